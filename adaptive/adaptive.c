@@ -0,0 +1,57 @@
+#include "adaptive.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+void adaptive_init(struct adaptive *adaptive, double threshold) {
+    adaptive->threshold = threshold;
+    adaptive->backend = REDISTRIBUTION_CENTER;
+    adaptive->contended = 0;
+    adaptive->reason = "not decided yet";
+}
+
+enum redistribution_backend adaptive_decide(struct adaptive *adaptive, const struct contention_counters *phase_1,
+                                            const struct phase_2_shape *shape) {
+    const struct contention_counters *stacks = &phase_1[CONTENTION_STACK];
+    const struct contention_counters *queues = &phase_1[CONTENTION_QUEUE];
+    uint64_t acquisitions = stacks->acquisitions + queues->acquisitions;
+    adaptive->contended = acquisitions > 0 ? (double) (stacks->contended + queues->contended) / (double) acquisitions : 0;
+
+    if (shape->inserters == 0 || shape->consumers == 0) {
+        adaptive->backend = REDISTRIBUTION_CENTER;
+        adaptive->reason = "nothing to redistribute";
+    } else if (adaptive->contended > adaptive->threshold) {
+        adaptive->backend = REDISTRIBUTION_P2P;
+        adaptive->reason = "the flights' locks were contended, the center would funnel every airline through one list";
+    } else if (shape->pending > ADAPTIVE_CENTER_LIMIT) {
+        adaptive->backend = REDISTRIBUTION_P2P;
+        adaptive->reason = "the overflow is too large for the center's sorted inserts";
+    } else {
+        adaptive->backend = REDISTRIBUTION_CENTER;
+        adaptive->reason = "the flights' locks were rarely contended and the overflow is small";
+    }
+
+    printf("Adaptive redistribution: phase 2 through the %s, %s\n", redistribution_backend_name(adaptive->backend),
+           adaptive->reason);
+    printf("Adaptive redistribution: %.2f%% of %" PRIu64 " stack & queue locks contended in phase 1 (threshold %.2f%%), "
+           "%" PRIu64 " pending reservations, %u inserter & %u consumer airlines\n", 100.0 * adaptive->contended,
+           acquisitions, 100.0 * adaptive->threshold, shape->pending, shape->inserters, shape->consumers);
+    return adaptive->backend;
+}
+
+void adaptive_review(const struct adaptive *adaptive, const struct contention_counters *phase_2, double seconds) {
+    if (adaptive->backend == REDISTRIBUTION_P2P) {
+        const struct contention_counters *board = &phase_2[CONTENTION_BOARD];
+        printf("Adaptive redistribution: phase 2 on the p2p board took %.3f ms, %" PRIu64 " claim retries\n",
+               seconds * 1e3, board->retries);
+    } else {
+        const struct contention_counters *center = &phase_2[CONTENTION_CENTER];
+        printf("Adaptive redistribution: phase 2 through the center took %.3f ms, %.2f%% of %" PRIu64
+               " center locks contended (%.3f ms waited), %" PRIu64 " failed validations\n", seconds * 1e3,
+               center->acquisitions > 0 ? 100.0 * (double) center->contended / (double) center->acquisitions : 0,
+               center->acquisitions, (double) center->wait_ns / 1e6, center->validate_failures);
+    }
+}
+
+const char *redistribution_backend_name(enum redistribution_backend backend) {
+    return backend == REDISTRIBUTION_P2P ? "p2p board" : "center";
+}
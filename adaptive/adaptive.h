@@ -0,0 +1,66 @@
+#ifndef HY486_PROJECT_ADAPTIVE_H
+#define HY486_PROJECT_ADAPTIVE_H
+
+#include <stdint.h>
+#include "../contention/contention.h"
+
+/**
+ * Overflow above which phase 2 goes through the board even without contention, since every insert
+ * walks the center's sorted list and their cost grows with the square of the overflow
+ */
+#define ADAPTIVE_CENTER_LIMIT 4096
+
+/**
+ * How phase 2 moves the overflow of the queues to under-full flights
+ */
+enum redistribution_backend {
+    REDISTRIBUTION_CENTER, // through the sorted lazy list of the management center
+    REDISTRIBUTION_P2P // straight into seats reserved on the matching board
+};
+
+/**
+ * What phase 2 has to do, as the controller finds it at the phase boundary
+ */
+struct phase_2_shape {
+    unsigned int inserters; // flights with pending reservations
+    unsigned int consumers; // flights with free seats
+    uint64_t pending; // reservations waiting in the queues
+};
+
+/**
+ * @brief Picks the phase 2 backend from the contention observed in phase 1 (--redistribution=adaptive).
+ *
+ * Only the redistribution adapts: the stacks, queues and center keep the representation they were built
+ * with, since the tree has no second runtime implementation of any of them to migrate their contents to.
+ * The center is a single list every airline goes through, which is cheap while the threads rarely find
+ * each other's locks held, whereas the board spreads block transfers over the flights' own stacks.
+ * The controller decides at the phase boundary, where every other thread waits at a barrier, so the
+ * airlines start phase 2 on the new backend without any handoff. Decisions are printed with the
+ * counters behind them, and so is a review of the phase 2 that followed.
+ */
+struct adaptive {
+    double threshold; // share of contended stack & queue locks above which the board is picked
+    enum redistribution_backend backend;
+    double contended; // the share phase 1 ran into
+    const char *reason;
+};
+
+void adaptive_init(struct adaptive *adaptive, double threshold);
+
+/**
+ * @param phase_1 The contention counters of phase 1, summed per structure
+ * @return The backend phase 2 should run on
+ */
+enum redistribution_backend adaptive_decide(struct adaptive *adaptive, const struct contention_counters *phase_1,
+                                            const struct phase_2_shape *shape);
+
+/**
+ * Prints how phase 2 went on the backend that was picked, so that the decision can be audited
+ * @param phase_2 The contention counters of phase 2, summed per structure
+ * @param seconds How long phase 2 took
+ */
+void adaptive_review(const struct adaptive *adaptive, const struct contention_counters *phase_2, double seconds);
+
+const char *redistribution_backend_name(enum redistribution_backend backend);
+
+#endif //HY486_PROJECT_ADAPTIVE_H
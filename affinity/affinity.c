@@ -0,0 +1,152 @@
+#define _GNU_SOURCE
+
+#include "affinity.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static enum pin_policy active_policy = PIN_NONE;
+
+/**
+ * The cores allowed when the process started, in placement order
+ */
+static int *cpu_order = NULL;
+static int num_cpus = 0;
+static cpu_set_t initial_mask;
+
+int parse_pin_policy(const char *name, enum pin_policy *policy) {
+    if (strcmp(name, "none") == 0) {
+        *policy = PIN_NONE;
+    } else if (strcmp(name, "compact") == 0) {
+        *policy = PIN_COMPACT;
+    } else if (strcmp(name, "scatter") == 0) {
+        *policy = PIN_SCATTER;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+const char *pin_policy_name(enum pin_policy policy) {
+    switch (policy) {
+        case PIN_COMPACT:
+            return "compact";
+        case PIN_SCATTER:
+            return "scatter";
+        default:
+            return "none";
+    }
+}
+
+/**
+ * @return The physical package (socket) of the given core, or 0 if the topology is unknown
+ */
+static int package_of(int cpu) {
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return 0;
+    }
+    int package = 0;
+    if (fscanf(file, "%d", &package) != 1) {
+        package = 0;
+    }
+    fclose(file);
+    return package;
+}
+
+int affinity_init(enum pin_policy policy) {
+    active_policy = PIN_NONE;
+    if (policy == PIN_NONE) {
+        return 1;
+    }
+
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &initial_mask) != 0) {
+        perror("sched_getaffinity");
+        return 0;
+    }
+    int allowed = CPU_COUNT(&initial_mask);
+    int *cpus = malloc(sizeof(int) * allowed);
+    int *packages = malloc(sizeof(int) * allowed);
+    cpu_order = malloc(sizeof(int) * allowed);
+    if (cpus == NULL || packages == NULL || cpu_order == NULL) {
+        free(cpus);
+        free(packages);
+        free(cpu_order);
+        cpu_order = NULL;
+        return 0;
+    }
+
+    int max_package = 0;
+    num_cpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE && num_cpus < allowed; cpu++) {
+        if (CPU_ISSET(cpu, &initial_mask)) {
+            cpus[num_cpus] = cpu;
+            packages[num_cpus] = package_of(cpu);
+            if (packages[num_cpus] > max_package) max_package = packages[num_cpus];
+            num_cpus++;
+        }
+    }
+
+    int placed = 0;
+    if (policy == PIN_COMPACT) {
+        // fill one package before moving on to the next
+        for (int package = 0; package <= max_package; package++) {
+            for (int i = 0; i < num_cpus; i++) {
+                if (packages[i] == package) cpu_order[placed++] = cpus[i];
+            }
+        }
+    } else {
+        // take the next unused core of every package in turn
+        while (placed < num_cpus) {
+            for (int package = 0; package <= max_package; package++) {
+                for (int i = 0; i < num_cpus; i++) {
+                    if (packages[i] == package) {
+                        cpu_order[placed++] = cpus[i];
+                        packages[i] = -1; // used
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    free(cpus);
+    free(packages);
+    active_policy = policy;
+    return 1;
+}
+
+int affinity_cpu_for_flight(unsigned int flight) {
+    if (active_policy == PIN_NONE || num_cpus == 0) {
+        return -1;
+    }
+    return cpu_order[flight % num_cpus];
+}
+
+int pin_current_thread(int cpu) {
+    if (cpu < 0) {
+        return 1;
+    }
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &mask) == 0;
+}
+
+void unpin_current_thread(void) {
+    if (active_policy == PIN_NONE) {
+        return;
+    }
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &initial_mask);
+}
+
+void affinity_destroy(void) {
+    free(cpu_order);
+    cpu_order = NULL;
+    num_cpus = 0;
+    active_policy = PIN_NONE;
+}
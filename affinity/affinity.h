@@ -0,0 +1,49 @@
+#ifndef HY486_PROJECT_AFFINITY_H
+#define HY486_PROJECT_AFFINITY_H
+
+/**
+ * How a flight group (the A agencies of a flight, its airline and the flight's
+ * stack & queue headers) is placed on the available cores. The reservation nodes are
+ * allocated by whichever thread pushes them, so only those of the group's own threads
+ * are first touched on its core.
+ */
+enum pin_policy {
+    PIN_NONE, // leave placement to the scheduler
+    PIN_COMPACT, // consecutive flight groups on neighbouring cores of the same package
+    PIN_SCATTER // consecutive flight groups spread round-robin across packages
+};
+
+/**
+ * @return 1 if name is a known policy (stored in policy), 0 otherwise
+ */
+int parse_pin_policy(const char *name, enum pin_policy *policy);
+
+const char *pin_policy_name(enum pin_policy policy);
+
+/**
+ * Builds the core ordering used by the given policy out of the cores this process is
+ * allowed to run on. Must be called before any thread is pinned.
+ * @return 1 if successful, 0 otherwise (pinning is then disabled)
+ */
+int affinity_init(enum pin_policy policy);
+
+/**
+ * @param flight The flight's position in the flights table
+ * @return The core the flight's group is placed on, or -1 if pinning is disabled
+ */
+int affinity_cpu_for_flight(unsigned int flight);
+
+/**
+ * Pins the calling thread to a single core. Does nothing for cpu == -1.
+ * @return 1 if successful, 0 otherwise
+ */
+int pin_current_thread(int cpu);
+
+/**
+ * Lets the calling thread run on every core it was originally allowed to.
+ */
+void unpin_current_thread(void);
+
+void affinity_destroy(void);
+
+#endif //HY486_PROJECT_AFFINITY_H
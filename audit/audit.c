@@ -0,0 +1,147 @@
+#include "audit.h"
+#include "../stack/stack.h"
+#include "../queue/queue.h"
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Totals of every flow over all threads
+ */
+struct audit_totals {
+    uint64_t flows[AUDIT_FLOWS];
+};
+
+int auditor_init(struct auditor *auditor, unsigned int num_slots, struct flight_reservations **flights,
+                 unsigned int numOfFlights, struct list *management_center, unsigned int interval_ms) {
+    auditor->slots = aligned_alloc(_Alignof(struct audit_counters), sizeof(struct audit_counters) * num_slots);
+    if (auditor->slots == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < num_slots; i++) {
+        atomic_init(&auditor->slots[i].version, 0);
+        for (int flow = 0; flow < AUDIT_FLOWS; flow++) {
+            atomic_init(&auditor->slots[i].flows[flow], 0);
+        }
+    }
+    auditor->num_slots = num_slots;
+    auditor->flights = flights;
+    auditor->num_flights = numOfFlights;
+    auditor->management_center = management_center;
+    auditor->interval_ms = interval_ms;
+    atomic_init(&auditor->stop, 0);
+    auditor->audits = 0;
+    auditor->exact_audits = 0;
+    auditor->violations = 0;
+    return 1;
+}
+
+/**
+ * Sums the counters of all threads. Unless racing, a thread's flows are read as they are,
+ * so some of its latest moves may be missing; that's what the lower bounds are built on.
+ * With settled set, a thread in the middle of an operation is waited for, so that every
+ * move already visible in the structures is counted; that's what the upper bounds need.
+ */
+static void read_totals(struct auditor *auditor, struct audit_totals *totals, int settled) {
+    memset(totals, 0, sizeof(struct audit_totals));
+    for (unsigned int i = 0; i < auditor->num_slots; i++) {
+        struct audit_counters *counters = &auditor->slots[i];
+        if (settled) {
+            while (atomic_load_explicit(&counters->version, memory_order_acquire) & 1) {
+                sched_yield(); // operations are short, this only waits for the current one
+            }
+        }
+        for (int flow = 0; flow < AUDIT_FLOWS; flow++) {
+            totals->flows[flow] += atomic_load_explicit(&counters->flows[flow], memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Checks that an observed size lies within what the flows allow
+ * @return 1 if it does, 0 otherwise
+ */
+static int check_bounds(const char *name, uint64_t observed, uint64_t in_before, uint64_t out_before,
+                        uint64_t in_after, uint64_t out_after) {
+    int64_t lower = (int64_t) in_before - (int64_t) out_after;
+    int64_t upper = (int64_t) in_after - (int64_t) out_before;
+    if ((int64_t) observed < lower || (int64_t) observed > upper) {
+        printf("Audit violation: %s hold %" PRIu64 " reservations, the flows allow %" PRId64 " to %" PRId64 "\n",
+               name, observed, lower, upper);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Runs a single audit
+ * @return 1 if every invariant held, 0 otherwise
+ */
+static int audit_once(struct auditor *auditor) {
+    struct audit_totals before, after;
+    int result = 1;
+
+    read_totals(auditor, &before, 0);
+    uint64_t stacked = 0, queued = 0;
+    for (unsigned int i = 0; i < auditor->num_flights; i++) {
+        struct stack *stack = auditor->flights[i]->completed_reservations;
+        unsigned int size = stack->size;
+        if (size > stack->capacity) {
+            printf("Audit violation: flight %u holds %u reservations but has %u seats\n", i, size, stack->capacity);
+            result = 0;
+        }
+        stacked += size;
+        queued += auditor->flights[i]->pending_reservations->size;
+    }
+    uint64_t centered = auditor->management_center->size;
+    // the sizes must be read before any version in the second pass
+    atomic_thread_fence(memory_order_seq_cst);
+    read_totals(auditor, &after, 1);
+
+    const uint64_t *b = before.flows, *a = after.flows;
+    result &= check_bounds("the stacks", stacked,
+                           b[AUDIT_PUSHED] + b[AUDIT_CENTER_TO_STACK], b[AUDIT_RELEASED],
+                           a[AUDIT_PUSHED] + a[AUDIT_CENTER_TO_STACK], a[AUDIT_RELEASED]);
+    result &= check_bounds("the queues", queued,
+                           b[AUDIT_ENQUEUED] + b[AUDIT_CENTER_TO_QUEUE], b[AUDIT_TO_CENTER],
+                           a[AUDIT_ENQUEUED] + a[AUDIT_CENTER_TO_QUEUE], a[AUDIT_TO_CENTER]);
+    result &= check_bounds("the center", centered,
+                           b[AUDIT_TO_CENTER], b[AUDIT_CENTER_TO_STACK] + b[AUDIT_CENTER_TO_QUEUE],
+                           a[AUDIT_TO_CENTER], a[AUDIT_CENTER_TO_STACK] + a[AUDIT_CENTER_TO_QUEUE]);
+
+    auditor->audits++;
+    if (memcmp(&before, &after, sizeof(struct audit_totals)) == 0) auditor->exact_audits++;
+    if (!result) auditor->violations++;
+    return result;
+}
+
+static void *auditor_main(void *args) {
+    struct auditor *auditor = (struct auditor *) args;
+    struct timespec ts = {auditor->interval_ms / 1000, (long) (auditor->interval_ms % 1000) * 1000000L};
+    while (!atomic_load_explicit(&auditor->stop, memory_order_acquire)) {
+        nanosleep(&ts, NULL);
+        audit_once(auditor);
+    }
+    return NULL;
+}
+
+int auditor_start(struct auditor *auditor) {
+    return pthread_create(&auditor->thread, NULL, auditor_main, auditor) == 0;
+}
+
+int auditor_stop(struct auditor *auditor) {
+    atomic_store_explicit(&auditor->stop, 1, memory_order_release);
+    pthread_join(auditor->thread, NULL);
+    // everything is quiescent by now, so this one is exact
+    audit_once(auditor);
+    printf("Online audit: %" PRIu64 " audits (%" PRIu64 " exact), %" PRIu64 " with violations\n",
+           auditor->audits, auditor->exact_audits, auditor->violations);
+    return auditor->violations == 0;
+}
+
+void auditor_destroy(struct auditor *auditor) {
+    free(auditor->slots);
+}
@@ -0,0 +1,93 @@
+#ifndef HY486_PROJECT_AUDIT_H
+#define HY486_PROJECT_AUDIT_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include "../common/reservations.h"
+#include "../list/lazy_list.h"
+
+/**
+ * Moves of reservations between the structures, counted by the thread that makes them
+ */
+enum audit_flow {
+    AUDIT_PUSHED, // agency booked it on a stack
+    AUDIT_ENQUEUED, // agency booked it on a queue
+    AUDIT_TO_CENTER, // airline moved it from its queue to the center
+    AUDIT_CENTER_TO_STACK, // airline moved it from the center to its stack
+    AUDIT_CENTER_TO_QUEUE, // airline took it from the center but its stack filled up, so it went back to its queue
+    AUDIT_RELEASED, // service released its seat
+    AUDIT_FLOWS
+};
+
+/**
+ * Versioned flow counters of one thread, on their own cache line. The version is odd while the
+ * thread is in the middle of an operation, i.e. has changed a structure but not counted it yet.
+ */
+struct audit_counters {
+    _Alignas(64) atomic_uint version;
+    atomic_uint_fast64_t flows[AUDIT_FLOWS];
+};
+
+/**
+ * @brief Online auditor of the reservation structures.
+ *
+ * Every interval a background thread checks that the stacks, queues and center hold exactly the
+ * reservations that the flow counters say they should, without taking any lock. It reads all counters,
+ * then the sizes of the structures, then all counters again, waiting only for threads that are in the
+ * middle of an operation. Since flows only grow, every size must lie between what went in by the first
+ * read minus what left by the second, and what went in by the second minus what left by the first.
+ * When nothing moved between the two reads the bounds meet and the check is exact.
+ */
+struct auditor {
+    unsigned int num_slots; // one per agency (or replay worker) and one per airline
+    struct audit_counters *slots;
+    struct flight_reservations **flights;
+    unsigned int num_flights;
+    struct list *management_center;
+    unsigned int interval_ms;
+    atomic_int stop;
+    pthread_t thread;
+    uint64_t audits;
+    uint64_t exact_audits;
+    uint64_t violations;
+};
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int auditor_init(struct auditor *auditor, unsigned int num_slots, struct flight_reservations **flights,
+                 unsigned int numOfFlights, struct list *management_center, unsigned int interval_ms);
+
+static inline void audit_begin(struct audit_counters *counters) {
+    unsigned int version = atomic_load_explicit(&counters->version, memory_order_relaxed);
+    atomic_store_explicit(&counters->version, version + 1, memory_order_relaxed);
+    // the odd version must be visible before any change to the structures
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+static inline void audit_count(struct audit_counters *counters, enum audit_flow flow) {
+    atomic_store_explicit(&counters->flows[flow],
+                          atomic_load_explicit(&counters->flows[flow], memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static inline void audit_end(struct audit_counters *counters) {
+    unsigned int version = atomic_load_explicit(&counters->version, memory_order_relaxed);
+    atomic_store_explicit(&counters->version, version + 1, memory_order_release);
+}
+
+/**
+ * Starts the background thread, which audits every interval until auditor_stop is called
+ * @return 1 if successful, 0 otherwise
+ */
+int auditor_start(struct auditor *auditor);
+
+/**
+ * Stops the background thread, runs a last audit and prints a summary of all audits
+ * @return 1 if no audit found a violation, 0 otherwise
+ */
+int auditor_stop(struct auditor *auditor);
+
+void auditor_destroy(struct auditor *auditor);
+
+#endif //HY486_PROJECT_AUDIT_H
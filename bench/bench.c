@@ -0,0 +1,615 @@
+/**
+ * Microbenchmarks of the stack, the queue and the lazy list in isolation. Every run prefills a
+ * container, lets a number of threads add and remove reservations in a given mix for a given time,
+ * and reports the throughput, the speedup over the first thread count and the mallocs and frees per
+ * operation. Once the workers stop, the remaining reservations are read over and over the way the
+ * checks read them (in place, block by block, in UNROLLED_NODES builds, exported in chunks otherwise)
+ * and the reservations read per second are reported too. The allocations are counted by wrapping malloc & free at link time (see the Makefile),
+ * so only the containers' own calls are counted. With --index every add also records the reservation's
+ * location in a reservation index first, as the simulation does, which measures its write-path overhead.
+ * Built with LATENCY_HISTOGRAMS, every worker records into a latency slot of its own and the latencies
+ * of each run are printed after its results.
+ *
+ * Usage: ./bin/bench [--container=stack|queue|list|all] [--threads=1,2,4] [--mix=ADD_PERCENT]
+ *                    [--keys=uniform|sequential|zipf] [--zipf-s=S] [--key-range=N] [--prefill=N]
+ *                    [--duration=SECONDS] [--seed=N] [--index]
+ */
+
+#include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../stack/stack.h"
+#include "../queue/queue.h"
+#include "../list/lazy_list.h"
+#include "../workload/workload.h"
+#include "../index/reservation_index.h"
+#include "../latency/latency.h"
+
+#define MAX_THREAD_COUNTS 32
+
+/**
+ * Operations a worker runs between two looks at the stop flag
+ */
+#define OPERATION_BATCH 64
+
+/**
+ * Reservations a walk exports at a time, like the checks do
+ */
+#define WALK_CHUNK 1024
+
+/**
+ * How long the remaining reservations are walked after each run, in seconds
+ */
+#define WALK_SECONDS 0.05
+
+/**
+ * Where the walks' sums go, so that their reads aren't optimized away
+ */
+static volatile uint64_t walk_sink;
+
+void *__real_malloc(size_t size);
+
+void __real_free(void *ptr);
+
+static __thread uint64_t thread_allocations;
+static __thread uint64_t thread_frees;
+
+void *__wrap_malloc(size_t size) {
+    thread_allocations++;
+    return __real_malloc(size);
+}
+
+void __wrap_free(void *ptr) {
+    if (ptr != NULL) thread_frees++;
+    __real_free(ptr);
+}
+
+enum key_distribution {
+    KEYS_UNIFORM,
+    KEYS_SEQUENTIAL, // every thread adds its own increasing keys, the worst case for the sorted list
+    KEYS_ZIPF
+};
+
+struct bench_config {
+    const char *container; // a container's name or "all"
+    unsigned int threads[MAX_THREAD_COUNTS];
+    unsigned int num_thread_counts;
+    unsigned int add_percent; // share of adds (push, enqueue, insert), the rest are removals
+    enum key_distribution keys;
+    double zipf_s;
+    unsigned int key_range; // keys are drawn from 1..key_range
+    unsigned int prefill;
+    double duration;
+    uint64_t seed;
+    int index; // record every added reservation in a reservation index
+};
+
+/**
+ * A container as the benchmark drives it
+ */
+struct container_ops {
+    const char *name;
+    void *(*create)(void);
+    /**
+     * Loads reservations sorted by increasing, distinct numbers
+     */
+    void (*prefill)(void *container, const struct Reservation *reservations, unsigned int count);
+    /**
+     * @return 1 if the reservation was added
+     */
+    int (*add)(void *container, struct Reservation reservation);
+    /**
+     * @return 1 if a reservation was removed
+     */
+    int (*remove)(void *container);
+    unsigned int (*size)(void *container);
+    /**
+     * Reads every reservation of a quiescent container once
+     * @param sum Set to the sum of their numbers
+     * @return The number of reservations read
+     */
+    uint64_t (*walk)(void *container, uint64_t *sum);
+    void (*destroy)(void *container);
+    enum reservation_place place; // what the index records for an added reservation
+};
+
+static void *stack_create(void) {
+    return createStack(UINT32_MAX); // unbounded, a full stack would turn pushes into no-ops
+}
+
+static void stack_prefill(void *container, const struct Reservation *reservations, unsigned int count) {
+    pushBulk(container, reservations, count);
+}
+
+static int stack_add(void *container, struct Reservation reservation) {
+    return push(container, reservation);
+}
+
+static int stack_remove(void *container) {
+    return pop(container).reservation_number != -1;
+}
+
+static unsigned int stack_size(void *container) {
+    return ((struct stack *) container)->size;
+}
+
+static uint64_t stack_walk(void *container, uint64_t *sum) {
+    uint64_t read = 0;
+    *sum = 0;
+    struct reservation_cursor cursor = {0};
+#ifdef UNROLLED_NODES
+    struct reservation_span span;
+    while (nextStackSpan(container, &cursor, &span)) {
+        for (size_t i = 0; i < span.count; i++) *sum += (uint64_t) span.reservations[i].reservation_number;
+        read += span.count;
+    }
+#else
+    struct Reservation chunk[WALK_CHUNK];
+    unsigned int count;
+    while ((count = exportStack(container, &cursor, chunk, WALK_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) *sum += (uint64_t) chunk[i].reservation_number;
+        read += count;
+    }
+#endif
+    return read;
+}
+
+static void stack_destroy(void *container) {
+    destroyStack(container);
+}
+
+static void *queue_create(void) {
+    return createQueue();
+}
+
+static void queue_prefill(void *container, const struct Reservation *reservations, unsigned int count) {
+    enqueueBulk(container, reservations, count);
+}
+
+static int queue_add(void *container, struct Reservation reservation) {
+    enqueue(container, reservation);
+    return 1;
+}
+
+static int queue_remove(void *container) {
+    return dequeue(container).reservation_number != -1;
+}
+
+static unsigned int queue_size(void *container) {
+    return ((struct queue *) container)->size;
+}
+
+static uint64_t queue_walk(void *container, uint64_t *sum) {
+    uint64_t read = 0;
+    *sum = 0;
+    struct reservation_cursor cursor = {0};
+#ifdef UNROLLED_NODES
+    struct reservation_span span;
+    while (nextQueueSpan(container, &cursor, &span)) {
+        for (size_t i = 0; i < span.count; i++) *sum += (uint64_t) span.reservations[i].reservation_number;
+        read += span.count;
+    }
+#else
+    struct Reservation chunk[WALK_CHUNK];
+    unsigned int count;
+    while ((count = exportQueue(container, &cursor, chunk, WALK_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) *sum += (uint64_t) chunk[i].reservation_number;
+        read += count;
+    }
+#endif
+    return read;
+}
+
+static void queue_destroy(void *container) {
+    destroyQueue(container);
+}
+
+static void *list_create(void) {
+    return create_list();
+}
+
+static void list_prefill(void *container, const struct Reservation *reservations, unsigned int count) {
+    appendSortedBulk(container, reservations, count);
+}
+
+static int list_add(void *container, struct Reservation reservation) {
+    return insert(container, reservation);
+}
+
+static int list_remove(void *container) {
+    return deleteAndGet(container).reservation_number != -1;
+}
+
+static unsigned int list_size(void *container) {
+    return ((struct list *) container)->size;
+}
+
+static uint64_t list_walk(void *container, uint64_t *sum) {
+    uint64_t read = 0;
+    *sum = 0;
+    struct reservation_cursor cursor = {0};
+    struct Reservation chunk[WALK_CHUNK];
+    unsigned int count;
+    while ((count = exportList(container, &cursor, chunk, WALK_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) *sum += (uint64_t) chunk[i].reservation_number;
+        read += count;
+    }
+    return read;
+}
+
+static void list_destroy(void *container) {
+    destroyList(container);
+}
+
+static const struct container_ops containers[] = {
+        {"stack", stack_create, stack_prefill, stack_add, stack_remove, stack_size, stack_walk, stack_destroy,
+                PLACE_STACK},
+        {"queue", queue_create, queue_prefill, queue_add, queue_remove, queue_size, queue_walk, queue_destroy,
+                PLACE_QUEUE},
+        {"list",  list_create,  list_prefill,  list_add,  list_remove,  list_size,  list_walk,  list_destroy,
+                PLACE_CENTER},
+};
+
+#define NUM_CONTAINERS (sizeof(containers) / sizeof(containers[0]))
+
+/**
+ * State shared by the workers of one run
+ */
+struct bench_run {
+    const struct bench_config *config;
+    const struct container_ops *ops;
+    void *container;
+    struct reservation_index *index; // NULL unless adds are indexed
+    const struct workload *key_workload; // draws uniform & zipf keys
+    unsigned int num_threads;
+#ifdef LATENCY_HISTOGRAMS
+    struct latency_recorders *latencies; // a slot per worker
+#endif
+    pthread_barrier_t start;
+    atomic_int stop;
+};
+
+struct bench_worker {
+    struct bench_run *run;
+    unsigned int index;
+    pthread_t thread;
+    uint64_t operations;
+    uint64_t allocations;
+    uint64_t frees;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * splitmix64, for the operation mix
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void *bench_worker_main(void *args) {
+    struct bench_worker *worker = (struct bench_worker *) args;
+    struct bench_run *run = worker->run;
+    const struct bench_config *config = run->config;
+    uint64_t mix_state = config->seed ^ (0x51ED270B27ull * (worker->index + 1));
+    struct workload_agency keys;
+    workload_agency_init(run->key_workload, &keys, (int) worker->index + 1);
+    uint64_t sequence = worker->index;
+#ifdef LATENCY_HISTOGRAMS
+    latency_attach(run->latencies, worker->index, LATENCY_NO_FLIGHT); // the containers aren't a flight's
+#endif
+
+    pthread_barrier_wait(&run->start);
+    uint64_t allocations = thread_allocations, frees = thread_frees;
+    uint64_t operations = 0;
+    while (!atomic_load_explicit(&run->stop, memory_order_relaxed)) {
+        for (int i = 0; i < OPERATION_BATCH; i++) {
+            if (next_random(&mix_state) % 100 < config->add_percent) {
+                unsigned int key;
+                if (config->keys == KEYS_SEQUENTIAL) {
+                    key = (unsigned int) (sequence % config->key_range);
+                    sequence += run->num_threads;
+                } else {
+                    key = workload_next_flight(run->key_workload, &keys, 0);
+                }
+                struct Reservation reservation = {(int) worker->index + 1, (reservation_number_t) key + 1};
+                if (run->index != NULL) {
+                    reservation_index_set(run->index, reservation.reservation_number, run->ops->place, 0);
+                }
+                run->ops->add(run->container, reservation);
+            } else {
+                run->ops->remove(run->container);
+            }
+        }
+        operations += OPERATION_BATCH;
+    }
+    worker->operations = operations;
+    worker->allocations = thread_allocations - allocations;
+    worker->frees = thread_frees - frees;
+    return NULL;
+}
+
+/**
+ * Results of one run
+ */
+struct bench_result {
+    double ops_per_second;
+    double allocations_per_op;
+    double frees_per_op;
+    unsigned int final_size;
+    double walked_per_second; // reservations of the final contents read per second
+#ifdef LATENCY_HISTOGRAMS
+    struct latency_recorders latencies; // reported & destroyed by the caller
+#endif
+};
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+static int run_bench(const struct bench_config *config, const struct container_ops *ops,
+                     const struct workload *key_workload, const struct Reservation *prefill,
+                     unsigned int num_threads, struct bench_result *result) {
+#ifdef LATENCY_HISTOGRAMS
+    if (!latency_init(&result->latencies, num_threads)) {
+        fprintf(stderr, "Could not allocate the latency recorders\n");
+        return 0;
+    }
+#endif
+    struct reservation_index index;
+    if (config->index && !reservation_index_init(&index, config->key_range)) {
+        fprintf(stderr, "Could not allocate the reservation index\n");
+#ifdef LATENCY_HISTOGRAMS
+        latency_destroy(&result->latencies);
+#endif
+        return 0;
+    }
+    struct bench_run run;
+    run.config = config;
+    run.ops = ops;
+    run.container = ops->create();
+    run.key_workload = key_workload;
+    run.num_threads = num_threads;
+#ifdef LATENCY_HISTOGRAMS
+    run.latencies = &result->latencies;
+#endif
+    run.index = config->index ? &index : NULL;
+    pthread_barrier_init(&run.start, NULL, num_threads + 1);
+    atomic_init(&run.stop, 0);
+    ops->prefill(run.container, prefill, config->prefill);
+
+    struct bench_worker *workers = calloc(num_threads, sizeof(struct bench_worker));
+    for (unsigned int i = 0; i < num_threads; i++) {
+        workers[i].run = &run;
+        workers[i].index = i;
+        pthread_create(&workers[i].thread, NULL, bench_worker_main, &workers[i]);
+    }
+    pthread_barrier_wait(&run.start);
+    double start = now_seconds();
+    struct timespec ts = {(time_t) config->duration,
+                          (long) ((config->duration - (double) (time_t) config->duration) * 1e9)};
+    nanosleep(&ts, NULL);
+    atomic_store_explicit(&run.stop, 1, memory_order_relaxed);
+
+    uint64_t operations = 0, allocations = 0, frees = 0;
+    for (unsigned int i = 0; i < num_threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        operations += workers[i].operations;
+        allocations += workers[i].allocations;
+        frees += workers[i].frees;
+    }
+    double elapsed = now_seconds() - start;
+
+    result->ops_per_second = (double) operations / elapsed;
+    result->allocations_per_op = operations > 0 ? (double) allocations / (double) operations : 0;
+    result->frees_per_op = operations > 0 ? (double) frees / (double) operations : 0;
+    result->final_size = ops->size(run.container);
+
+    // the workers are joined, so the container is quiescent as the walks require
+    uint64_t walked = 0, sum = 0;
+    int walked_all = 1;
+    double walk_start = now_seconds(), walk_elapsed;
+    do {
+        uint64_t read = ops->walk(run.container, &sum);
+        walk_sink += sum;
+        walked += read;
+        walked_all = read == result->final_size;
+        walk_elapsed = now_seconds() - walk_start;
+    } while (walked_all && walk_elapsed < WALK_SECONDS);
+    result->walked_per_second = walk_elapsed > 0 ? (double) walked / walk_elapsed : 0;
+
+    free(workers);
+    pthread_barrier_destroy(&run.start);
+    ops->destroy(run.container);
+    if (run.index != NULL) reservation_index_destroy(run.index);
+    if (!walked_all) {
+        fprintf(stderr, "Walking the %s didn't read its %u reservations\n", ops->name, result->final_size);
+#ifdef LATENCY_HISTOGRAMS
+        latency_destroy(&result->latencies);
+#endif
+        return 0;
+    }
+    return 1;
+}
+
+static int parse_thread_counts(const char *arg, struct bench_config *config) {
+    config->num_thread_counts = 0;
+    const char *p = arg;
+    while (*p != '\0') {
+        char *end;
+        unsigned long threads = strtoul(p, &end, 10);
+        if (end == p || threads == 0 || config->num_thread_counts == MAX_THREAD_COUNTS) return 0;
+        config->threads[config->num_thread_counts++] = (unsigned int) threads;
+        if (*end == ',') end++;
+        else if (*end != '\0') return 0;
+        p = end;
+    }
+    return config->num_thread_counts > 0;
+}
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [--container=stack|queue|list|all] [--threads=1,2,4] [--mix=ADD_PERCENT]\n"
+                    "       [--keys=uniform|sequential|zipf] [--zipf-s=S] [--key-range=N] [--prefill=N]\n"
+                    "       [--duration=SECONDS] [--seed=N] [--index]\n", program);
+}
+
+enum bench_option_id {
+    OPT_CONTAINER = 256,
+    OPT_THREADS,
+    OPT_MIX,
+    OPT_KEYS,
+    OPT_ZIPF_S,
+    OPT_KEY_RANGE,
+    OPT_PREFILL,
+    OPT_DURATION,
+    OPT_SEED,
+    OPT_INDEX,
+};
+
+static const struct option long_options[] = {
+        {"container", required_argument, NULL, OPT_CONTAINER},
+        {"threads",   required_argument, NULL, OPT_THREADS},
+        {"mix",       required_argument, NULL, OPT_MIX},
+        {"keys",      required_argument, NULL, OPT_KEYS},
+        {"zipf-s",    required_argument, NULL, OPT_ZIPF_S},
+        {"key-range", required_argument, NULL, OPT_KEY_RANGE},
+        {"prefill",   required_argument, NULL, OPT_PREFILL},
+        {"duration",  required_argument, NULL, OPT_DURATION},
+        {"seed",      required_argument, NULL, OPT_SEED},
+        {"index",     no_argument,       NULL, OPT_INDEX},
+        {NULL, 0,                        NULL, 0}
+};
+
+static int parse_bench_options(int argc, char *argv[], struct bench_config *config) {
+    config->container = "all";
+    config->threads[0] = 1;
+    config->threads[1] = 2;
+    config->threads[2] = 4;
+    config->num_thread_counts = 3;
+    config->add_percent = 50;
+    config->keys = KEYS_UNIFORM;
+    config->zipf_s = 0.99;
+    config->key_range = 65536;
+    config->prefill = 1024;
+    config->duration = 1.0;
+    config->seed = 42;
+    config->index = 0;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (option) {
+            case OPT_CONTAINER:
+                config->container = optarg;
+                break;
+            case OPT_THREADS:
+                if (!parse_thread_counts(optarg, config)) return 0;
+                break;
+            case OPT_MIX:
+                config->add_percent = (unsigned int) strtoul(optarg, NULL, 10);
+                if (config->add_percent > 100) return 0;
+                break;
+            case OPT_KEYS:
+                if (strcmp(optarg, "uniform") == 0) config->keys = KEYS_UNIFORM;
+                else if (strcmp(optarg, "sequential") == 0) config->keys = KEYS_SEQUENTIAL;
+                else if (strcmp(optarg, "zipf") == 0) config->keys = KEYS_ZIPF;
+                else return 0;
+                break;
+            case OPT_ZIPF_S:
+                config->zipf_s = strtod(optarg, NULL);
+                break;
+            case OPT_KEY_RANGE:
+                config->key_range = (unsigned int) strtoul(optarg, NULL, 10);
+                if (config->key_range == 0) return 0;
+                break;
+            case OPT_PREFILL:
+                config->prefill = (unsigned int) strtoul(optarg, NULL, 10);
+                break;
+            case OPT_DURATION:
+                config->duration = strtod(optarg, NULL);
+                if (config->duration <= 0) return 0;
+                break;
+            case OPT_SEED:
+                config->seed = strtoull(optarg, NULL, 10);
+                break;
+            case OPT_INDEX:
+                config->index = 1;
+                break;
+            default:
+                return 0;
+        }
+    }
+    if (strcmp(config->container, "all") != 0) {
+        for (size_t i = 0; i < NUM_CONTAINERS; i++) {
+            if (strcmp(config->container, containers[i].name) == 0) return 1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    struct bench_config config;
+    if (!parse_bench_options(argc, argv, &config)) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    // uniform keys are a Zipf distribution with exponent 0
+    struct workload_config key_config = {FLIGHTS_ZIPF, config.keys == KEYS_ZIPF ? config.zipf_s : 0,
+                                         config.seed, 0, 0, 0, 0};
+    struct workload key_workload;
+    if (!workload_init(&key_workload, &key_config, config.key_range)) {
+        return 1;
+    }
+
+    // the prefilled keys are spread evenly over the key range, sorted and distinct as the list needs them
+    struct Reservation *prefill = malloc(sizeof(struct Reservation) * (config.prefill > 0 ? config.prefill : 1));
+    for (unsigned int i = 0; i < config.prefill; i++) {
+        prefill[i].agency_id = 0;
+        prefill[i].reservation_number = (reservation_number_t) ((uint64_t) i * config.key_range / config.prefill) + 1;
+    }
+
+    static const char *key_names[] = {"uniform", "sequential", "zipf"};
+    printf("%u%% adds, %s keys over 1..%u, prefill %u, %.2f s per run\n", config.add_percent,
+           key_names[config.keys], config.key_range, config.prefill, config.duration);
+#ifdef UNROLLED_NODES
+    printf("unrolled stack & queue nodes of %u & %u reservations\n", STACK_BLOCK_RESERVATIONS, QUEUE_BLOCK_RESERVATIONS);
+#endif
+    if (config.index) printf("every add is recorded in a reservation index first\n");
+    printf("%-9s %7s %14s %8s %10s %9s %10s %14s\n", "container", "threads", "ops/s", "speedup", "allocs/op",
+           "frees/op", "final size", "walked/s");
+    for (size_t c = 0; c < NUM_CONTAINERS; c++) {
+        const struct container_ops *ops = &containers[c];
+        if (strcmp(config.container, "all") != 0 && strcmp(config.container, ops->name) != 0) continue;
+        double baseline = 0;
+        for (unsigned int t = 0; t < config.num_thread_counts; t++) {
+            struct bench_result result;
+            if (!run_bench(&config, ops, &key_workload, prefill, config.threads[t], &result)) return 1;
+            if (t == 0) baseline = result.ops_per_second;
+            printf("%-9s %7u %14.0f %7.2fx %10.3f %9.3f %10u %14.0f\n", ops->name, config.threads[t],
+                   result.ops_per_second, result.ops_per_second / baseline, result.allocations_per_op,
+                   result.frees_per_op, result.final_size, result.walked_per_second);
+#ifdef LATENCY_HISTOGRAMS
+            char label[64];
+            snprintf(label, sizeof(label), "%s with %u thread(s)", ops->name, config.threads[t]);
+            latency_report(&result.latencies, label, 0);
+            latency_destroy(&result.latencies);
+#endif
+        }
+    }
+
+    free(prefill);
+    workload_destroy(&key_workload);
+    return 0;
+}
@@ -0,0 +1,190 @@
+/**
+ * Measures what false sharing costs the real stack and queue, in the layout of the build it's part of.
+ * Every queue gets a pair of threads, an enqueuer and a dequeuer, which in the default build write
+ * locks and ends that share cache lines and in CACHE_LAYOUT builds only share the size. Every stack
+ * gets a thread pushing & popping and one polling isStackFull, as agencies do before they push.
+ * Build it with `make false-sharing` and again with `make false-sharing CACHE_LAYOUT=1` (after a
+ * `make clean`) and compare the two.
+ *
+ * Usage: ./bin/false_sharing [pairs] [seconds]
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "../queue/queue.h"
+#include "../stack/stack.h"
+
+/**
+ * Enqueuers hold off while a queue holds this many reservations, which keeps the memory bounded
+ * when the dequeuer falls behind
+ */
+#define QUEUE_BOUND 4096
+
+/**
+ * Capacity of every stack, which the pushing thread never fills
+ */
+#define STACK_CAPACITY 1024
+
+enum role {
+    ROLE_ENQUEUE,
+    ROLE_DEQUEUE,
+    ROLE_PUSH_POP,
+    ROLE_POLL
+};
+
+struct worker {
+    enum role role;
+    struct queue *queue;
+    struct stack *stack;
+    int cpu;
+    atomic_int *stop;
+    uint64_t operations;
+    pthread_t thread;
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/**
+ * Runs up to 256 operations of the worker's role
+ * @return The number of operations that did something, i.e. not counting dequeues from an empty queue
+ */
+static unsigned int run_round(struct worker *worker) {
+    struct Reservation reservation = {1, 1};
+    unsigned int done = 256;
+    switch (worker->role) {
+        case ROLE_ENQUEUE:
+            if (worker->queue->size >= QUEUE_BOUND) {
+                sched_yield();
+                return 0;
+            }
+            for (int i = 0; i < 256; i++) enqueue(worker->queue, reservation);
+            break;
+        case ROLE_DEQUEUE:
+            for (int i = 0; i < 256; i++) {
+                if (dequeue(worker->queue).reservation_number == -1) done--;
+            }
+            break;
+        case ROLE_PUSH_POP:
+            for (int i = 0; i < 128; i++) {
+                push(worker->stack, reservation);
+                pop(worker->stack);
+            }
+            break;
+        case ROLE_POLL:
+            for (int i = 0; i < 256; i++) {
+                // the result is used so that the read isn't optimized away
+                if (isStackFull(worker->stack)) sched_yield();
+            }
+            break;
+    }
+    return done;
+}
+
+static void *worker_main(void *args) {
+    struct worker *worker = (struct worker *) args;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    while (!atomic_load_explicit(worker->stop, memory_order_relaxed)) {
+        worker->operations += run_round(worker);
+    }
+    return NULL;
+}
+
+/**
+ * Runs the workers for the given time
+ * @param rates Set to the operations per second of the first and the second worker of every pair
+ */
+static void run(struct worker *workers, unsigned int num_workers, double seconds, double rates[2]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    atomic_int stop;
+    atomic_init(&stop, 0);
+    for (unsigned int i = 0; i < num_workers; i++) {
+        workers[i].cpu = (int) (i % (cpus > 0 ? cpus : 1)); // the two threads of a pair on neighbouring cores
+        workers[i].stop = &stop;
+        workers[i].operations = 0;
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    struct timespec ts = {(time_t) seconds, (long) ((seconds - (double) (time_t) seconds) * 1e9)};
+    double start = now_seconds();
+    nanosleep(&ts, NULL);
+    atomic_store(&stop, 1);
+    uint64_t operations[2] = {0, 0};
+    for (unsigned int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i].thread, NULL);
+        operations[i % 2] += workers[i].operations;
+    }
+    double elapsed = now_seconds() - start;
+    rates[0] = (double) operations[0] / elapsed;
+    rates[1] = (double) operations[1] / elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    unsigned int pairs = argc > 1 ? (unsigned int) strtoul(argv[1], NULL, 10) : 1;
+    double seconds = argc > 2 ? strtod(argv[2], NULL) : 1.0;
+    if (pairs == 0 || seconds <= 0) {
+        fprintf(stderr, "Usage: %s [pairs] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    struct queue **queues = calloc(pairs, sizeof(struct queue *));
+    struct stack **stacks = calloc(pairs, sizeof(struct stack *));
+    struct worker *workers = calloc(2 * pairs, sizeof(struct worker));
+    if (queues == NULL || stacks == NULL || workers == NULL) {
+        return 1;
+    }
+    for (unsigned int i = 0; i < pairs; i++) {
+        queues[i] = createQueue();
+        stacks[i] = createStack(STACK_CAPACITY);
+        if (queues[i] == NULL || stacks[i] == NULL) {
+            fprintf(stderr, "Could not allocate the containers\n");
+            return 1;
+        }
+    }
+
+    double queue_rates[2], stack_rates[2];
+    for (unsigned int i = 0; i < pairs; i++) {
+        workers[2 * i] = (struct worker) {.role = ROLE_ENQUEUE, .queue = queues[i]};
+        workers[2 * i + 1] = (struct worker) {.role = ROLE_DEQUEUE, .queue = queues[i]};
+    }
+    run(workers, 2 * pairs, seconds, queue_rates);
+    for (unsigned int i = 0; i < pairs; i++) {
+        workers[2 * i] = (struct worker) {.role = ROLE_PUSH_POP, .stack = stacks[i]};
+        workers[2 * i + 1] = (struct worker) {.role = ROLE_POLL, .stack = stacks[i]};
+    }
+    run(workers, 2 * pairs, seconds, stack_rates);
+
+#ifdef CACHE_LAYOUT
+    const char *layout = "CACHE_LAYOUT";
+#else
+    const char *layout = "default";
+#endif
+    printf("%s layout, %u pair(s) of threads, %.1f s per container on %ld online CPUs\n", layout, pairs, seconds,
+           sysconf(_SC_NPROCESSORS_ONLN));
+    printf("queue (%zu bytes): %.2f Mops/s enqueued, %.2f Mops/s dequeued\n", sizeof(struct queue),
+           queue_rates[0] / 1e6, queue_rates[1] / 1e6);
+    printf("stack (%zu bytes): %.2f Mops/s pushed & popped, %.2f Mops/s polled\n", sizeof(struct stack),
+           stack_rates[0] / 1e6, stack_rates[1] / 1e6);
+
+    for (unsigned int i = 0; i < pairs; i++) {
+        destroyQueue(queues[i]);
+        destroyStack(stacks[i]);
+    }
+    free(queues);
+    free(stacks);
+    free(workers);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#!/bin/sh
+# Runs ./bin/main over a grid of A values, CPU counts and backends, appending the per-phase
+# timings of every run (see --timings) to one CSV file, or JSON lines if OUTPUT ends in .json.
+# CPU counts are applied with taskset, so that the same agencies & airlines compete for fewer cores.
+#
+# Usage: bench/sweep.sh [-a "10 20 40"] [-c "1 2 4"] [-b "center p2p adaptive pipelined p2c"] [-r REPEATS]
+#                       [-o OUTPUT] [-- extra ./bin/main options]
+
+FLIGHTS="10 20 40"
+CPUS="$(nproc)"
+BACKENDS="center p2p pipelined"
+REPEATS=1
+OUTPUT="sweep.csv"
+MAIN="$(dirname "$0")/../bin/main"
+
+usage() {
+    cat >&2 <<EOF
+Usage: bench/sweep.sh [-a "10 20 40"] [-c "1 2 4"] [-b "center p2p adaptive pipelined p2c"] [-r REPEATS]
+                      [-o OUTPUT] [-- extra ./bin/main options]
+EOF
+}
+
+while getopts "a:c:b:r:o:" opt; do
+    case "$opt" in
+        a) FLIGHTS="$OPTARG" ;;
+        c) CPUS="$OPTARG" ;;
+        b) BACKENDS="$OPTARG" ;;
+        r) REPEATS="$OPTARG" ;;
+        o) OUTPUT="$OPTARG" ;;
+        *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+if [ ! -x "$MAIN" ]; then
+    echo "$MAIN not found, run make first" >&2
+    exit 1
+fi
+
+backend_options() {
+    case "$1" in
+        center) echo "" ;;
+        p2p) echo "--redistribution=p2p" ;;
+        adaptive) echo "--redistribution=adaptive" ;;
+        pipelined) echo "--pipelined" ;;
+        p2c) echo "--routing=p2c" ;;
+        *) echo "Unknown backend '$1'" >&2; return 1 ;;
+    esac
+}
+
+online=$(nproc)
+failures=0
+for cpus in $CPUS; do
+    if [ "$cpus" -gt "$online" ]; then
+        echo "Skipping $cpus CPUs, only $online are online" >&2
+        continue
+    fi
+    for backend in $BACKENDS; do
+        backend_args=$(backend_options "$backend") || exit 1
+        for A in $FLIGHTS; do
+            run=1
+            while [ "$run" -le "$REPEATS" ]; do
+                echo "A=$A cpus=$cpus backend=$backend run $run/$REPEATS" >&2
+                # shellcheck disable=SC2086 # the backend options are meant to split
+                taskset -c "0-$((cpus - 1))" "$MAIN" --timings="$OUTPUT" $backend_args "$@" "$A" >/dev/null
+                status=$?
+                # a failed check exits with a nonzero status, like a run that couldn't start
+                if [ "$status" -ne 0 ]; then
+                    echo "A=$A cpus=$cpus backend=$backend failed with exit status $status" >&2
+                    failures=$((failures + 1))
+                fi
+                run=$((run + 1))
+            done
+        done
+    done
+done
+echo "Timings appended to $OUTPUT" >&2
+[ "$failures" -eq 0 ]
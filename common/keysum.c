@@ -0,0 +1,27 @@
+#include "keysum.h"
+
+uint64_t expected_total_size(uint64_t numOfFlights) {
+    return numOfFlights * numOfFlights * numOfFlights;
+}
+
+keysum_t expected_total_keysum(uint64_t numOfFlights) {
+    // reservation numbers are exactly 1..A^3, so the sum is n(n + 1) / 2 with n = A^3
+    keysum_t n = expected_total_size(numOfFlights);
+    return n * (n + 1) / 2;
+}
+
+char *format_keysum(keysum_t value, char *buf) {
+    char digits[KEYSUM_STR_LEN];
+    int len = 0;
+    do {
+        digits[len++] = (char) ('0' + (int) (value % 10));
+        value /= 10;
+    } while (value != 0);
+
+    // digits were produced least significant first
+    for (int i = 0; i < len; i++) {
+        buf[i] = digits[len - 1 - i];
+    }
+    buf[len] = '\0';
+    return buf;
+}
@@ -0,0 +1,35 @@
+#ifndef HY486_PROJECT_KEYSUM_H
+#define HY486_PROJECT_KEYSUM_H
+
+#include <stdint.h>
+
+/**
+ * Accumulator for the sum of reservation numbers. The expected keysum is
+ * (A^6 + A^3) / 2, which overflows 64 bits once A exceeds ~1600.
+ */
+typedef unsigned __int128 keysum_t;
+
+/**
+ * Enough room for the 39 decimal digits of a 128-bit value plus the terminator
+ */
+#define KEYSUM_STR_LEN 40
+
+/**
+ * @return The exact number of reservations produced for A flights, i.e. A^3
+ */
+uint64_t expected_total_size(uint64_t numOfFlights);
+
+/**
+ * @return The exact sum of all reservation numbers produced for A flights, i.e. (A^6 + A^3) / 2
+ */
+keysum_t expected_total_keysum(uint64_t numOfFlights);
+
+/**
+ * Formats a keysum in decimal since printf has no conversion for 128-bit integers.
+ * @param value The keysum to format
+ * @param buf A buffer of at least KEYSUM_STR_LEN bytes
+ * @return buf
+ */
+char *format_keysum(keysum_t value, char *buf);
+
+#endif //HY486_PROJECT_KEYSUM_H
@@ -0,0 +1,384 @@
+#include "options.h"
+#include "../timeline/timeline.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum option_id {
+    OPT_PIN = 256,
+    OPT_WAL,
+    OPT_WAL_BATCH,
+    OPT_WAL_LATENCY,
+    OPT_SNAPSHOT,
+    OPT_RESTORE,
+    OPT_RECOVER,
+    OPT_REPLAY,
+    OPT_REPLAY_WORKERS,
+    OPT_REPLAY_PACED,
+    OPT_WRITE_TRACE,
+    OPT_WORKLOAD,
+    OPT_ZIPF_S,
+    OPT_SEED,
+    OPT_AGENCY_RATE,
+    OPT_BURST,
+    OPT_ROUTING,
+    OPT_FLEXIBLE_FRACTION,
+    OPT_REDISTRIBUTION,
+    OPT_ADAPTIVE_THRESHOLD,
+    OPT_PIPELINED,
+    OPT_SERVICE,
+    OPT_REPORT_INTERVAL,
+    OPT_BACKLOG,
+    OPT_AUDIT,
+    OPT_VERIFY,
+    OPT_VERIFY_WORKERS,
+    OPT_FLIGHT_STATS,
+    OPT_TIMINGS,
+    OPT_CONTENTION,
+    OPT_PERF_COUNTERS,
+    OPT_TIMELINE,
+    OPT_TIMELINE_EVENTS,
+    OPT_TIMELINE_LOCK_US,
+    OPT_SEQUENTIAL,
+    OPT_REFERENCE,
+    OPT_INDEX,
+    OPT_LOCATE,
+};
+
+static const struct option long_options[] = {
+        {"pin",            required_argument, NULL, OPT_PIN},
+        {"wal",            required_argument, NULL, OPT_WAL},
+        {"wal-batch",      required_argument, NULL, OPT_WAL_BATCH},
+        {"wal-latency-us", required_argument, NULL, OPT_WAL_LATENCY},
+        {"snapshot",       required_argument, NULL, OPT_SNAPSHOT},
+        {"restore",        required_argument, NULL, OPT_RESTORE},
+        {"recover",        required_argument, NULL, OPT_RECOVER},
+        {"replay",         required_argument, NULL, OPT_REPLAY},
+        {"replay-workers", required_argument, NULL, OPT_REPLAY_WORKERS},
+        {"replay-paced",   no_argument,       NULL, OPT_REPLAY_PACED},
+        {"write-trace",    required_argument, NULL, OPT_WRITE_TRACE},
+        {"workload",       required_argument, NULL, OPT_WORKLOAD},
+        {"zipf-s",         required_argument, NULL, OPT_ZIPF_S},
+        {"seed",           required_argument, NULL, OPT_SEED},
+        {"agency-rate",    required_argument, NULL, OPT_AGENCY_RATE},
+        {"burst",          required_argument, NULL, OPT_BURST},
+        {"routing",           required_argument, NULL, OPT_ROUTING},
+        {"flexible-fraction", required_argument, NULL, OPT_FLEXIBLE_FRACTION},
+        {"redistribution",    required_argument, NULL, OPT_REDISTRIBUTION},
+        {"adaptive-threshold", required_argument, NULL, OPT_ADAPTIVE_THRESHOLD},
+        {"pipelined",         no_argument,       NULL, OPT_PIPELINED},
+        {"service",           required_argument, NULL, OPT_SERVICE},
+        {"report-interval",   required_argument, NULL, OPT_REPORT_INTERVAL},
+        {"backlog",           required_argument, NULL, OPT_BACKLOG},
+        {"audit",             required_argument, NULL, OPT_AUDIT},
+        {"verify",            required_argument, NULL, OPT_VERIFY},
+        {"verify-workers",    required_argument, NULL, OPT_VERIFY_WORKERS},
+        {"flight-stats",      no_argument,       NULL, OPT_FLIGHT_STATS},
+        {"timings",           required_argument, NULL, OPT_TIMINGS},
+        {"contention",        no_argument,       NULL, OPT_CONTENTION},
+        {"perf-counters",     no_argument,       NULL, OPT_PERF_COUNTERS},
+        {"timeline",          required_argument, NULL, OPT_TIMELINE},
+        {"timeline-events",   required_argument, NULL, OPT_TIMELINE_EVENTS},
+        {"timeline-lock-us",  required_argument, NULL, OPT_TIMELINE_LOCK_US},
+        {"sequential",        no_argument,       NULL, OPT_SEQUENTIAL},
+        {"reference",         no_argument,       NULL, OPT_REFERENCE},
+        {"index",             no_argument,       NULL, OPT_INDEX},
+        {"locate",            required_argument, NULL, OPT_LOCATE},
+        {"help",           no_argument,       NULL, 'h'},
+        {NULL, 0,                             NULL, 0}
+};
+
+void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] A\n", program);
+    fprintf(stderr, "       %s [options] --restore=PATH|--recover=PATH|--replay=PATH [A]\n", program);
+    fprintf(stderr, "  --pin=none|compact|scatter   pin each flight's agencies & airline to a core (default: none)\n");
+    fprintf(stderr, "  --wal=PATH                   log every reservation operation to a write-ahead log\n");
+    fprintf(stderr, "  --wal-batch=N                records per log buffer (default: 256)\n");
+    fprintf(stderr, "  --wal-latency-us=N           max time a record waits for its group commit (default: 1000)\n");
+    fprintf(stderr, "  --snapshot=PATH              save the flights table & center after the phase 1 checks\n");
+    fprintf(stderr, "  --restore=PATH               restart from a snapshot instead of running phase 1\n");
+    fprintf(stderr, "  --recover=PATH               restart from the state a --wal log reached instead of running phase 1\n");
+    fprintf(stderr, "  --replay=PATH                book the reservations of a trace in phase 1 instead\n");
+    fprintf(stderr, "  --replay-workers=N           threads replaying the trace (default: one per agency)\n");
+    fprintf(stderr, "  --replay-paced               replay every record at its timestamp\n");
+    fprintf(stderr, "  --write-trace=PATH           write the reservations of a regular run as a trace and exit\n");
+    fprintf(stderr, "  --workload=fixed|zipf        flight choice of the agencies (default: fixed, agency X books flight (X-1) mod A)\n");
+    fprintf(stderr, "  --zipf-s=S                   Zipf exponent of --workload=zipf (default: 0.99)\n");
+    fprintf(stderr, "  --seed=N                     seed of the per-agency generators (default: 1)\n");
+    fprintf(stderr, "  --agency-rate=R|MIN:MAX      reservations per second per agency, or each agency's own between MIN & MAX\n");
+    fprintf(stderr, "  --burst=ON_MS:OFF_MS         agencies book for ON_MS then idle for OFF_MS\n");
+    fprintf(stderr, "  --routing=home|p2c           book flexible reservations on the emptier of two flights (default: home)\n");
+    fprintf(stderr, "  --flexible-fraction=F        share of reservations that are flexible under p2c (default: 1.0)\n");
+    fprintf(stderr, "  --redistribution=MODE        center, p2p or adaptive: how phase 2 moves overflow to under-full flights (default: center)\n");
+    fprintf(stderr, "  --adaptive-threshold=PCT     %% of contended phase 1 locks above which adaptive picks p2p (default: 2)\n");
+    fprintf(stderr, "  --pipelined                  overlap both phases, validating everything at the end\n");
+    fprintf(stderr, "  --service=SECONDS            keep booking and releasing seats for SECONDS (implies --pipelined)\n");
+    fprintf(stderr, "  --report-interval=MS         how often the service reports (default: 1000)\n");
+    fprintf(stderr, "  --backlog=N                  reservations the service lets wait for a seat (default: A^3)\n");
+    fprintf(stderr, "  --audit=MS                   audit a pipelined run online every MS milliseconds\n");
+    fprintf(stderr, "  --verify=keysum|bitmap       how the checks verify reservation numbers (default: keysum)\n");
+    fprintf(stderr, "  --verify-workers=N           threads of the bitmap verification (default: one per CPU)\n");
+    fprintf(stderr, "  --flight-stats               print per-flight statistics of the reservations at the end\n");
+    fprintf(stderr, "  --timings=PATH               append the run's per-phase timings to a CSV (or *.json) file\n");
+    fprintf(stderr, "  --contention                 count lock waits, retries & empty polls, reported at every check\n");
+    fprintf(stderr, "  --perf-counters              count cycles, instructions, LLC misses, context switches & faults per phase\n");
+    fprintf(stderr, "  --timeline=PATH              write a Chrome trace-event timeline of every thread to PATH\n");
+    fprintf(stderr, "  --timeline-events=N          events the timeline keeps per thread (default: 4096, at most 2^24)\n");
+    fprintf(stderr, "  --timeline-lock-us=US        shortest lock wait put on the timeline (default: 10)\n");
+    fprintf(stderr, "  --sequential                 run the single-threaded reference of the batch run instead\n");
+    fprintf(stderr, "  --reference                  compare the run with the sequential reference: speedup & final contents\n");
+    fprintf(stderr, "  --index                      index where every reservation is, checked against the structures\n");
+    fprintf(stderr, "  --locate=N                   look reservation N up in the index after the final checks (implies --index)\n");
+}
+
+int parse_options(int argc, char *argv[], struct run_options *options) {
+    memset(options, 0, sizeof(struct run_options));
+    options->pin_policy = PIN_NONE;
+    options->wal_batch = 256;
+    options->wal_latency_us = 1000;
+    options->workload.distribution = FLIGHTS_FIXED;
+    options->workload.zipf_s = 0.99;
+    options->workload.seed = 1;
+    options->flexible_fraction = 1.0;
+    options->report_interval_ms = 1000;
+    options->timeline_events = 4096;
+    options->timeline_lock_us = 10;
+    options->adaptive_threshold = 0.02;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+        switch (opt) {
+            case OPT_PIN:
+                if (!parse_pin_policy(optarg, &options->pin_policy)) {
+                    fprintf(stderr, "Unknown pinning policy '%s'\n", optarg);
+                    print_usage(argv[0]);
+                    return 0;
+                }
+                break;
+            case OPT_WAL:
+                options->wal_path = optarg;
+                break;
+            case OPT_WAL_BATCH:
+                options->wal_batch = strtoul(optarg, NULL, 10);
+                break;
+            case OPT_WAL_LATENCY:
+                options->wal_latency_us = strtoul(optarg, NULL, 10);
+                break;
+            case OPT_SNAPSHOT:
+                options->snapshot_path = optarg;
+                break;
+            case OPT_RESTORE:
+                options->restore_path = optarg;
+                break;
+            case OPT_RECOVER:
+                options->recover_path = optarg;
+                break;
+            case OPT_REPLAY:
+                options->replay_path = optarg;
+                break;
+            case OPT_REPLAY_WORKERS:
+                options->replay_workers = strtoul(optarg, NULL, 10);
+                break;
+            case OPT_REPLAY_PACED:
+                options->replay_paced = 1;
+                break;
+            case OPT_WRITE_TRACE:
+                options->write_trace_path = optarg;
+                break;
+            case OPT_WORKLOAD:
+                if (strcmp(optarg, "zipf") == 0) {
+                    options->workload.distribution = FLIGHTS_ZIPF;
+                } else if (strcmp(optarg, "fixed") != 0) {
+                    fprintf(stderr, "Unknown workload '%s'\n", optarg);
+                    return 0;
+                }
+                options->use_workload = 1;
+                break;
+            case OPT_ZIPF_S:
+                options->workload.zipf_s = strtod(optarg, NULL);
+                options->use_workload = 1;
+                break;
+            case OPT_SEED:
+                options->workload.seed = strtoull(optarg, NULL, 10);
+                options->use_workload = 1;
+                break;
+            case OPT_AGENCY_RATE: {
+                // R for every agency, or MIN:MAX for a rate of each agency's own between them
+                char *end;
+                options->workload.agency_rate = strtod(optarg, &end);
+                options->workload.agency_rate_max = *end == ':' ? strtod(end + 1, NULL) : options->workload.agency_rate;
+                if (options->workload.agency_rate < 0 ||
+                    options->workload.agency_rate_max < options->workload.agency_rate) {
+                    fprintf(stderr, "--agency-rate expects R or MIN:MAX with 0 <= MIN <= MAX\n");
+                    return 0;
+                }
+                options->use_workload = 1;
+                break;
+            }
+            case OPT_BURST:
+                if (sscanf(optarg, "%u:%u", &options->workload.burst_on_ms, &options->workload.burst_off_ms) != 2 ||
+                    options->workload.burst_on_ms == 0) {
+                    fprintf(stderr, "--burst expects ON_MS:OFF_MS\n");
+                    return 0;
+                }
+                options->use_workload = 1;
+                break;
+            case OPT_ROUTING:
+                if (strcmp(optarg, "p2c") == 0) {
+                    options->p2c_routing = 1;
+                } else if (strcmp(optarg, "home") != 0) {
+                    fprintf(stderr, "Unknown routing '%s'\n", optarg);
+                    return 0;
+                }
+                break;
+            case OPT_FLEXIBLE_FRACTION:
+                options->flexible_fraction = strtod(optarg, NULL);
+                break;
+            case OPT_REDISTRIBUTION:
+                options->p2p_redistribution = 0;
+                options->adaptive_redistribution = 0;
+                if (strcmp(optarg, "p2p") == 0) {
+                    options->p2p_redistribution = 1;
+                } else if (strcmp(optarg, "adaptive") == 0) {
+                    options->adaptive_redistribution = 1;
+                } else if (strcmp(optarg, "center") != 0) {
+                    fprintf(stderr, "Unknown redistribution '%s'\n", optarg);
+                    return 0;
+                }
+                break;
+            case OPT_ADAPTIVE_THRESHOLD:
+                options->adaptive_threshold = strtod(optarg, NULL) / 100;
+                break;
+            case OPT_PIPELINED:
+                options->pipelined = 1;
+                break;
+            case OPT_SERVICE:
+                options->service_seconds = strtod(optarg, NULL);
+                if (options->service_seconds <= 0) {
+                    fprintf(stderr, "The service duration must be positive\n");
+                    return 0;
+                }
+                options->pipelined = 1;
+                break;
+            case OPT_REPORT_INTERVAL:
+                options->report_interval_ms = strtoul(optarg, NULL, 10);
+                if (options->report_interval_ms == 0) options->report_interval_ms = 1;
+                break;
+            case OPT_BACKLOG:
+                options->backlog_limit = strtoull(optarg, NULL, 10);
+                break;
+            case OPT_VERIFY:
+                if (strcmp(optarg, "bitmap") == 0) {
+                    options->exactly_once = 1;
+                } else if (strcmp(optarg, "keysum") != 0) {
+                    fprintf(stderr, "Unknown verification '%s'\n", optarg);
+                    print_usage(argv[0]);
+                    return 0;
+                }
+                break;
+            case OPT_VERIFY_WORKERS:
+                options->verification_workers = strtoul(optarg, NULL, 10);
+                break;
+            case OPT_FLIGHT_STATS:
+                options->flight_stats = 1;
+                break;
+            case OPT_TIMINGS:
+                options->timings_path = optarg;
+                break;
+            case OPT_CONTENTION:
+                options->contention = 1;
+                break;
+            case OPT_PERF_COUNTERS:
+                options->perf_counters = 1;
+                break;
+            case OPT_TIMELINE:
+                options->timeline_path = optarg;
+                break;
+            case OPT_TIMELINE_EVENTS: {
+                unsigned long events = strtoul(optarg, NULL, 10);
+                if (events > TIMELINE_MAX_EVENTS) {
+                    fprintf(stderr, "--timeline-events expects at most %u events per thread\n", TIMELINE_MAX_EVENTS);
+                    return 0;
+                }
+                options->timeline_events = events > 0 ? (unsigned int) events : 1;
+                break;
+            }
+            case OPT_TIMELINE_LOCK_US:
+                options->timeline_lock_us = strtoul(optarg, NULL, 10);
+                break;
+            case OPT_SEQUENTIAL:
+                options->sequential = 1;
+                break;
+            case OPT_REFERENCE:
+                options->reference = 1;
+                break;
+            case OPT_INDEX:
+                options->index_reservations = 1;
+                break;
+            case OPT_LOCATE:
+                options->locate_reservation = strtoull(optarg, NULL, 10);
+                options->index_reservations = 1;
+                break;
+            case OPT_AUDIT:
+                options->audit_interval_ms = strtoul(optarg, NULL, 10);
+                if (options->audit_interval_ms == 0) options->audit_interval_ms = 1;
+                break;
+            default:
+                print_usage(argv[0]);
+                return 0;
+        }
+    }
+
+    if (options->pipelined &&
+        (options->p2p_redistribution || options->adaptive_redistribution || options->snapshot_path != NULL)) {
+        fprintf(stderr, "--pipelined redistributes through the center and has no quiescent point to snapshot\n");
+        return 0;
+    }
+    if (options->audit_interval_ms > 0 && !options->pipelined) {
+        fprintf(stderr, "--audit needs --pipelined or --service, other runs are checked at their barriers\n");
+        return 0;
+    }
+    // released seats can't be logged, and restore, replay & trace writing are single batches
+    if (options->service_seconds > 0 &&
+        (options->wal_path != NULL || options->restore_path != NULL || options->recover_path != NULL ||
+         options->replay_path != NULL || options->write_trace_path != NULL)) {
+        fprintf(stderr, "--service can't be combined with --wal, --restore, --recover, --replay or --write-trace\n");
+        return 0;
+    }
+    // released seats would stay in the index, which would grow for as long as the service runs
+    if (options->index_reservations && options->service_seconds > 0) {
+        fprintf(stderr, "--index can't be combined with --service\n");
+        return 0;
+    }
+    // the synthetic agencies don't run there, so their workload and routing would be silently ignored
+    if ((options->use_workload || options->p2c_routing) && (options->restore_path != NULL || options->recover_path != NULL ||
+                                  options->replay_path != NULL || options->write_trace_path != NULL)) {
+        fprintf(stderr, "--workload, --zipf-s, --seed, --agency-rate, --burst and --routing=p2c can't be "
+                        "combined with --restore, --recover, --replay or --write-trace\n");
+        return 0;
+    }
+    if ((options->restore_path != NULL) + (options->recover_path != NULL) + (options->replay_path != NULL) > 1) {
+        fprintf(stderr, "--restore, --recover and --replay can't be combined\n");
+        return 0;
+    }
+
+    // A is read from the snapshot, log or trace
+    if ((options->restore_path != NULL || options->recover_path != NULL || options->replay_path != NULL) &&
+        optind == argc) {
+        return 1;
+    }
+
+    // A is the single positional argument
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    int A = atoi(argv[optind]);
+    if (A <= 0) {
+        fprintf(stderr, "A must be a positive number of flights\n");
+        return 0;
+    }
+    options->numOfFlights = A;
+    return 1;
+}
@@ -0,0 +1,59 @@
+#ifndef HY486_PROJECT_OPTIONS_H
+#define HY486_PROJECT_OPTIONS_H
+
+#include "../affinity/affinity.h"
+#include "../workload/workload.h"
+
+/**
+ * Command line options of a run. Only A is mandatory (unless restoring a snapshot, recovering a log or replaying a trace),
+ * everything else defaults to the plain two-phase simulation.
+ */
+struct run_options {
+    unsigned int numOfFlights; // A
+    enum pin_policy pin_policy; // how agency & airline threads are pinned to cores
+    const char *wal_path; // write-ahead reservation log, NULL to keep reservations in memory only
+    unsigned int wal_batch; // records per log buffer handed to the flusher
+    unsigned int wal_latency_us; // upper bound on how long a record waits before its group commit
+    const char *snapshot_path; // where to save the state after the phase 1 checks, NULL to skip
+    const char *restore_path; // snapshot to restart phase 2 from instead of running phase 1
+    const char *recover_path; // write-ahead log to rebuild the state from and restart phase 2, like a snapshot
+    const char *replay_path; // trace to replay in phase 1 instead of the synthetic agencies
+    unsigned int replay_workers; // threads replaying the trace, 0 for one per agency in the trace
+    int replay_paced; // replay each record at its timestamp instead of as fast as possible
+    const char *write_trace_path; // write the synthetic workload of A flights as a trace and exit
+    int use_workload; // whether any of the workload options below was given
+    struct workload_config workload; // flight distribution, rates & bursts of the synthetic agencies
+    int p2c_routing; // book flexible reservations on the emptier of two flights
+    double flexible_fraction; // share of reservations that are flexible under p2c routing
+    int p2p_redistribution; // phase 2 moves overflow straight into reserved seats instead of through the center
+    int adaptive_redistribution; // the controller picks center or p2p at the phase boundary from the phase 1 contention
+    double adaptive_threshold; // share of contended stack & queue locks above which the adaptive run picks p2p
+    int pipelined; // airlines redistribute while the agencies are still booking, checks only run at the end
+    double service_seconds; // run as a long-running service for this long, 0 for a single batch of A^3 reservations
+    unsigned int report_interval_ms; // how often the service reports throughput & latency
+    uint64_t backlog_limit; // reservations the service lets wait in queues & the center, 0 for A^3
+    unsigned int audit_interval_ms; // how often the online auditor checks a pipelined run, 0 for no auditor
+    int exactly_once; // verify reservation numbers with a bitmap of 1..N instead of the keysum
+    unsigned int verification_workers; // threads of the bitmap verification, 0 for one per online CPU
+    int flight_stats; // print per-flight statistics of the reservation numbers after the final checks
+    const char *timings_path; // CSV (or JSON lines if *.json) the run's per-phase timings are appended to, NULL to skip
+    int contention; // count lock acquisitions, waits, retries & empty polls per thread and report them at every check
+    int perf_counters; // count hardware events & thread resource usage per phase and report them after the checks
+    const char *timeline_path; // where to write the Chrome trace-event timeline of the threads, NULL to skip
+    unsigned int timeline_events; // events the timeline keeps per thread, the oldest are overwritten
+    unsigned int timeline_lock_us; // shortest lock wait put on the timeline
+    int sequential; // run the single-threaded reference of the batch run instead of the threads
+    int reference; // run the sequential reference after the threads, for the speedup & as an oracle of the final contents
+    int index_reservations; // keep a hash index of where every reservation is, checked with the structures
+    uint64_t locate_reservation; // reservation to look up in the index after the final checks, 0 for none
+};
+
+/**
+ * Parses the command line into the given options, printing the usage on error.
+ * @return 1 if successful, 0 otherwise
+ */
+int parse_options(int argc, char *argv[], struct run_options *options);
+
+void print_usage(const char *program);
+
+#endif //HY486_PROJECT_OPTIONS_H
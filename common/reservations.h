@@ -5,9 +5,70 @@
 #ifndef HY486_PROJECT_RESERVATIONS_H
 #define HY486_PROJECT_RESERVATIONS_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+/**
+ * Reservation numbers go up to A^3, which no longer fits in 32 bits once A grows
+ * past ~1290. Building with LARGE_SCALE (make LARGE_SCALE=1) widens them to 64 bits,
+ * otherwise a reservation stays a compact 8-byte record.
+ */
+#ifdef LARGE_SCALE
+typedef int64_t reservation_number_t;
+#define PRI_RESERVATION PRId64
+#define RESERVATION_NUMBER_MAX INT64_MAX
+#define RESERVATION_NUMBER_MIN INT64_MIN
+#else
+typedef int32_t reservation_number_t;
+#define PRI_RESERVATION PRId32
+#define RESERVATION_NUMBER_MAX INT32_MAX
+#define RESERVATION_NUMBER_MIN INT32_MIN
+#endif
+
 struct Reservation {
     int agency_id; // the agency_id of the agency that produced this reservation
-    int reservation_number;
+    reservation_number_t reservation_number;
+};
+
+/**
+ * Called for every reservation an iteration over a stack, queue or list visits
+ * @return 0 to stop the iteration early, anything else to continue
+ */
+typedef int (*reservation_visitor)(const struct Reservation *reservation, void *context);
+
+/**
+ * Where a chunked export or span walk over a stack, queue or list is. Zero-initialize it
+ * to start from the beginning of the container.
+ */
+struct reservation_cursor {
+    const void *node; // next node to hand out, freed if the container removes it
+    int started;
+    unsigned int offset; // for nodes that hold several: the queue's next index, or the stack's count still to hand out
+    unsigned long removals; // the container's removal count when the cursor last moved
+};
+
+/**
+ * The cursor of an export or span walk keeps a raw node pointer between calls, so the container must
+ * stay quiescent until the walk is done. Aborts if the container removed a reservation since the
+ * cursor last moved, rather than following a pointer that may have been freed.
+ * @param removals The container's removal count, read under the lock that guards removals
+ */
+static inline void check_cursor(const struct reservation_cursor *cursor, unsigned long removals, const char *walk) {
+    if (cursor->started && cursor->removals != removals) {
+        fprintf(stderr, "%s: the container changed between two calls of one walk\n", walk);
+        abort();
+    }
+}
+
+/**
+ * Reservations that lie contiguously in a container's own memory
+ */
+struct reservation_span {
+    const struct Reservation *reservations;
+    size_t count;
 };
 
 /**
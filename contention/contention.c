@@ -0,0 +1,100 @@
+#include "contention.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+const char *const contention_structure_names[CONTENTION_STRUCTURES] = {"stacks", "queues", "center", "p2p board"};
+
+__thread struct contention_recorder *contention_slot = NULL;
+
+uint64_t contention_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+int contention_init(struct contention_recorders *recorders, unsigned int num_slots) {
+    size_t size = sizeof(struct contention_recorder) * (num_slots > 0 ? num_slots : 1);
+    recorders->slots = aligned_alloc(_Alignof(struct contention_recorder), size);
+    if (recorders->slots == NULL) {
+        return 0;
+    }
+    memset(recorders->slots, 0, size);
+    for (unsigned int i = 0; i < num_slots; i++) {
+        recorders->slots[i].flight = CONTENTION_NO_FLIGHT;
+    }
+    recorders->num_slots = num_slots;
+    return 1;
+}
+
+void contention_attach(struct contention_recorders *recorders, unsigned int slot, unsigned int flight) {
+    recorders->slots[slot].flight = flight;
+    contention_slot = &recorders->slots[slot];
+}
+
+static void add(struct contention_counters *into, const struct contention_counters *from) {
+    into->acquisitions += from->acquisitions;
+    into->contended += from->contended;
+    into->wait_ns += from->wait_ns;
+    into->validate_failures += from->validate_failures;
+    into->retries += from->retries;
+    into->empty_polls += from->empty_polls;
+}
+
+static void print_counters(const char *name, const struct contention_counters *counters) {
+    printf("%-12s %14" PRIu64 " %12" PRIu64 " %7.2f%% %12.3f %12" PRIu64 " %10" PRIu64 " %12" PRIu64 "\n", name,
+           counters->acquisitions, counters->contended,
+           counters->acquisitions > 0 ? 100.0 * (double) counters->contended / (double) counters->acquisitions : 0,
+           (double) counters->wait_ns / 1e6, counters->validate_failures, counters->retries, counters->empty_polls);
+}
+
+void contention_totals(struct contention_recorders *recorders, struct contention_counters *totals) {
+    memset(totals, 0, sizeof(struct contention_counters) * CONTENTION_STRUCTURES);
+    for (unsigned int i = 0; i < recorders->num_slots; i++) {
+        for (int s = 0; s < CONTENTION_STRUCTURES; s++) {
+            add(&totals[s], &recorders->slots[i].structures[s]);
+        }
+    }
+}
+
+void contention_reset(struct contention_recorders *recorders) {
+    for (unsigned int i = 0; i < recorders->num_slots; i++) {
+        memset(recorders->slots[i].structures, 0, sizeof(recorders->slots[i].structures));
+    }
+}
+
+void contention_report(struct contention_recorders *recorders, const char *phase, unsigned int numOfFlights) {
+    struct contention_counters totals[CONTENTION_STRUCTURES];
+    contention_totals(recorders, totals);
+    printf("%s contention:\n", phase);
+    printf("%-12s %14s %12s %8s %12s %12s %10s %12s\n", "structure", "acquisitions", "contended", "%", "wait (ms)",
+           "validations", "retries", "empty polls");
+    for (int s = 0; s < CONTENTION_STRUCTURES; s++) {
+        print_counters(contention_structure_names[s], &totals[s]);
+    }
+
+    // attributed to the flight of the thread that ran into it, summed over all structures
+    for (unsigned int flight = 0; flight < numOfFlights; flight++) {
+        struct contention_counters sum;
+        memset(&sum, 0, sizeof(sum));
+        for (unsigned int i = 0; i < recorders->num_slots; i++) {
+            if (recorders->slots[i].flight != flight) continue;
+            for (int s = 0; s < CONTENTION_STRUCTURES; s++) {
+                add(&sum, &recorders->slots[i].structures[s]);
+            }
+        }
+        char name[24];
+        snprintf(name, sizeof(name), "flight %u", flight);
+        print_counters(name, &sum);
+    }
+    printf("\n");
+
+    // the next phase starts from zero
+    contention_reset(recorders);
+}
+
+void contention_destroy(struct contention_recorders *recorders) {
+    free(recorders->slots);
+}
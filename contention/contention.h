@@ -0,0 +1,120 @@
+#ifndef HY486_PROJECT_CONTENTION_H
+#define HY486_PROJECT_CONTENTION_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "../layout/layout.h"
+#include "../timeline/timeline.h"
+
+/**
+ * The kinds of structures contention is counted for
+ */
+enum contention_structure {
+    CONTENTION_STACK,
+    CONTENTION_QUEUE,
+    CONTENTION_CENTER,
+    CONTENTION_BOARD, // the p2p matching board, which has no locks but retries its claims
+    CONTENTION_STRUCTURES
+};
+
+struct contention_counters {
+    uint64_t acquisitions; // locks taken
+    uint64_t contended; // of which were held by another thread at first
+    uint64_t wait_ns; // time spent waiting for those
+    uint64_t validate_failures; // lazy list validations that failed, each of which restarts the traversal
+    uint64_t retries; // matching board claims whose CAS failed and was retried
+    uint64_t empty_polls; // pop, dequeue & deleteAndGet calls that found nothing
+};
+
+/**
+ * The counters of one thread, only ever written by it and on cache lines of their own
+ */
+struct contention_recorder {
+    _Alignas(CACHE_LINE_SIZE) unsigned int flight; // the thread's flight, CONTENTION_NO_FLIGHT if it has none
+    struct contention_counters structures[CONTENTION_STRUCTURES];
+};
+
+#define CONTENTION_NO_FLIGHT UINT32_MAX
+
+/**
+ * A recorder per agency (or replay worker) and airline, summed at the controller's checks
+ */
+struct contention_recorders {
+    struct contention_recorder *slots;
+    unsigned int num_slots;
+};
+
+/**
+ * The calling thread's recorder, NULL unless contention is counted (--contention) for it
+ */
+extern __thread struct contention_recorder *contention_slot;
+
+/**
+ * The structures' names, e.g. for the lock waits on the timeline
+ */
+extern const char *const contention_structure_names[CONTENTION_STRUCTURES];
+
+uint64_t contention_now(void);
+
+/**
+ * @brief Takes a lock, counting the acquisition into the calling thread's recorder.
+ *
+ * The lock is first tried without blocking, and only if that fails is the acquisition counted as
+ * contended and the wait timed. Waits are also put on the timeline of threads that record one.
+ * Without either this is two thread-local loads and a branch away from pthread_mutex_lock.
+ */
+static inline void contention_lock(pthread_mutex_t *lock, enum contention_structure structure) {
+    struct contention_recorder *slot = contention_slot;
+    if (slot == NULL && timeline_slot == NULL) {
+        pthread_mutex_lock(lock);
+        return;
+    }
+    if (slot != NULL) slot->structures[structure].acquisitions++;
+    if (pthread_mutex_trylock(lock) == 0) return;
+    uint64_t started = contention_now();
+    pthread_mutex_lock(lock);
+    uint64_t waited = contention_now() - started;
+    if (slot != NULL) {
+        slot->structures[structure].contended++;
+        slot->structures[structure].wait_ns += waited;
+    }
+    if (timeline_slot != NULL) timeline_lock_wait(contention_structure_names[structure], started, waited);
+}
+
+/**
+ * Adds one to a counter of the calling thread, e.g. CONTENTION_COUNT(CONTENTION_CENTER, retries)
+ */
+#define CONTENTION_COUNT(structure, counter) \
+    do { if (contention_slot != NULL) contention_slot->structures[structure].counter++; } while (0)
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int contention_init(struct contention_recorders *recorders, unsigned int num_slots);
+
+/**
+ * Makes the calling thread count its contention into a slot
+ * @param flight The thread's flight, for the per-flight report, or CONTENTION_NO_FLIGHT
+ */
+void contention_attach(struct contention_recorders *recorders, unsigned int slot, unsigned int flight);
+
+/**
+ * Sums the counters of all threads per structure. The threads must be quiescent.
+ * @param totals CONTENTION_STRUCTURES counters, indexed by enum contention_structure
+ */
+void contention_totals(struct contention_recorders *recorders, struct contention_counters *totals);
+
+/**
+ * Clears the counters of all threads, e.g. for the next phase. The threads must be quiescent.
+ */
+void contention_reset(struct contention_recorders *recorders);
+
+/**
+ * Sums the counters of all threads and prints them per structure and per flight,
+ * then clears them for the next phase. The threads must be quiescent.
+ */
+void contention_report(struct contention_recorders *recorders, const char *phase, unsigned int numOfFlights);
+
+void contention_destroy(struct contention_recorders *recorders);
+
+#endif //HY486_PROJECT_CONTENTION_H
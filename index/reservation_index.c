@@ -0,0 +1,253 @@
+#include "reservation_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Bounds of the root's size, 2^ROOT_MAX_BITS slots being 128 MB
+ */
+#define ROOT_MIN_BITS 10
+#define ROOT_MAX_BITS 24
+
+/**
+ * Set in a slot that points to a child node instead of a leaf
+ */
+#define CHILD_TAG ((uintptr_t) 1)
+
+#define PLACE_SHIFT 30
+#define FLIGHT_MASK ((1u << PLACE_SHIFT) - 1)
+
+/**
+ * The chunk a thread allocates from, and a leaf & node it allocated but lost the race to publish
+ */
+struct index_arena {
+    uint64_t index_id;
+    struct index_chunk *chunk;
+    size_t next_size;
+    struct index_leaf *spare_leaf;
+    struct index_node *spare_node;
+};
+
+static __thread struct index_arena arena;
+
+static atomic_uint_fast64_t next_index_id = 1;
+
+/**
+ * The splitmix64 finalizer, a bijection, so distinct reservation numbers always end up in different slots
+ * before the hash runs out of bits
+ */
+static uint64_t hash_number(reservation_number_t reservation_number) {
+    uint64_t z = (uint64_t) reservation_number;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint32_t pack_location(enum reservation_place place, unsigned int flight) {
+    return (uint32_t) place << PLACE_SHIFT | (flight & FLIGHT_MASK);
+}
+
+/**
+ * Carves memory out of the calling thread's chunk, starting a new one when it's full
+ * @return NULL if no chunk could be allocated
+ */
+static void *allocate(struct reservation_index *index, size_t size, size_t alignment) {
+    if (arena.index_id != index->id) {
+        // the chunks of another index are of no use here
+        memset(&arena, 0, sizeof(arena));
+        arena.index_id = index->id;
+        arena.next_size = INDEX_CHUNK_MIN;
+    }
+    struct index_chunk *chunk = arena.chunk;
+    size_t offset = chunk != NULL ? (chunk->used + alignment - 1) & ~(alignment - 1) : 0;
+    if (chunk == NULL || offset + size > chunk->size) {
+        chunk = aligned_alloc(64, arena.next_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = arena.next_size;
+        if (arena.next_size < INDEX_CHUNK_MAX) arena.next_size *= 2;
+        chunk->next = atomic_load_explicit(&index->chunks, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&index->chunks, &chunk->next, chunk, memory_order_relaxed,
+                                                      memory_order_relaxed)) {}
+        arena.chunk = chunk;
+        offset = (sizeof(struct index_chunk) + alignment - 1) & ~(alignment - 1);
+    }
+    chunk->used = offset + size;
+    return (char *) chunk + offset;
+}
+
+static struct index_leaf *new_leaf(struct reservation_index *index) {
+    if (arena.index_id == index->id && arena.spare_leaf != NULL) {
+        struct index_leaf *leaf = arena.spare_leaf;
+        arena.spare_leaf = NULL;
+        return leaf;
+    }
+    return allocate(index, sizeof(struct index_leaf), _Alignof(struct index_leaf));
+}
+
+/**
+ * @return A node with every slot empty, NULL if none could be allocated
+ */
+static struct index_node *new_node(struct reservation_index *index) {
+    if (arena.index_id == index->id && arena.spare_node != NULL) {
+        struct index_node *node = arena.spare_node;
+        arena.spare_node = NULL;
+        return node;
+    }
+    struct index_node *node = allocate(index, sizeof(struct index_node), 64);
+    if (node != NULL) {
+        for (unsigned int i = 0; i < INDEX_NODE_SLOTS; i++) {
+            atomic_init(&node->slots[i], 0);
+        }
+    }
+    return node;
+}
+
+int reservation_index_init(struct reservation_index *index, uint64_t expected) {
+    // about two root slots per reservation, so that few of them have to be split
+    unsigned int bits = ROOT_MIN_BITS;
+    while (bits < ROOT_MAX_BITS && (1ull << bits) < 2 * expected) {
+        bits++;
+    }
+    index->root = calloc((size_t) 1 << bits, sizeof(_Atomic uintptr_t));
+    if (index->root == NULL) {
+        return 0;
+    }
+    index->root_bits = bits;
+    index->id = atomic_fetch_add_explicit(&next_index_id, 1, memory_order_relaxed);
+    atomic_init(&index->chunks, NULL);
+    return 1;
+}
+
+void reservation_index_set(struct reservation_index *index, reservation_number_t reservation_number,
+                           enum reservation_place place, unsigned int flight) {
+    uint32_t location = pack_location(place, flight);
+    uint64_t hash = hash_number(reservation_number);
+    _Atomic uintptr_t *slot = &index->root[hash & (((uint64_t) 1 << index->root_bits) - 1)];
+    unsigned int shift = index->root_bits;
+    struct index_leaf *leaf = NULL;
+    uintptr_t current = atomic_load_explicit(slot, memory_order_acquire);
+
+    while (1) {
+        if (current == 0) {
+            if (leaf == NULL) {
+                leaf = new_leaf(index);
+                if (leaf == NULL) return;
+                leaf->reservation_number = reservation_number;
+                atomic_init(&leaf->location, location);
+            }
+            if (atomic_compare_exchange_strong_explicit(slot, &current, (uintptr_t) leaf, memory_order_release,
+                                                        memory_order_acquire)) {
+                return;
+            }
+            continue; // someone else took the slot, look at what they put there
+        }
+        if (current & CHILD_TAG) {
+            struct index_node *node = (struct index_node *) (current & ~CHILD_TAG);
+            slot = &node->slots[(hash >> shift) & (INDEX_NODE_SLOTS - 1)];
+            shift += INDEX_NODE_BITS;
+            current = atomic_load_explicit(slot, memory_order_acquire);
+            continue;
+        }
+
+        struct index_leaf *existing = (struct index_leaf *) current;
+        if (existing->reservation_number == reservation_number) {
+            atomic_store_explicit(&existing->location, location, memory_order_release);
+            if (leaf != NULL) arena.spare_leaf = leaf; // another thread added it meanwhile
+            return;
+        }
+        // another reservation holds the slot, so it moves one level down into a new node
+        struct index_node *node = new_node(index);
+        if (node == NULL) return;
+        _Atomic uintptr_t *moved = &node->slots[(hash_number(existing->reservation_number) >> shift) &
+                                                (INDEX_NODE_SLOTS - 1)];
+        atomic_store_explicit(moved, current, memory_order_relaxed);
+        uintptr_t child = (uintptr_t) node | CHILD_TAG;
+        if (atomic_compare_exchange_strong_explicit(slot, &current, child, memory_order_release,
+                                                    memory_order_acquire)) {
+            current = child;
+        } else {
+            atomic_store_explicit(moved, 0, memory_order_relaxed);
+            arena.spare_node = node;
+        }
+    }
+}
+
+int reservation_index_find(struct reservation_index *index, reservation_number_t reservation_number,
+                           struct reservation_location *location) {
+    uint64_t hash = hash_number(reservation_number);
+    uintptr_t current = atomic_load_explicit(&index->root[hash & (((uint64_t) 1 << index->root_bits) - 1)],
+                                             memory_order_acquire);
+    unsigned int shift = index->root_bits;
+    while (current & CHILD_TAG) {
+        struct index_node *node = (struct index_node *) (current & ~CHILD_TAG);
+        current = atomic_load_explicit(&node->slots[(hash >> shift) & (INDEX_NODE_SLOTS - 1)], memory_order_acquire);
+        shift += INDEX_NODE_BITS;
+    }
+    if (current == 0) {
+        return 0;
+    }
+    struct index_leaf *leaf = (struct index_leaf *) current;
+    if (leaf->reservation_number != reservation_number) {
+        return 0;
+    }
+    uint32_t packed = atomic_load_explicit(&leaf->location, memory_order_acquire);
+    location->place = (enum reservation_place) (packed >> PLACE_SHIFT);
+    location->flight = packed & FLIGHT_MASK;
+    return location->place != PLACE_NONE;
+}
+
+static void count_slot(uintptr_t current, unsigned int depth, struct reservation_index_stats *stats) {
+    if (current == 0) {
+        return;
+    }
+    if (current & CHILD_TAG) {
+        struct index_node *node = (struct index_node *) (current & ~CHILD_TAG);
+        stats->nodes++;
+        for (unsigned int i = 0; i < INDEX_NODE_SLOTS; i++) {
+            count_slot(atomic_load_explicit(&node->slots[i], memory_order_acquire), depth + 1, stats);
+        }
+        return;
+    }
+    struct index_leaf *leaf = (struct index_leaf *) current;
+    stats->leaves++;
+    if (atomic_load_explicit(&leaf->location, memory_order_relaxed) >> PLACE_SHIFT != PLACE_NONE) {
+        stats->located++;
+    }
+    if (depth > stats->depth) stats->depth = depth;
+}
+
+void reservation_index_stats(struct reservation_index *index, struct reservation_index_stats *stats) {
+    memset(stats, 0, sizeof(struct reservation_index_stats));
+    size_t slots = (size_t) 1 << index->root_bits;
+    for (size_t i = 0; i < slots; i++) {
+        count_slot(atomic_load_explicit(&index->root[i], memory_order_acquire), 1, stats);
+    }
+    stats->bytes = slots * sizeof(_Atomic uintptr_t);
+    for (struct index_chunk *chunk = atomic_load(&index->chunks); chunk != NULL; chunk = chunk->next) {
+        stats->bytes += chunk->size;
+    }
+}
+
+const char *reservation_place_name(enum reservation_place place) {
+    switch (place) {
+        case PLACE_STACK:
+            return "stack";
+        case PLACE_QUEUE:
+            return "queue";
+        case PLACE_CENTER:
+            return "center";
+        default:
+            return "nowhere";
+    }
+}
+
+void reservation_index_destroy(struct reservation_index *index) {
+    struct index_chunk *chunk = atomic_load(&index->chunks);
+    while (chunk != NULL) {
+        struct index_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(index->root);
+}
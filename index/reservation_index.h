@@ -0,0 +1,120 @@
+#ifndef HY486_PROJECT_RESERVATION_INDEX_H
+#define HY486_PROJECT_RESERVATION_INDEX_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/reservations.h"
+
+/**
+ * Slots of the nodes below the root, indexed by the next INDEX_NODE_BITS bits of a hash
+ */
+#define INDEX_NODE_BITS 4
+#define INDEX_NODE_SLOTS (1u << INDEX_NODE_BITS)
+
+/**
+ * Bytes of the allocations a thread carves leaves & nodes out of. A thread's first chunk is the smallest
+ * and every next one doubles up to the largest, so the many agencies that add a few reservations each
+ * don't hold on to much unused memory.
+ */
+#define INDEX_CHUNK_MIN 1024
+#define INDEX_CHUNK_MAX (64 * 1024)
+
+/**
+ * Where a reservation is
+ */
+enum reservation_place {
+    PLACE_NONE, // not indexed, or released
+    PLACE_STACK,
+    PLACE_QUEUE,
+    PLACE_CENTER
+};
+
+struct reservation_location {
+    enum reservation_place place;
+    unsigned int flight; // whose stack or queue holds it, or the airline that moved it to the center
+};
+
+/**
+ * A reservation number and its location, packed as place << 30 | flight
+ */
+struct index_leaf {
+    reservation_number_t reservation_number;
+    _Atomic uint32_t location;
+};
+
+/**
+ * A slot holds 0 when empty, a leaf, or a child node with the low bit set
+ */
+struct index_node {
+    _Atomic uintptr_t slots[INDEX_NODE_SLOTS];
+};
+
+struct index_chunk {
+    struct index_chunk *next;
+    size_t size;
+    size_t used;
+};
+
+/**
+ * @brief A lock-free hash index from reservation numbers to their location.
+ *
+ * The index is a hash trie. The root is a table sized from the expected number of reservations, indexed by
+ * the low bits of a hash of the reservation number. When a new reservation's slot is already taken by
+ * another, the slot is split with a CAS into a child node that the next INDEX_NODE_BITS bits of the hashes
+ * index. The index grows where it's crowded, without ever rehashing or stopping the writers. A lookup is a
+ * walk of a couple of slots on average. Leaves are never removed, only their location changes, so nothing
+ * is freed before the index is destroyed. That also rules out ABA on the CASes.
+ */
+struct reservation_index {
+    uint64_t id; // tells the threads' chunks of different indexes apart
+    _Atomic uintptr_t *root;
+    unsigned int root_bits;
+    _Atomic(struct index_chunk *) chunks; // of every thread, freed when the index is destroyed
+};
+
+/**
+ * What the index holds, counted by walking it
+ */
+struct reservation_index_stats {
+    uint64_t leaves;
+    uint64_t located; // leaves that aren't PLACE_NONE
+    uint64_t nodes;
+    unsigned int depth; // deepest leaf, the root being depth 1
+    size_t bytes;
+};
+
+/**
+ * @param expected Reservations the index is expected to hold, only used to size the root
+ * @return 1 if successful, 0 otherwise
+ */
+int reservation_index_init(struct reservation_index *index, uint64_t expected);
+
+/**
+ * @brief Records where a reservation is, adding it to the index if it's new.
+ *
+ * Lock-free, and wait-free once the reservation is indexed. A reservation that can't be added
+ * because memory ran out is left out, which reservation_index_stats shows as fewer leaves.
+ * Callers record a move before making it, so that a later move of the same reservation by
+ * another thread, which follows the structure operation this one precedes, is never
+ * overwritten with an older location.
+ */
+void reservation_index_set(struct reservation_index *index, reservation_number_t reservation_number,
+                           enum reservation_place place, unsigned int flight);
+
+/**
+ * @return 1 and the reservation's location if it's indexed and not PLACE_NONE, 0 otherwise
+ */
+int reservation_index_find(struct reservation_index *index, reservation_number_t reservation_number,
+                           struct reservation_location *location);
+
+/**
+ * Counts what the index holds. The writers must be quiescent for the counts to be exact.
+ */
+void reservation_index_stats(struct reservation_index *index, struct reservation_index_stats *stats);
+
+const char *reservation_place_name(enum reservation_place place);
+
+void reservation_index_destroy(struct reservation_index *index);
+
+#endif //HY486_PROJECT_RESERVATION_INDEX_H
@@ -0,0 +1,153 @@
+#include "latency.h"
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static const char *op_names[LATENCY_OPS] = {"push", "pop", "enqueue", "dequeue", "insert", "deleteAndGet"};
+
+#ifdef LATENCY_HISTOGRAMS
+__thread struct latency_recorder *latency_slot = NULL;
+
+uint64_t latency_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+static unsigned int bucket_of(uint64_t ns) {
+    if (ns < LATENCY_SUB_BUCKETS) return (unsigned int) ns;
+    if (ns >> LATENCY_MAX_BITS) ns = (1ull << LATENCY_MAX_BITS) - 1;
+    unsigned int msb = 63 - __builtin_clzll(ns);
+    unsigned int shift = msb - LATENCY_SUB_BITS;
+    // the top LATENCY_SUB_BITS + 1 bits of ns, whose leading 1 stands for the power of two
+    return LATENCY_SUB_BUCKETS * (shift + 1) + (unsigned int) (ns >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+void latency_record(enum latency_op op, uint64_t started) {
+    uint64_t ns = latency_now() - started;
+    struct latency_histogram *histogram = latency_slot->ops[op];
+    if (histogram == NULL) {
+        histogram = calloc(1, sizeof(struct latency_histogram));
+        if (histogram == NULL) return;
+        latency_slot->ops[op] = histogram;
+    }
+    histogram->count++;
+    histogram->buckets[bucket_of(ns)]++;
+    if (ns > histogram->max_ns) histogram->max_ns = ns;
+}
+#endif
+
+/**
+ * @return The highest latency that falls into a bucket
+ */
+static uint64_t bucket_upper_bound(unsigned int bucket) {
+    if (bucket < LATENCY_SUB_BUCKETS) return bucket;
+    unsigned int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+    uint64_t lower = (uint64_t) (LATENCY_SUB_BUCKETS + bucket % LATENCY_SUB_BUCKETS) << shift;
+    return lower + (1ull << shift) - 1;
+}
+
+static void merge(struct latency_histogram *into, const struct latency_histogram *from) {
+    into->count += from->count;
+    if (from->max_ns > into->max_ns) into->max_ns = from->max_ns;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+}
+
+/**
+ * @return The latency below which a fraction of the recorded ones fall, within the bucket's precision
+ */
+static uint64_t percentile(const struct latency_histogram *histogram, double fraction) {
+    uint64_t target = (uint64_t) ceil(fraction * (double) histogram->count);
+    if (target == 0) target = 1;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= target) {
+            uint64_t bound = bucket_upper_bound(i);
+            return bound < histogram->max_ns ? bound : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+int latency_init(struct latency_recorders *recorders, unsigned int num_slots) {
+    recorders->slots = calloc(num_slots > 0 ? num_slots : 1, sizeof(struct latency_recorder));
+    if (recorders->slots == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < num_slots; i++) {
+        recorders->slots[i].flight = LATENCY_NO_FLIGHT;
+    }
+    recorders->num_slots = num_slots;
+    return 1;
+}
+
+void latency_attach(struct latency_recorders *recorders, unsigned int slot, unsigned int flight) {
+    recorders->slots[slot].flight = flight;
+#ifdef LATENCY_HISTOGRAMS
+    latency_slot = &recorders->slots[slot];
+#endif
+}
+
+/**
+ * Merges the histograms of an operation over the threads of a flight, or all threads for LATENCY_NO_FLIGHT
+ */
+static void merge_op(struct latency_recorders *recorders, enum latency_op op, unsigned int flight,
+                     struct latency_histogram *merged) {
+    memset(merged, 0, sizeof(struct latency_histogram));
+    for (unsigned int i = 0; i < recorders->num_slots; i++) {
+        const struct latency_recorder *recorder = &recorders->slots[i];
+        if (recorder->ops[op] == NULL) continue;
+        if (flight != LATENCY_NO_FLIGHT && recorder->flight != flight) continue;
+        merge(merged, recorder->ops[op]);
+    }
+}
+
+void latency_report(struct latency_recorders *recorders, const char *phase, unsigned int numOfFlights) {
+    struct latency_histogram *merged = malloc(sizeof(struct latency_histogram));
+    if (merged == NULL) return;
+
+    printf("%s latencies (ns):\n", phase);
+    printf("%-14s %12s %10s %10s %10s %12s\n", "operation", "count", "p50", "p99", "p99.9", "max");
+    for (int op = 0; op < LATENCY_OPS; op++) {
+        merge_op(recorders, op, LATENCY_NO_FLIGHT, merged);
+        if (merged->count == 0) continue;
+        printf("%-14s %12" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %12" PRIu64 "\n", op_names[op],
+               merged->count, percentile(merged, 0.5), percentile(merged, 0.99), percentile(merged, 0.999),
+               merged->max_ns);
+    }
+    // attributed to the flight of the thread that ran the operation
+    for (unsigned int flight = 0; flight < numOfFlights; flight++) {
+        for (int op = 0; op < LATENCY_OPS; op++) {
+            merge_op(recorders, op, flight, merged);
+            if (merged->count == 0) continue;
+            printf("Flight %u %s: %" PRIu64 " ops, p50 %" PRIu64 ", p99 %" PRIu64 ", p99.9 %" PRIu64 ", max %" PRIu64 "\n",
+                   flight, op_names[op], merged->count, percentile(merged, 0.5), percentile(merged, 0.99),
+                   percentile(merged, 0.999), merged->max_ns);
+        }
+    }
+    printf("\n");
+    free(merged);
+
+    // the next phase starts from empty histograms
+    for (unsigned int i = 0; i < recorders->num_slots; i++) {
+        for (int op = 0; op < LATENCY_OPS; op++) {
+            struct latency_histogram *histogram = recorders->slots[i].ops[op];
+            if (histogram != NULL) memset(histogram, 0, sizeof(struct latency_histogram));
+        }
+    }
+}
+
+void latency_destroy(struct latency_recorders *recorders) {
+    for (unsigned int i = 0; i < recorders->num_slots; i++) {
+        for (int op = 0; op < LATENCY_OPS; op++) {
+            free(recorders->slots[i].ops[op]);
+        }
+    }
+    free(recorders->slots);
+}
@@ -0,0 +1,104 @@
+#ifndef HY486_PROJECT_LATENCY_H
+#define HY486_PROJECT_LATENCY_H
+
+#include <stdint.h>
+
+/**
+ * The container operations whose latency is recorded
+ */
+enum latency_op {
+    LATENCY_PUSH,
+    LATENCY_POP,
+    LATENCY_ENQUEUE,
+    LATENCY_DEQUEUE,
+    LATENCY_INSERT,
+    LATENCY_DELETE, // deleteAndGet
+    LATENCY_OPS
+};
+
+/**
+ * Values below 2^LATENCY_SUB_BITS nanoseconds get a bucket each, every power of two above that is split
+ * into 2^LATENCY_SUB_BITS buckets, so a recorded latency is off by at most 1/8 of itself
+ */
+#define LATENCY_SUB_BITS 3
+#define LATENCY_SUB_BUCKETS (1u << LATENCY_SUB_BITS)
+/**
+ * Latencies from 2^LATENCY_MAX_BITS ns (~69 s) on share the last bucket
+ */
+#define LATENCY_MAX_BITS 36
+#define LATENCY_BUCKETS (LATENCY_SUB_BUCKETS * (LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1))
+
+/**
+ * A log-bucketed (HDR-style) histogram of latencies in nanoseconds
+ */
+struct latency_histogram {
+    uint64_t count;
+    uint64_t max_ns;
+    uint64_t buckets[LATENCY_BUCKETS];
+};
+
+/**
+ * The histograms of one thread, only ever written by it
+ */
+struct latency_recorder {
+    unsigned int flight; // the thread's flight, LATENCY_NO_FLIGHT if it has none
+    struct latency_histogram *ops[LATENCY_OPS]; // allocated on the thread's first operation of each kind
+};
+
+#define LATENCY_NO_FLIGHT UINT32_MAX
+
+/**
+ * A recorder per agency (or replay worker) and airline, merged at the controller's checks
+ */
+struct latency_recorders {
+    struct latency_recorder *slots;
+    unsigned int num_slots;
+};
+
+#ifdef LATENCY_HISTOGRAMS
+
+/**
+ * The calling thread's recorder, NULL if its operations aren't recorded
+ */
+extern __thread struct latency_recorder *latency_slot;
+
+uint64_t latency_now(void);
+
+void latency_record(enum latency_op op, uint64_t started);
+
+/**
+ * Opens a latency measurement in the current scope, to be closed with LATENCY_STOP
+ */
+#define LATENCY_START() uint64_t latency_started = latency_slot != NULL ? latency_now() : 0
+/**
+ * Records the time since LATENCY_START as a latency of op
+ */
+#define LATENCY_STOP(op) do { if (latency_slot != NULL) latency_record((op), latency_started); } while (0)
+
+#else
+
+#define LATENCY_START() do { } while (0)
+#define LATENCY_STOP(op) do { } while (0)
+
+#endif
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int latency_init(struct latency_recorders *recorders, unsigned int num_slots);
+
+/**
+ * Makes the calling thread record its operations into a slot
+ * @param flight The thread's flight, for the per-flight report, or LATENCY_NO_FLIGHT
+ */
+void latency_attach(struct latency_recorders *recorders, unsigned int slot, unsigned int flight);
+
+/**
+ * Merges the histograms of all threads and prints p50, p99, p99.9 and max of every operation,
+ * overall and per flight, then clears them for the next phase. The threads must be quiescent.
+ */
+void latency_report(struct latency_recorders *recorders, const char *phase, unsigned int numOfFlights);
+
+void latency_destroy(struct latency_recorders *recorders);
+
+#endif //HY486_PROJECT_LATENCY_H
@@ -0,0 +1,68 @@
+#include "flights_table.h"
+#include <stdlib.h>
+
+int createFlightsTable(struct flights_table *table, unsigned int numOfFlights) {
+    table->num_flights = numOfFlights;
+    table->slots = NULL;
+    table->flights = calloc(numOfFlights > 0 ? numOfFlights : 1, sizeof(struct flight_reservations *));
+    if (table->flights == NULL) {
+        return 0;
+    }
+#ifdef CACHE_LAYOUT
+    // the size of an aligned struct is a multiple of its alignment, as aligned_alloc requires
+    table->slots = aligned_alloc(_Alignof(struct flight_slot),
+                                 sizeof(struct flight_slot) * (numOfFlights > 0 ? numOfFlights : 1));
+    if (table->slots == NULL) {
+        free(table->flights);
+        return 0;
+    }
+#endif
+    return 1;
+}
+
+struct flight_reservations *createFlight(struct flights_table *table, unsigned int flight, unsigned int capacity) {
+    struct flight_reservations *created;
+#ifdef CACHE_LAYOUT
+    struct flight_slot *slot = &table->slots[flight];
+    initStack(&slot->completed_reservations, capacity);
+    if (!initQueue(&slot->pending_reservations)) {
+        finalizeStack(&slot->completed_reservations);
+        return NULL;
+    }
+    created = &slot->flight;
+    created->completed_reservations = &slot->completed_reservations;
+    created->pending_reservations = &slot->pending_reservations;
+#else
+    created = (struct flight_reservations *) malloc(sizeof(struct flight_reservations));
+    if (created == NULL) {
+        return NULL;
+    }
+    created->completed_reservations = createStack(capacity);
+    created->pending_reservations = createQueue();
+    if (created->completed_reservations == NULL || created->pending_reservations == NULL) {
+        destroyStack(created->completed_reservations);
+        if (created->pending_reservations != NULL) destroyQueue(created->pending_reservations);
+        free(created);
+        return NULL;
+    }
+#endif
+    table->flights[flight] = created;
+    return created;
+}
+
+void destroyFlightsTable(struct flights_table *table) {
+    for (unsigned int i = 0; i < table->num_flights; i++) {
+        struct flight_reservations *flight = table->flights[i];
+        if (flight == NULL) continue;
+#ifdef CACHE_LAYOUT
+        finalizeStack(flight->completed_reservations);
+        finalizeQueue(flight->pending_reservations);
+#else
+        destroyStack(flight->completed_reservations);
+        destroyQueue(flight->pending_reservations);
+        free(flight);
+#endif
+    }
+    free(table->slots);
+    free(table->flights);
+}
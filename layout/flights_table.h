@@ -0,0 +1,48 @@
+#ifndef HY486_PROJECT_FLIGHTS_TABLE_H
+#define HY486_PROJECT_FLIGHTS_TABLE_H
+
+#include "../common/reservations.h"
+#include "../stack/stack.h"
+#include "../queue/queue.h"
+
+/**
+ * A flight together with its stack and queue, the unit of the flights table in CACHE_LAYOUT builds
+ */
+struct flight_slot {
+    struct flight_reservations flight; // read-mostly pointers to the two below
+    struct stack completed_reservations;
+    struct queue pending_reservations;
+};
+
+/**
+ * @brief The flights of a run and the memory behind them.
+ *
+ * By default every flight, stack and queue is a separate allocation. In CACHE_LAYOUT builds the
+ * whole table is a single cache-line aligned allocation of flight slots instead, so a flight's
+ * structures sit next to each other and no two flights share a cache line.
+ */
+struct flights_table {
+    struct flight_reservations **flights; // what the rest of the program indexes
+    struct flight_slot *slots; // NULL unless CACHE_LAYOUT
+    unsigned int num_flights;
+};
+
+/**
+ * Allocates the table, without creating any flight. The slots are only touched by createFlight, but
+ * several slots share a page, so under CACHE_LAYOUT the first flight created on a page places all of them.
+ * @return 1 if successful, 0 otherwise
+ */
+int createFlightsTable(struct flights_table *table, unsigned int numOfFlights);
+
+/**
+ * Creates a flight with an empty stack of the given capacity and an empty queue
+ * @return The flight, also stored in table->flights[flight], or NULL if allocation failed
+ */
+struct flight_reservations *createFlight(struct flights_table *table, unsigned int flight, unsigned int capacity);
+
+/**
+ * Destroys every flight created in the table and frees the table
+ */
+void destroyFlightsTable(struct flights_table *table);
+
+#endif //HY486_PROJECT_FLIGHTS_TABLE_H
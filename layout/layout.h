@@ -0,0 +1,19 @@
+#ifndef HY486_PROJECT_LAYOUT_H
+#define HY486_PROJECT_LAYOUT_H
+
+#define CACHE_LINE_SIZE 64
+
+/**
+ * Starts a group of fields on its own cache line in builds with CACHE_LAYOUT. A group holds the
+ * fields one owner writes together, e.g. a lock and what it guards, so that threads working on
+ * different groups of a structure (e.g. the two ends of a queue) don't false-share, while a thread
+ * working on one group only pulls one line. Expands to nothing otherwise, which keeps the
+ * structures as compact as they were.
+ */
+#ifdef CACHE_LAYOUT
+#define HOT_FIELD _Alignas(CACHE_LINE_SIZE)
+#else
+#define HOT_FIELD
+#endif
+
+#endif //HY486_PROJECT_LAYOUT_H
@@ -4,6 +4,8 @@
 
 #include <malloc.h>
 #include "lazy_list.h"
+#include "../latency/latency.h"
+#include "../contention/contention.h"
 
 
 struct list *create_list() {
@@ -17,6 +19,8 @@ struct list *create_list() {
     list->tail->reservation.reservation_number = -1;
     pthread_mutex_init(&list->tail->lock, NULL);
     list->head->next = list->tail;
+    list->size = 0;
+    list->removals = 0;
     return list;
 }
 
@@ -30,7 +34,7 @@ int validate(struct list_reservation *pred, struct list_reservation *curr) {
     return !pred->marked && !curr->marked && pred->next == curr;
 }
 
-int searchReservation(struct list *list, int reservation_number) {
+int searchReservation(struct list *list, reservation_number_t reservation_number) {
 
     struct list_reservation *current = list->head;
 
@@ -44,12 +48,14 @@ int searchReservation(struct list *list, int reservation_number) {
     return 0;
 }
 
+static int printReservation(const struct Reservation *reservation, void *context) {
+    (void) context;
+    printf("Reservation in center with id : %" PRI_RESERVATION " -> ", reservation->reservation_number);
+    return 1;
+}
+
 void printList(struct list *list) {
-    struct list_reservation *current = list->head->next; // head is sentinel
-    while (current != list->tail) {
-        printf("Reservation in center with id : %d -> ", current->reservation.reservation_number);
-        current = current->next;
-    }
+    forEachInList(list, printReservation, NULL);
     printf("NULL\n");
 }
 
@@ -59,6 +65,7 @@ int isListEmpty(struct list *list) {
 
 
 int insert(struct list *list, struct Reservation reservation) {
+    LATENCY_START();
     while (1) {
         struct list_reservation *pred = list->head;
         struct list_reservation *curr = list->head->next;
@@ -70,8 +77,8 @@ int insert(struct list *list, struct Reservation reservation) {
             curr = curr->next;
         }
 
-        pthread_mutex_lock(&pred->lock);
-        pthread_mutex_lock(&curr->lock);
+        contention_lock(&pred->lock, CONTENTION_CENTER);
+        contention_lock(&curr->lock, CONTENTION_CENTER);
 
         // confirm that the proper nodes have been locked
         if (validate(pred, curr)) {
@@ -79,6 +86,7 @@ int insert(struct list *list, struct Reservation reservation) {
                 // key already present so abort insertion
                 pthread_mutex_unlock(&curr->lock);
                 pthread_mutex_unlock(&pred->lock);
+                LATENCY_STOP(LATENCY_INSERT);
                 return 0;
             } else {
                 // found suitable position for non-yet existent entry
@@ -88,8 +96,10 @@ int insert(struct list *list, struct Reservation reservation) {
                 node->marked = 0;
                 node->next = curr;
                 pred->next = node;
+                list->size += 1;
                 pthread_mutex_unlock(&curr->lock);
                 pthread_mutex_unlock(&pred->lock);
+                LATENCY_STOP(LATENCY_INSERT);
 
                 return 1;
             }
@@ -98,6 +108,7 @@ int insert(struct list *list, struct Reservation reservation) {
         // failed to validate, release and retry
         pthread_mutex_unlock(&curr->lock);
         pthread_mutex_unlock(&pred->lock);
+        CONTENTION_COUNT(CONTENTION_CENTER, validate_failures);
     }
 }
 
@@ -107,6 +118,7 @@ int insert(struct list *list, struct Reservation reservation) {
  * @return The first list element
  */
 struct Reservation deleteAndGet(struct list *list) {
+    LATENCY_START();
     struct Reservation reservation;
 
     while (1) {
@@ -115,28 +127,81 @@ struct Reservation deleteAndGet(struct list *list) {
 
         // list is empty
         if (curr == list->tail) {
+            CONTENTION_COUNT(CONTENTION_CENTER, empty_polls);
             reservation.reservation_number = -1;
+            LATENCY_STOP(LATENCY_DELETE);
             return reservation;
         }
 
-        pthread_mutex_lock(&pred->lock);
-        pthread_mutex_lock(&curr->lock);
+        contention_lock(&pred->lock, CONTENTION_CENTER);
+        contention_lock(&curr->lock, CONTENTION_CENTER);
 
         if (validate(pred, curr)) {
             struct list_reservation *tmp = curr;
             reservation = tmp->reservation;
             curr->marked = 1; // remove logically
             pred->next = curr->next; // remove physically
+            list->size -= 1;
+            atomic_fetch_add_explicit(&list->removals, 1, memory_order_relaxed);
             free(tmp);
             pthread_mutex_unlock(&curr->lock);
             pthread_mutex_unlock(&pred->lock);
+            LATENCY_STOP(LATENCY_DELETE);
             return reservation;
         }
 
         // failed to validate, release and retry
         pthread_mutex_unlock(&curr->lock);
         pthread_mutex_unlock(&pred->lock);
+        CONTENTION_COUNT(CONTENTION_CENTER, validate_failures);
+    }
+}
+
+void appendSortedBulk(struct list *list, const struct Reservation *reservations, unsigned int count) {
+    // find the current last node, whose successor is the tail sentinel
+    struct list_reservation *last = list->head;
+    while (last->next != list->tail) {
+        last = last->next;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        struct list_reservation *node = (struct list_reservation *) malloc(sizeof(struct list_reservation));
+        if (node == NULL) {
+            break;
+        }
+        pthread_mutex_init(&node->lock, NULL);
+        node->reservation = reservations[i];
+        node->marked = 0;
+        node->next = list->tail;
+        last->next = node;
+        last = node;
+        list->size += 1;
+    }
+}
+
+unsigned int forEachInList(struct list *list, reservation_visitor visit, void *context) {
+    unsigned int visited = 0;
+    for (struct list_reservation *node = list->head->next; node != list->tail; node = node->next) { // head is sentinel
+        if (node->marked) continue;
+        visited++;
+        if (!visit(&node->reservation, context)) break;
+    }
+    return visited;
+}
+
+unsigned int exportList(struct list *list, struct reservation_cursor *cursor, struct Reservation *out,
+                        unsigned int max) {
+    unsigned int copied = 0;
+    unsigned long removals = atomic_load_explicit(&list->removals, memory_order_relaxed);
+    check_cursor(cursor, removals, "exportList");
+    const struct list_reservation *node = cursor->started ? cursor->node : list->head->next;
+    for (; node != list->tail && copied < max; node = node->next) {
+        if (!node->marked) out[copied++] = node->reservation;
     }
+    cursor->node = node;
+    cursor->started = 1;
+    cursor->removals = removals;
+    return copied;
 }
 
 void destroyList(struct list *list) {
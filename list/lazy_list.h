@@ -6,6 +6,7 @@
 #define HY486_PROJECT_LAZY_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include "../common/reservations.h"
 
 /**
@@ -30,13 +31,15 @@ struct list_reservation {
 struct list {
     struct list_reservation *head;
     struct list_reservation *tail;
+    _Atomic unsigned int size; // number of reservations in the list, for readers that can't walk it
+    _Atomic unsigned long removals; // deletions so far, so that a walk can tell its cursor is stale
 };
 
 struct list *create_list();
 
 void printList(struct list *list);
 
-int searchReservation(struct list *list, int flight_number);
+int searchReservation(struct list *list, reservation_number_t reservation_number);
 
 int validate(struct list_reservation *pred, struct list_reservation *curr);
 
@@ -46,6 +49,27 @@ int insert(struct list *list, struct Reservation reservation);
 
 struct Reservation deleteAndGet(struct list *list);
 
+/**
+ * Appends reservations that are already sorted and greater than every reservation in
+ * the list, without searching or locking. Only safe while no other thread uses the list.
+ */
+void appendSortedBulk(struct list *list, const struct Reservation *reservations, unsigned int count);
+
+/**
+ * Calls visit for every reservation that isn't marked as deleted, in ascending order. Like searches,
+ * the walk takes no locks.
+ * @return The number of reservations visited
+ */
+unsigned int forEachInList(struct list *list, reservation_visitor visit, void *context);
+
+/**
+ * Copies up to max reservations, in ascending order, into out, continuing where the cursor left off.
+ * Like searches, the walk takes no locks, so nothing may be deleted during an export (see check_cursor).
+ * @return The number of reservations copied, 0 once every reservation has been exported
+ */
+unsigned int exportList(struct list *list, struct reservation_cursor *cursor, struct Reservation *out,
+                        unsigned int max);
+
 void destroyList(struct list *list);
 
 #endif //HY486_PROJECT_LAZY_LIST_H
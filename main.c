@@ -1,19 +1,44 @@
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
 #include <stdlib.h>
-#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "stack/stack.h"
 #include "queue/queue.h"
 #include "common/reservations.h"
+#include "common/keysum.h"
 #include "list/lazy_list.h"
+#include "common/options.h"
+#include "affinity/affinity.h"
+#include "wal/wal.h"
+#include "snapshot/snapshot.h"
+#include "trace/trace.h"
+#include "workload/workload.h"
+#include "routing/routing.h"
+#include "p2p/matching_board.h"
+#include "service/service.h"
+#include "audit/audit.h"
+#include "verify/exactly_once.h"
+#include "simd/reservation_stats.h"
+#include "layout/flights_table.h"
+#include "timings/phase_timings.h"
+#include "latency/latency.h"
+#include "contention/contention.h"
+#include "perf/perf_counters.h"
+#include "timeline/timeline.h"
+#include "sequential/reference.h"
+#include "adaptive/adaptive.h"
+#include "index/reservation_index.h"
 
 
-pthread_mutex_t inserter_airlines_lock;
-
 /**
- * Set by the flight controller and altered by airline companies (shared var)
+ * Set by the flight controller and altered by airline companies (shared var). Inserters decrement it with
+ * release ordering after their last insert, and consumers load it with acquire ordering before they look
+ * at the center, so a consumer that reads 0 also sees every reservation inserted before it.
  */
-unsigned int number_of_inserter_airlines;
+_Atomic unsigned int number_of_inserter_airlines;
 
 
 /**
@@ -31,6 +56,162 @@ unsigned int numOfFlights = 0;
  */
 unsigned int numOfAirlineCompanies = 0;
 
+/**
+ * Number of reservations the checks expect to find. A^3 for the synthetic agencies,
+ * or whatever the replayed trace or restored snapshot holds.
+ */
+uint64_t expectedTotalReservations = 0;
+
+/**
+ * Sum of reservation numbers the checks expect to find, (A^6 + A^3) / 2 for the synthetic agencies
+ */
+keysum_t expectedKeySum = 0;
+
+/**
+ * The synthetic workload of the agencies, NULL for the fixed mapping at full speed
+ */
+struct workload *workload = NULL;
+
+/**
+ * Reservations each flight should receive in phase 1 under the workload, NULL if not using one
+ */
+uint64_t *expectedFlightReservations = NULL;
+
+/**
+ * Power-of-two-choices router of flexible reservations, NULL to book every reservation on its own flight
+ */
+struct router *router = NULL;
+
+/**
+ * Phase 1 overflow (reservations that end up in queues) the agencies would cause without routing
+ */
+uint64_t overflowWithoutRouting = 0;
+
+/**
+ * Board matching overflow reservations with reserved seats in phase 2, NULL to redistribute through the center
+ */
+struct matching_board *seat_board = NULL;
+
+/**
+ * Picks the phase 2 backend at the phase boundary (--redistribution=adaptive), NULL when it's fixed
+ */
+struct adaptive *adaptive = NULL;
+
+/**
+ * Whether both phases overlap (--pipelined)
+ */
+int pipelined = 0;
+
+/**
+ * Pipelined mode: reservations that are in a queue, in the center or on their way between the two,
+ * i.e. booked but not yet on a stack. Termination is detected when it drops to 0 after the producers finish.
+ */
+atomic_uint_fast64_t outstanding_reservations;
+
+/**
+ * Pipelined mode: set by the controller once every agency (or replay worker) has finished
+ */
+atomic_int producers_done;
+
+/**
+ * Long-running service mode (--service), NULL for a single batch of A^3 reservations
+ */
+struct service *service = NULL;
+
+/**
+ * Online auditor of pipelined runs (--audit), NULL when the structures are only checked at the end
+ */
+struct auditor *auditor = NULL;
+
+/**
+ * The calling thread's flow counters, NULL if it isn't audited
+ */
+static __thread struct audit_counters *audit_slot = NULL;
+
+/**
+ * Whether the controller verifies the reservation numbers with the exactly-once bitmap (--verify=bitmap)
+ * instead of the keysum. Only set when the expected reservations are numbered 1..N.
+ */
+int exactlyOnceVerification = 0;
+
+/**
+ * Threads of the exactly-once verification, 0 for one per online CPU
+ */
+unsigned int verificationWorkers = 0;
+
+/**
+ * Whether the controller prints per-flight statistics after the final checks (--flight-stats)
+ */
+int flightStats = 0;
+
+/**
+ * When each phase of the run ended, marked by the controller and main (--timings)
+ */
+struct phase_timings run_timings;
+
+#ifdef LATENCY_HISTOGRAMS
+/**
+ * Per-thread latency histograms of the container operations, in the same slots as the auditor's counters
+ */
+struct latency_recorders latencies;
+#endif
+
+/**
+ * Per-thread lock & retry counters (--contention), NULL when they aren't counted
+ */
+struct contention_recorders *contention = NULL;
+
+/**
+ * Whether the controller prints the contention counters at its checks (--contention), which
+ * adaptive runs also count without printing them
+ */
+int contentionReports = 0;
+
+/**
+ * Per-phase hardware & resource usage counters (--perf-counters), NULL when they aren't counted
+ */
+struct perf_counters *perf_counters = NULL;
+
+/**
+ * Per-thread event rings of the timeline (--timeline), NULL when it isn't recorded
+ */
+struct timeline *timeline = NULL;
+
+/**
+ * Reservations the checks copy out of a structure per lock acquisition
+ */
+#define EXPORT_CHUNK 1024
+
+/**
+ * Reservations an inserter airline moves per claimed block of seats
+ */
+#define P2P_BATCH 64
+
+/**
+ * Seed of the agencies' generators
+ */
+uint64_t workloadSeed = 1;
+
+/**
+ * When the agencies started, used to pace them under the workload
+ */
+double agencies_start = 0;
+
+/**
+ * Write-ahead log of every reservation operation, NULL when running in memory only
+ */
+struct wal *reservation_log = NULL;
+
+/**
+ * Where every reservation is (--index), NULL when it isn't tracked
+ */
+struct reservation_index *reservation_index = NULL;
+
+/**
+ * Reservation the controller looks up in the index after the final checks (--locate), 0 for none
+ */
+reservation_number_t locatedReservation = 0;
+
 /**
  * The flight controller responsible for validating flight reservations
  */
@@ -54,12 +235,35 @@ pthread_barrier_t barrier_start_2nd_phase;
  */
 pthread_barrier_t barrier_start_2nd_phase_checks;
 
+/**
+ * Set by the controller before the phase 2 barrier when the phase 1 checks failed, so that the
+ * airlines skip phase 2 and the run ends instead of leaving them waiting at the barrier
+ */
+int phase_1_failed = 0;
+
 /**
  * Represents an agency's arguments that are passed to and used by agency threads
  */
 struct agency_args {
     int agency_id;
+    unsigned int flight_index; // position of the flight in the flights table
     struct flight_reservations *flight;
+    struct flight_reservations **flights; // the whole table, for workloads that spread an agency over many flights
+    int cpu; // core of the flight's group, -1 if not pinned
+};
+
+/**
+ * Represents a trace replay worker's arguments. Worker w replays the records of the agencies the
+ * partition gives it straight out of the mapped trace, in timestamp order, so that every agency's
+ * reservations are booked in the order the trace has them.
+ */
+struct replay_args {
+    unsigned int worker;
+    const struct trace *trace;
+    const struct trace_partition *partition;
+    struct flight_reservations **flights;
+    int paced; // sleep until each record's timestamp before booking it
+    double start; // when the replay started, in now_seconds() time
 };
 
 /**
@@ -69,58 +273,388 @@ struct flight_controller_args {
     int id;
     struct flight_reservations **flights;
     struct list *management_center;
+    const char *snapshot_path; // where to save the state between the phases, NULL to skip
+    struct matching_board *board; // posted as seat_board if an adaptive run picks p2p, NULL unless the run is adaptive
 };
 
 /**
  * Represents an airline's arguments that are passed to and used by airline threads
  */
 struct airline_args {
+    unsigned int flight_index; // position of the flight in the flights table
     struct flight_reservations *flight; // flight for which the company is responsible
+    struct flight_reservations **flights; // the whole table, for moving overflow directly to other flights
     struct list *management_center;
+    int cpu; // core of the flight's group, -1 if not pinned
 };
 
+/**
+ * Appends a reservation operation to the write-ahead log, if there is one. Called before the
+ * operation is applied, so that no effect a thread could have seen is missing from the log.
+ */
+static inline void log_reservation(enum wal_record_type type, unsigned int flight, struct Reservation reservation) {
+    if (reservation_log != NULL) {
+        wal_append(reservation_log, type, flight, reservation);
+    }
+}
+
+/**
+ * Records in the index where a reservation is about to be moved, if there is an index. This precedes the
+ * move, so a later move by the thread that takes it from there can't be overwritten with this location.
+ */
+static inline void index_reservation(enum reservation_place place, unsigned int flight, struct Reservation reservation) {
+    if (reservation_index != NULL) {
+        reservation_index_set(reservation_index, reservation.reservation_number, place, flight);
+    }
+}
+
+/**
+ * Waits at a barrier, putting the wait on the calling thread's timeline
+ * @param name The barrier's name on the timeline
+ */
+static void barrier_wait(pthread_barrier_t *barrier, const char *name) {
+    TIMELINE_BEGIN(waited);
+    pthread_barrier_wait(barrier);
+    TIMELINE_END(waited, TIMELINE_BARRIER, name, 0);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Books a reservation on a flight, in its stack unless the stack is full and in its queue otherwise.
+ */
+static void book_reservation(unsigned int flight_index, struct flight_reservations *flight,
+                             struct Reservation reservation) {
+    if (audit_slot != NULL) audit_begin(audit_slot);
+    // add to stack, unless it is (or concurrently became) full
+    int tried = 0, pushed = 0;
+    unsigned int size;
+    if (!isStackFull(flight->completed_reservations)) {
+        index_reservation(PLACE_STACK, flight_index, reservation);
+        log_reservation(WAL_PUSH, flight_index, reservation);
+        tried = 1;
+        pushed = pushSized(flight->completed_reservations, reservation, &size);
+    }
+    if (pushed) {
+        if (audit_slot != NULL) audit_count(audit_slot, AUDIT_PUSHED);
+        if (router != NULL) {
+            router_note_push(router, flight_index, size, flight->completed_reservations->capacity);
+        }
+    } else { // add reservation to queue if stack is full
+        if (pipelined) atomic_fetch_add_explicit(&outstanding_reservations, 1, memory_order_relaxed);
+        index_reservation(PLACE_QUEUE, flight_index, reservation);
+        // a logged push that found the stack full is undone by its own record
+        log_reservation(tried ? WAL_STACK_FULL : WAL_ENQUEUE, flight_index, reservation);
+        enqueue(flight->pending_reservations, reservation);
+        if (audit_slot != NULL) audit_count(audit_slot, AUDIT_ENQUEUED);
+    }
+    if (audit_slot != NULL) audit_end(audit_slot);
+}
+
+/**
+ * Phase 2 without the center. Inserter airlines post their waiting reservations on the board, under-full
+ * airlines reserve and post as many of their free seats as there are waiting reservations to cover, and
+ * inserter airlines claim blocks of those seats and move their pending reservations straight into them.
+ * @param airline_comp_args The airline's arguments
+ */
+static void redistribute_directly(struct airline_args *airline_comp_args) {
+    struct stack *completed_reservations = airline_comp_args->flight->completed_reservations;
+    struct queue *pending_reservations = airline_comp_args->flight->pending_reservations;
+
+    if (pending_reservations->size > 0) {
+        board_post_waiting(seat_board, airline_comp_args->flight_index, pending_reservations->size);
+        board_airline_ready(seat_board);
+
+        struct Reservation batch[P2P_BATCH];
+        while (pending_reservations->size > 0) {
+            unsigned int want = pending_reservations->size < P2P_BATCH ? pending_reservations->size : P2P_BATCH;
+            TIMELINE_BEGIN(block);
+            unsigned int target;
+            // start after our own flight so that inserters spread over different offers
+            unsigned int seats = board_claim_seats(seat_board, airline_comp_args->flight_index + 1, want, &target);
+            if (seats == 0) {
+                if (board_exhausted(seat_board, numOfAirlineCompanies)) break; // no seats left anywhere
+                sched_yield(); // under-full airlines haven't posted their seats yet
+                continue;
+            }
+
+            unsigned int count = 0;
+            while (count < seats) {
+                struct Reservation reservation = dequeue(pending_reservations);
+                if (reservation.reservation_number == -1) break;
+                batch[count++] = reservation;
+            }
+            if (count < seats) {
+                // give the seats we couldn't fill back to the board, they stay reserved until the controller
+                // withdraws them after phase 2
+                board_offer_seats(seat_board, target, seats - count);
+            }
+            for (unsigned int i = 0; i < count; i++) {
+                index_reservation(PLACE_STACK, target, batch[i]);
+                log_reservation(WAL_TO_STACK, target, batch[i]);
+            }
+            pushReservedBulk(airline_comp_args->flights[target]->completed_reservations, batch, count);
+            board_complete_transfer(seat_board, count);
+            TIMELINE_END(block, TIMELINE_BATCH, "p2p seat block", count);
+        }
+        // update shared variable for inserter airlines
+        atomic_fetch_sub_explicit(&number_of_inserter_airlines, 1, memory_order_release);
+    } else {
+        while (!isStackFull(completed_reservations)) {
+            unsigned int waiting;
+            // start after our own flight so that consumers spread over different inserters
+            unsigned int covered = board_cover_waiting(seat_board, airline_comp_args->flight_index + 1,
+                                                       completed_reservations->capacity, &waiting);
+            if (covered == 0) {
+                if (board_covered(seat_board)) break; // nothing is left waiting for seats
+                sched_yield(); // inserter airlines haven't posted their reservations yet
+                continue;
+            }
+            unsigned int seats = reserveSeats(completed_reservations, covered);
+            if (seats > 0) board_offer_seats(seat_board, airline_comp_args->flight_index, seats);
+            if (seats < covered) {
+                // out of free seats, so another airline has to cover the rest
+                board_uncover_waiting(seat_board, waiting, covered - seats);
+                break;
+            }
+        }
+        board_airline_ready(seat_board);
+    }
+}
+
+/**
+ * Backs off an idle pipelined airline, from yielding up to sleeping for a millisecond
+ * @param idle_rounds Consecutive rounds without work, reset by the caller when it finds some
+ */
+static void idle_backoff(unsigned int idle_rounds) {
+    if (idle_rounds < 16) {
+        sched_yield();
+    } else {
+        unsigned int shift = idle_rounds - 16 < 10 ? idle_rounds - 16 : 10;
+        struct timespec ts = {0, 1000L << shift}; // 1us doubling up to ~1ms
+        nanosleep(&ts, NULL);
+    }
+}
+
+/**
+ * Pipelined reservation management, which runs while the agencies are still booking. Every round the
+ * airline moves one reservation from its own queue to the center as soon as the queue is non-empty and,
+ * if its stack has room, one reservation from the center to its stack. In service mode it also releases
+ * one completed seat back to capacity. Roles can change during the run, since agencies may fill the
+ * stack or overflow into the queue at any time.
+ * The airline is done once the producers have finished, its own queue is empty and either its stack
+ * is full (outside service mode, where seats are never released) or no reservation is outstanding anywhere.
+ * @param airline_comp_args The airline's arguments
+ */
+static void manage_pipelined(struct airline_args *airline_comp_args) {
+    struct stack *completed_reservations = airline_comp_args->flight->completed_reservations;
+    struct queue *pending_reservations = airline_comp_args->flight->pending_reservations;
+    struct list *management_center = airline_comp_args->management_center;
+    struct service_counters *counters = service != NULL ? &service->airlines[airline_comp_args->flight_index] : NULL;
+    unsigned int idle_rounds = 0;
+
+    while (1) {
+        // read before looking at the structures, so that no reservation booked before it was set is missed
+        int done_producing = atomic_load_explicit(&producers_done, memory_order_acquire);
+        int worked = 0;
+
+        if (pending_reservations->size > 0) {
+            if (audit_slot != NULL) audit_begin(audit_slot);
+            struct Reservation reservation = dequeue(pending_reservations);
+            if (reservation.reservation_number != -1) {
+                index_reservation(PLACE_CENTER, airline_comp_args->flight_index, reservation);
+                log_reservation(WAL_TO_CENTER, airline_comp_args->flight_index, reservation);
+                insert(management_center, reservation);
+                if (audit_slot != NULL) audit_count(audit_slot, AUDIT_TO_CENTER);
+                worked = 1;
+            }
+            if (audit_slot != NULL) audit_end(audit_slot);
+        }
+
+        if (!isStackFull(completed_reservations) && !isListEmpty(management_center)) {
+            if (audit_slot != NULL) audit_begin(audit_slot);
+            struct Reservation reservation = deleteAndGet(management_center);
+            if (reservation.reservation_number != -1) {
+                index_reservation(PLACE_STACK, airline_comp_args->flight_index, reservation);
+                log_reservation(WAL_TO_STACK, airline_comp_args->flight_index, reservation);
+                if (push(completed_reservations, reservation)) {
+                    atomic_fetch_sub_explicit(&outstanding_reservations, 1, memory_order_release);
+                    if (audit_slot != NULL) audit_count(audit_slot, AUDIT_CENTER_TO_STACK);
+                } else {
+                    // the agencies filled the stack meanwhile, so it goes back through our own queue
+                    index_reservation(PLACE_QUEUE, airline_comp_args->flight_index, reservation);
+                    log_reservation(WAL_STACK_FULL, airline_comp_args->flight_index, reservation);
+                    enqueue(pending_reservations, reservation);
+                    if (audit_slot != NULL) audit_count(audit_slot, AUDIT_CENTER_TO_QUEUE);
+                }
+                worked = 1;
+            }
+            if (audit_slot != NULL) audit_end(audit_slot);
+        }
+
+        if (counters != NULL && completed_reservations->size > 0) {
+            if (audit_slot != NULL) audit_begin(audit_slot);
+            // the seat's flight departed, so it can be booked again
+            if (pop(completed_reservations).reservation_number != -1) {
+                service_note_release(counters);
+                if (audit_slot != NULL) audit_count(audit_slot, AUDIT_RELEASED);
+                worked = 1;
+            }
+            if (audit_slot != NULL) audit_end(audit_slot);
+        }
+
+        if (worked) {
+            idle_rounds = 0;
+            continue;
+        }
+        if (done_producing && pending_reservations->size == 0 &&
+            ((service == NULL && isStackFull(completed_reservations)) ||
+             atomic_load_explicit(&outstanding_reservations, memory_order_acquire) == 0)) {
+            break;
+        }
+        idle_backoff(idle_rounds++);
+    }
+}
+
 /**
  * The code to run when an airline company thread is spawned
  * @param args Must be of type (struct airline_args *)
  * @return NULL if the thread completed its execution successfully
  */
 void *airline_main(void *args) {
-    // guarantee that phase 2 starts after controller finishes phase 1 checks
-    pthread_barrier_wait(&barrier_start_2nd_phase);
     // cast back to args
     struct airline_args *airline_comp_args = (struct airline_args *) args;
-    if (airline_comp_args->flight->pending_reservations->size > 0) { // if company has reservations in queue
+    // run next to the agencies of the same flight
+    pin_current_thread(airline_comp_args->cpu);
+    // airlines come after the agencies' (or replay workers') slots
+    if (auditor != NULL) audit_slot = &auditor->slots[auditor->num_slots - numOfAirlineCompanies + airline_comp_args->flight_index];
+#ifdef LATENCY_HISTOGRAMS
+    latency_attach(&latencies, latencies.num_slots - numOfAirlineCompanies + airline_comp_args->flight_index,
+                   airline_comp_args->flight_index);
+#endif
+    if (contention != NULL) {
+        contention_attach(contention, contention->num_slots - numOfAirlineCompanies + airline_comp_args->flight_index,
+                          airline_comp_args->flight_index);
+    }
+    if (timeline != NULL) {
+        char name[32];
+        snprintf(name, sizeof(name), "airline %u", airline_comp_args->flight_index);
+        timeline_attach(timeline, timeline->num_slots - 1 - numOfAirlineCompanies + airline_comp_args->flight_index, name);
+    }
+    struct perf_thread perf;
+    if (pipelined) {
+        if (perf_counters != NULL) perf_thread_begin(&perf);
+        TIMELINE_BEGIN(managed);
+        manage_pipelined(airline_comp_args);
+        TIMELINE_END(managed, TIMELINE_WORK, "pipelined management", 0);
+        if (reservation_log != NULL) wal_flush_thread(reservation_log);
+        if (perf_counters != NULL) perf_thread_end(perf_counters, &perf, PERF_PHASE_2);
+        // signal to the controller that the final checks can start
+        barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
+        free(airline_comp_args);
+        return NULL;
+    }
+
+    // guarantee that phase 2 starts after controller finishes phase 1 checks
+    barrier_wait(&barrier_start_2nd_phase, "2nd phase barrier");
+    if (phase_1_failed) {
+        barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
+        free(airline_comp_args);
+        return NULL;
+    }
+    if (perf_counters != NULL) perf_thread_begin(&perf);
+    TIMELINE_BEGIN(redistributed);
+    uint32_t moved = 0;
+    if (seat_board != NULL) {
+        redistribute_directly(airline_comp_args);
+        TIMELINE_END(redistributed, TIMELINE_WORK, "p2p redistribution", 0);
+    } else if (airline_comp_args->flight->pending_reservations->size > 0) { // if company has reservations in queue
         // move reservations from pending queue to the reservation center
         struct queue *pending_reservations = airline_comp_args->flight->pending_reservations;
         while (pending_reservations->size > 0) {
             struct Reservation reservation = dequeue(pending_reservations);
             if (reservation.reservation_number != -1) {
+                index_reservation(PLACE_CENTER, airline_comp_args->flight_index, reservation);
+                log_reservation(WAL_TO_CENTER, airline_comp_args->flight_index, reservation);
                 insert(airline_comp_args->management_center, reservation);
+                moved++;
             }
         }
+        TIMELINE_END(redistributed, TIMELINE_DRAIN, "drain queue to center", moved);
         // update shared variable for inserter airlines
-        pthread_mutex_lock(&inserter_airlines_lock);
-        number_of_inserter_airlines--;
-        pthread_mutex_unlock(&inserter_airlines_lock);
+        atomic_fetch_sub_explicit(&number_of_inserter_airlines, 1, memory_order_release);
     } else if (!isStackFull(
             airline_comp_args->flight->completed_reservations)) { // if company has no pending reservations and has space on its stack
         struct stack *completed_reservations = airline_comp_args->flight->completed_reservations;
 
-        // reservation transfers should happen until the stack is either full or the center is empty and inserter == 0
+        // reservation transfers should happen until the stack is either full or the center is empty and inserter == 0.
+        // The counter is loaded before the center, so that an acquired 0 orders the emptiness check after the last insert.
         while (!isStackFull(completed_reservations) &&
-               (!isListEmpty(airline_comp_args->management_center) || number_of_inserter_airlines != 0)) {
+               (atomic_load_explicit(&number_of_inserter_airlines, memory_order_acquire) != 0 ||
+                !isListEmpty(airline_comp_args->management_center))) {
             // move reservation to the stack from the center
             struct Reservation reservation = deleteAndGet(airline_comp_args->management_center);
-            if (reservation.reservation_number != -1) push(completed_reservations, reservation);
+            if (reservation.reservation_number != -1) {
+                index_reservation(PLACE_STACK, airline_comp_args->flight_index, reservation);
+                log_reservation(WAL_TO_STACK, airline_comp_args->flight_index, reservation);
+                push(completed_reservations, reservation);
+                moved++;
+            }
         }
-
+        TIMELINE_END(redistributed, TIMELINE_DRAIN, "fill stack from center", moved);
     }
+    if (reservation_log != NULL) wal_flush_thread(reservation_log);
+    if (perf_counters != NULL) perf_thread_end(perf_counters, &perf, PERF_PHASE_2);
     // signal to the controller that checks can start if all airliners have reached this point
-    pthread_barrier_wait(&barrier_start_2nd_phase_checks);
+    barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
     free(airline_comp_args);
     return NULL;
 }
 
+/**
+ * Service mode booking loop of an agency. Reservation numbers keep the i*P + agency_id pattern of the
+ * batch run, so they're unique for the whole run, and an agency that runs out of them stops booking
+ * rather than wrapping around, since the center rejects a number it already holds. The agency holds off
+ * while the backlog of reservations waiting for a seat is at its limit, which keeps the memory of the run bounded.
+ */
+static void serve_bookings(struct agency_args *agency_args, struct workload_agency *generator,
+                           struct router_agency *routing) {
+    struct service_counters *counters = &service->agencies[agency_args->agency_id - 1];
+    reservation_number_t per_agency = (RESERVATION_NUMBER_MAX - numOfAgencies) / numOfAgencies;
+    reservation_number_t i = 0;
+
+    while (!service_stopped(service)) {
+        unsigned int idle_rounds = 0;
+        while (atomic_load_explicit(&outstanding_reservations, memory_order_relaxed) >= service->backlog_limit &&
+               !service_stopped(service)) {
+            idle_backoff(idle_rounds++);
+        }
+
+        if (i == per_agency) {
+            fprintf(stderr, "Agency %u: out of unique reservation numbers, stopping its bookings "
+                            "(build with LARGE_SCALE for 64-bit numbers)\n", agency_args->agency_id);
+            break;
+        }
+        struct Reservation reservation = {agency_args->agency_id, i * numOfAgencies + agency_args->agency_id};
+        i++;
+        unsigned int flight_index = agency_args->flight_index;
+        if (workload != NULL) {
+            workload_pace(workload, generator, agencies_start);
+            flight_index = workload_next_flight(workload, generator, agency_args->flight_index);
+        }
+        if (router != NULL) {
+            flight_index = router_choose(router, routing, flight_index);
+        }
+        double booking_start = now_seconds();
+        book_reservation(flight_index, agency_args->flights[flight_index], reservation);
+        service_note_booking(counters, (uint64_t) ((now_seconds() - booking_start) * 1e9));
+    }
+}
+
 /**
  * The code to run when an agency thread is spawned
  * @param args Must be of type (struct agency_args *)
@@ -128,27 +662,104 @@ void *airline_main(void *args) {
  */
 void *agency_main(void *args) {
     struct agency_args *agency_args = (struct agency_args *) args; // cast args back to struct ptr
-    // produce A reservations concurrently
-    for (unsigned int i = 0; i < numOfFlights; i++) {
+    pin_current_thread(agency_args->cpu);
+    if (auditor != NULL) audit_slot = &auditor->slots[agency_args->agency_id - 1];
+#ifdef LATENCY_HISTOGRAMS
+    latency_attach(&latencies, agency_args->agency_id - 1, agency_args->flight_index);
+#endif
+    if (contention != NULL) contention_attach(contention, agency_args->agency_id - 1, agency_args->flight_index);
+    if (timeline != NULL) {
+        char name[32];
+        snprintf(name, sizeof(name), "agency %u", agency_args->agency_id);
+        timeline_attach(timeline, agency_args->agency_id - 1, name);
+    }
+    struct perf_thread perf;
+    if (perf_counters != NULL) perf_thread_begin(&perf);
+    TIMELINE_BEGIN(booked);
+    struct workload_agency generator;
+    if (workload != NULL) workload_agency_init(workload, &generator, agency_args->agency_id);
+    struct router_agency routing;
+    if (router != NULL) router_agency_init(&routing, workloadSeed, agency_args->agency_id);
+
+    // produce A reservations concurrently, or keep producing until the service stops
+    if (service != NULL) serve_bookings(agency_args, &generator, &routing);
+    for (unsigned int i = 0; service == NULL && i < numOfFlights; i++) {
         struct Reservation *reservation = (struct Reservation *) malloc(sizeof(struct Reservation));
         reservation->agency_id = agency_args->agency_id;
-        reservation->reservation_number = (i * numOfAgencies) + agency_args->agency_id;
-        if (isStackFull(agency_args->flight->completed_reservations)) {  // add reservation to queue if stack is full
-            enqueue(agency_args->flight->pending_reservations, *reservation);
-        } else { // add to stack
-            push(agency_args->flight->completed_reservations, *reservation);
+        reservation->reservation_number = ((reservation_number_t) i * numOfAgencies) + agency_args->agency_id;
+        unsigned int flight_index = agency_args->flight_index;
+        if (workload != NULL) {
+            // wait for the agency's rate & burst phase, then let the workload pick the flight
+            workload_pace(workload, &generator, agencies_start);
+            flight_index = workload_next_flight(workload, &generator, agency_args->flight_index);
         }
+        if (router != NULL) {
+            flight_index = router_choose(router, &routing, flight_index);
+        }
+        book_reservation(flight_index, agency_args->flights[flight_index], *reservation);
         free(reservation);
     }
+    if (router != NULL) router_agency_finish(router, &routing);
+    TIMELINE_END(booked, TIMELINE_WORK, "bookings", service == NULL ? numOfFlights : 0);
+
+    // hand the remaining log records to the flusher instead of waiting for the latency bound
+    if (reservation_log != NULL) wal_flush_thread(reservation_log);
+    if (perf_counters != NULL) perf_thread_end(perf_counters, &perf, PERF_PHASE_1);
 
     // agency has finished importing flights, should wait for all others
-    pthread_barrier_wait(&barrier_start_1st_phase_checks);
+    barrier_wait(&barrier_start_1st_phase_checks, "1st phase checks barrier");
 
     // agency is done, free up memory
     free(agency_args);
     return NULL;
 }
 
+/**
+ * The code to run when a trace replay worker is spawned. Takes the place of the agencies in phase 1.
+ * @param args Must be of type (struct replay_args *)
+ * @return NULL if the thread completed its execution successfully
+ */
+void *replay_main(void *args) {
+    struct replay_args *replay_args = (struct replay_args *) args;
+    const struct trace_record *records = replay_args->trace->records;
+    const struct trace_partition *partition = replay_args->partition;
+    if (auditor != NULL) audit_slot = &auditor->slots[replay_args->worker];
+#ifdef LATENCY_HISTOGRAMS
+    latency_attach(&latencies, replay_args->worker, LATENCY_NO_FLIGHT); // a worker books on every flight
+#endif
+    if (contention != NULL) contention_attach(contention, replay_args->worker, CONTENTION_NO_FLIGHT);
+    if (timeline != NULL) {
+        char name[32];
+        snprintf(name, sizeof(name), "replay worker %u", replay_args->worker);
+        timeline_attach(timeline, replay_args->worker, name);
+    }
+    struct perf_thread perf;
+    if (perf_counters != NULL) perf_thread_begin(&perf);
+    TIMELINE_BEGIN(replayed);
+
+    // trace_open has already rejected every record this build can't book
+    for (uint64_t i = partition->offsets[replay_args->worker]; i < partition->offsets[replay_args->worker + 1]; i++) {
+        const struct trace_record *record = &records[partition->indices[i]];
+        if (replay_args->paced) {
+            double delay = replay_args->start + record->timestamp_ns / 1e9 - now_seconds();
+            if (delay > 0) {
+                struct timespec ts = {(time_t) delay, (long) ((delay - (time_t) delay) * 1e9)};
+                nanosleep(&ts, NULL);
+            }
+        }
+        struct Reservation reservation = {record->agency_id, (reservation_number_t) record->reservation_number};
+        book_reservation(record->flight, replay_args->flights[record->flight], reservation);
+    }
+    TIMELINE_END(replayed, TIMELINE_WORK, "replay", 0);
+
+    if (reservation_log != NULL) wal_flush_thread(reservation_log);
+    if (perf_counters != NULL) perf_thread_end(perf_counters, &perf, PERF_PHASE_1);
+    // worker has finished replaying its share, should wait for all others
+    barrier_wait(&barrier_start_1st_phase_checks, "1st phase checks barrier");
+    free(replay_args);
+    return NULL;
+}
+
 /**
  * Performs a stack overflow check for each given flight's completed
  * reservations.
@@ -174,6 +785,108 @@ int check_stack_overflow(struct flight_reservations **flights) {
     return 1;
 }
 
+/**
+ * Checks that no flight's stack still has seats reserved for transfers, i.e. that every seat
+ * reserved in phase 2 was either filled or released.
+ * @param flights An array of flights to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_reserved_seats(struct flight_reservations **flights) {
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        unsigned int reserved = flights[i]->completed_reservations->reserved;
+        if (reserved != 0) {
+            printf("Flight %d: %u seats are still reserved! Check failed\n", i, reserved);
+            return 0;
+        }
+    }
+    printf("Reserved seats check passed (none left)\n");
+    return 1;
+}
+
+/**
+ * Checks that every flight received exactly the reservations the workload generated for it.
+ * Only meaningful at the end of phase 1, since phase 2 moves reservations between flights.
+ * @param flights An array of flights to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_flight_distribution(struct flight_reservations **flights) {
+    unsigned int hottest = 0, coldest = 0;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        uint64_t found = (uint64_t) flights[i]->completed_reservations->size + flights[i]->pending_reservations->size;
+        if (found != expectedFlightReservations[i]) {
+            printf("Flight %u: distribution check failed (expected: %" PRIu64 ", found: %" PRIu64 ")\n", i,
+                   expectedFlightReservations[i], found);
+            return 0;
+        }
+        if (found > expectedFlightReservations[hottest]) hottest = i;
+        if (found < expectedFlightReservations[coldest]) coldest = i;
+    }
+    printf("Flight distribution check passed (hottest: flight %u with %" PRIu64 ", coldest: flight %u with %" PRIu64 ")\n",
+           hottest, expectedFlightReservations[hottest], coldest, expectedFlightReservations[coldest]);
+    return 1;
+}
+
+/**
+ * Reports how much phase 2 traffic through the center the router avoided. Every reservation
+ * left in a queue after phase 1 costs an insert and a deleteAndGet on the center in phase 2.
+ * @param flights An array of flights to check
+ */
+void report_routing(struct flight_reservations **flights) {
+    uint64_t overflow = 0;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        overflow += flights[i]->pending_reservations->size;
+    }
+    uint64_t flexible = atomic_load(&router->flexible);
+    uint64_t rerouted = atomic_load(&router->rerouted);
+    printf("Routing: %" PRIu64 " of %" PRIu64 " flexible reservations booked on their second choice\n", rerouted,
+           flexible);
+    printf("Routing: phase 1 overflow of %" PRIu64 " reservations (%" PRIu64 " without routing), %" PRId64
+           " center transfers avoided\n", overflow, overflowWithoutRouting, (int64_t) (overflowWithoutRouting - overflow));
+}
+
+/**
+ * Prints the count, range and mean of every flight's reservation numbers (stack and queue) and which
+ * agency booked most of them, computed with the vectorized kernels over exported chunks.
+ * @param flights An array of flights to report on
+ */
+void report_flight_stats(struct flight_reservations **flights) {
+    struct Reservation chunk[EXPORT_CHUNK];
+    unsigned int count;
+    uint64_t *histogram = malloc(sizeof(uint64_t) * numOfAgencies);
+    double start = now_seconds();
+    printf("\nPer-flight statistics (%s kernels)\n", reservation_stats_isa());
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        struct reservation_stats stats;
+        reservation_stats_init(&stats);
+        memset(histogram, 0, sizeof(uint64_t) * numOfAgencies);
+        struct reservation_cursor stackCursor = {0}, queueCursor = {0};
+        while ((count = exportStack(flights[i]->completed_reservations, &stackCursor, chunk, EXPORT_CHUNK)) > 0) {
+            reservation_stats_add(&stats, chunk, count);
+            agency_histogram_add(histogram, numOfAgencies, chunk, count);
+        }
+        while ((count = exportQueue(flights[i]->pending_reservations, &queueCursor, chunk, EXPORT_CHUNK)) > 0) {
+            reservation_stats_add(&stats, chunk, count);
+            agency_histogram_add(histogram, numOfAgencies, chunk, count);
+        }
+        if (stats.count == 0) {
+            printf("Flight %u: no reservations\n", i);
+            continue;
+        }
+
+        unsigned int agencies = 0, busiest = 0;
+        for (unsigned int agency = 0; agency < numOfAgencies; agency++) {
+            if (histogram[agency] > 0) agencies++;
+            if (histogram[agency] > histogram[busiest]) busiest = agency;
+        }
+        printf("Flight %u: %" PRIu64 " reservations, numbers %" PRI_RESERVATION "..%" PRI_RESERVATION
+               " (mean %.1f), from %u agencies (most from agency %u: %" PRIu64 ")\n",
+               i, stats.count, stats.min, stats.max, (double) stats.sum / stats.count, agencies, busiest + 1,
+               histogram[busiest]);
+    }
+    printf("Per-flight statistics took %.3f s\n", now_seconds() - start);
+    free(histogram);
+}
+
 /**
  * Performs a total size check for all given flights
  * by summing their completed & pending reservations.
@@ -181,19 +894,20 @@ int check_stack_overflow(struct flight_reservations **flights) {
  * @return 1 if successful, 0 otherwise
  */
 int check_total_size(struct flight_reservations **flights) {
-    unsigned int totalReservations = 0;
-    unsigned int expectedTotalReservations = pow(numOfFlights, 3);
+    uint64_t totalReservations = 0;
 
     for (unsigned int i = 0; i < numOfFlights; i++) {
         struct stack *completedReservations = flights[i]->completed_reservations;
         struct queue *pendingReservations = flights[i]->pending_reservations;
-        totalReservations += completedReservations->size + pendingReservations->size;
+        totalReservations += (uint64_t) completedReservations->size + pendingReservations->size;
     }
     int result = totalReservations == expectedTotalReservations;
     if (!result) {
-        printf("Total size check failed (expected: %d, found: %d)\n", expectedTotalReservations, totalReservations);
+        printf("Total size check failed (expected: %" PRIu64 ", found: %" PRIu64 ")\n", expectedTotalReservations,
+               totalReservations);
     } else {
-        printf("Total size check passed (expected: %d, found: %d)\n", expectedTotalReservations, totalReservations);
+        printf("Total size check passed (expected: %" PRIu64 ", found: %" PRIu64 ")\n", expectedTotalReservations,
+               totalReservations);
     }
     return result;
 }
@@ -205,56 +919,148 @@ int check_total_size(struct flight_reservations **flights) {
  * @return 1 if successful, 0 otherwise
  */
 int check_total_keysum(struct flight_reservations **flights) {
-    unsigned long totalKeySum = 0;
-    unsigned long expectedKeySum = (((pow(numOfFlights, 6)) + (pow(numOfFlights, 3))) / 2); // (A^6 + A^3) / 2
+    keysum_t totalKeySum = 0;
+#ifdef UNROLLED_NODES
+    // the checks run at barriers, so the blocks can be summed in place instead of copied out
+    struct reservation_span span;
+#else
+    // reservations are exported a chunk at a time under the locks and summed outside of them
+    struct Reservation chunk[EXPORT_CHUNK];
+    unsigned int count;
+#endif
     for (unsigned int i = 0; i < numOfFlights; i++) {
         struct stack *completedReservations = flights[i]->completed_reservations;
         struct queue *pendingReservations = flights[i]->pending_reservations;
 
-        // traverse the stack and sum the reservation numbers
-        struct stack_reservation *currentStackNode = completedReservations->top;
-        // lock to ensure thread safety
-        pthread_mutex_lock(&(completedReservations->top_lock));
-        while (currentStackNode != NULL) {
-            totalKeySum += currentStackNode->reservation.reservation_number;
-            currentStackNode = currentStackNode->next;
+        // sum the stack's reservation numbers with the vectorized kernel
+        struct reservation_stats stats;
+        reservation_stats_init(&stats);
+        struct reservation_cursor stackCursor = {0};
+#ifdef UNROLLED_NODES
+        while (nextStackSpan(completedReservations, &stackCursor, &span)) {
+            reservation_stats_add(&stats, span.reservations, span.count);
+        }
+#else
+        while ((count = exportStack(completedReservations, &stackCursor, chunk, EXPORT_CHUNK)) > 0) {
+            reservation_stats_add(&stats, chunk, count);
         }
-        pthread_mutex_unlock(&(completedReservations->top_lock));
+#endif
 
         if (isStackFull(
                 completedReservations)) { // traverse the queue if needed and sum the reservation numbers
-            // traverse queue
-
-            // acquire locks for thread safety
-            pthread_mutex_lock(&pendingReservations->head_lock);
-            pthread_mutex_lock(&pendingReservations->tail_lock);
-            struct queue_reservation *curr = pendingReservations->head->next; // get first node by skipping dummy node
-            while (curr != NULL) {
-                totalKeySum += curr->reservation.reservation_number;
-                curr = curr->next;
+            struct reservation_cursor queueCursor = {0};
+#ifdef UNROLLED_NODES
+            while (nextQueueSpan(pendingReservations, &queueCursor, &span)) {
+                reservation_stats_add(&stats, span.reservations, span.count);
             }
+#else
+            while ((count = exportQueue(pendingReservations, &queueCursor, chunk, EXPORT_CHUNK)) > 0) {
+                reservation_stats_add(&stats, chunk, count);
+            }
+#endif
 
             // update number of inserter airlines if the queue is not empty for this flight
             if (pendingReservations->size > 0) {
                 number_of_inserter_airlines += 1;
             }
+        }
+        totalKeySum += stats.sum;
+    }
 
-            // release locks
-            pthread_mutex_unlock(&pendingReservations->head_lock);
-            pthread_mutex_unlock(&pendingReservations->tail_lock);
+    int result = totalKeySum == expectedKeySum;
+    char expected[KEYSUM_STR_LEN], found[KEYSUM_STR_LEN];
+    format_keysum(expectedKeySum, expected);
+    format_keysum(totalKeySum, found);
+    if (!result) {
+        printf("Total keysum check failed (expected: %s, found %s)\n", expected, found);
+    } else {
+        printf("Total keysum check passed (expected: %s, found: %s)\n", expected, found);
+    }
+    return result;
+}
 
+/**
+ * Counts the airlines that will insert into the center in phase 2, i.e. those with a full stack and
+ * pending reservations. The keysum check does this while it walks the queues.
+ * @param flights An array of flights to check
+ */
+void count_inserter_airlines(struct flight_reservations **flights) {
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        if (isStackFull(flights[i]->completed_reservations) && flights[i]->pending_reservations->size > 0) {
+            number_of_inserter_airlines += 1;
         }
     }
+}
 
-    int result = totalKeySum == expectedKeySum;
+/**
+ * Performs an exactly-once check, verifying that the stacks, queues and center hold every
+ * reservation number in 1..N once, with no duplicates, strays or holes.
+ * @param flights An array of flights to check
+ * @param management_center The reservations center to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_exactly_once(struct flight_reservations **flights, struct list *management_center) {
+    struct exactly_once_result found;
+    double start = now_seconds();
+    if (!verify_exactly_once(flights, numOfFlights, management_center, expectedTotalReservations,
+                             verificationWorkers, &found)) {
+        printf("Exactly-once check failed (could not allocate a bitmap of %" PRIu64 " bits)\n",
+               expectedTotalReservations);
+        return 0;
+    }
+    double elapsed = now_seconds() - start;
+    uint64_t missing = expectedTotalReservations - found.distinct;
+    int result = found.duplicates == 0 && found.strays == 0 && missing == 0;
     if (!result) {
-        printf("Total keysum check failed (expected: %lu, found %lu)\n", expectedKeySum, totalKeySum);
+        printf("Exactly-once check failed (expected: 1..%" PRIu64 ", found: %" PRIu64 ", duplicates: %" PRIu64
+               ", out of range: %" PRIu64 ", missing: %" PRIu64 ")\n",
+               expectedTotalReservations, found.found, found.duplicates, found.strays, missing);
+        if (found.duplicates > 0) printf("First duplicate: %" PRI_RESERVATION "\n", found.first_duplicate);
+        if (missing > 0) printf("First missing: %" PRI_RESERVATION "\n", found.first_missing);
     } else {
-        printf("Total keysum check passed (expected: %lu, found: %lu)\n", expectedKeySum, totalKeySum);
+        printf("Exactly-once check passed (every reservation of 1..%" PRIu64 " found once, in %.3f s)\n",
+               expectedTotalReservations, elapsed);
     }
     return result;
 }
 
+/**
+ * Verifies the reservation numbers the flights hold, with the exactly-once check if enabled
+ * and with the keysum check otherwise
+ * @param flights An array of flights to check
+ * @param management_center The reservations center to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_reservation_numbers(struct flight_reservations **flights, struct list *management_center) {
+    if (!exactlyOnceVerification) {
+        return check_total_keysum(flights);
+    }
+    count_inserter_airlines(flights);
+    return check_exactly_once(flights, management_center);
+}
+
+/**
+ * Checks that every reservation booked by the service was either released or still holds a seat
+ * @param flights An array of flights to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_service_balance(struct flight_reservations **flights) {
+    uint64_t seated = 0;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        seated += flights[i]->completed_reservations->size;
+    }
+    uint64_t booked = service_total_booked(service);
+    uint64_t released = service_total_released(service);
+    if (booked != released + seated) {
+        printf("Service balance check failed (booked: %" PRIu64 ", released: %" PRIu64 ", seated: %" PRIu64 ")\n",
+               booked, released, seated);
+        return 0;
+    }
+    printf("Service balance check passed (booked: %" PRIu64 ", released: %" PRIu64 ", seated: %" PRIu64 ")\n",
+           booked, released, seated);
+    return 1;
+}
+
 /**
  * Performs a reservations completion check for all given flights and the
  * reservation management center by checking that all flight pending queues are empty
@@ -285,6 +1091,108 @@ int reservations_completion_check(struct flight_reservations **flights, struct l
     return result;
 }
 
+/**
+ * Looks up a chunk of a structure's reservations in the index
+ * @param place Where the chunk was exported from
+ * @param flight The flight whose stack or queue it was exported from
+ * @param wrong Incremented for every reservation the index doesn't locate there
+ * @param first_wrong Set to the first of those
+ */
+static void check_located(const struct Reservation *chunk, unsigned int count, enum reservation_place place,
+                          unsigned int flight, uint64_t *wrong, reservation_number_t *first_wrong) {
+    for (unsigned int i = 0; i < count; i++) {
+        struct reservation_location location;
+        if (!reservation_index_find(reservation_index, chunk[i].reservation_number, &location) ||
+            location.place != place || (place != PLACE_CENTER && location.flight != flight)) {
+            if ((*wrong)++ == 0) *first_wrong = chunk[i].reservation_number;
+        }
+    }
+}
+
+/**
+ * Performs an index check, looking up every reservation of the stacks, queues and center in the index and
+ * verifying that it's located where it was found, and that the index locates no other reservations.
+ * @param flights An array of flights to check
+ * @param management_center The reservations center to check
+ * @return 1 if successful, 0 otherwise
+ */
+int check_index(struct flight_reservations **flights, struct list *management_center) {
+    struct Reservation chunk[EXPORT_CHUNK];
+    unsigned int count;
+    uint64_t found = 0, wrong = 0;
+    reservation_number_t first_wrong = -1;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        struct reservation_cursor stackCursor = {0};
+        while ((count = exportStack(flights[i]->completed_reservations, &stackCursor, chunk, EXPORT_CHUNK)) > 0) {
+            check_located(chunk, count, PLACE_STACK, i, &wrong, &first_wrong);
+            found += count;
+        }
+        struct reservation_cursor queueCursor = {0};
+        while ((count = exportQueue(flights[i]->pending_reservations, &queueCursor, chunk, EXPORT_CHUNK)) > 0) {
+            check_located(chunk, count, PLACE_QUEUE, i, &wrong, &first_wrong);
+            found += count;
+        }
+    }
+    struct reservation_cursor centerCursor = {0};
+    while ((count = exportList(management_center, &centerCursor, chunk, EXPORT_CHUNK)) > 0) {
+        check_located(chunk, count, PLACE_CENTER, 0, &wrong, &first_wrong);
+        found += count;
+    }
+
+    struct reservation_index_stats stats;
+    reservation_index_stats(reservation_index, &stats);
+    if (wrong > 0 || stats.located != found) {
+        printf("Index check failed (found: %" PRIu64 ", located: %" PRIu64 ", misplaced: %" PRIu64 ")\n", found,
+               stats.located, wrong);
+        if (wrong > 0) printf("First misplaced: %" PRI_RESERVATION "\n", first_wrong);
+        return 0;
+    }
+    printf("Index check passed (%" PRIu64 " reservations located, %" PRIu64 " nodes, depth %u, %.1f MB)\n", found,
+           stats.nodes, stats.depth, (double) stats.bytes / (1024 * 1024));
+    return 1;
+}
+
+/**
+ * Prints where a reservation is according to the index, as a support ticket would ask for it
+ */
+void report_location(reservation_number_t reservation_number) {
+    struct reservation_location location;
+    if (!reservation_index_find(reservation_index, reservation_number, &location)) {
+        printf("Reservation %" PRI_RESERVATION " is not booked\n", reservation_number);
+    } else if (location.place == PLACE_CENTER) {
+        printf("Reservation %" PRI_RESERVATION " is in the management center\n", reservation_number);
+    } else {
+        printf("Reservation %" PRI_RESERVATION " is in the %s of flight %u\n", reservation_number,
+               reservation_place_name(location.place), location.flight);
+    }
+}
+
+/**
+ * Picks how an adaptive run redistributes in phase 2 from the contention of phase 1 and what is left to
+ * redistribute. Runs on the controller while the airlines wait at the phase 2 barrier, which publishes
+ * seat_board to them.
+ * @param controllerArgs The controller's arguments
+ */
+static void choose_redistribution(struct flight_controller_args *controllerArgs) {
+    TIMELINE_BEGIN(decided);
+    struct contention_counters phase_1[CONTENTION_STRUCTURES];
+    contention_totals(contention, phase_1);
+    struct phase_2_shape shape = {0, 0, 0};
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        unsigned int pending = controllerArgs->flights[i]->pending_reservations->size;
+        if (pending > 0) {
+            shape.inserters++;
+            shape.pending += pending;
+        } else if (!isStackFull(controllerArgs->flights[i]->completed_reservations)) {
+            shape.consumers++;
+        }
+    }
+    if (adaptive_decide(adaptive, phase_1, &shape) == REDISTRIBUTION_P2P) {
+        seat_board = controllerArgs->board;
+    }
+    TIMELINE_END(decided, TIMELINE_CHECK, "adaptive decision", 0);
+}
+
 /**
  * The code to run when the flight controller thread is spawned. This
  * thread is responsible for synchronising and performing checks for both phases.
@@ -292,106 +1200,643 @@ int reservations_completion_check(struct flight_reservations **flights, struct l
  * @return NULL if the thread completed its execution successfully
  */
 void *flight_controller_main(void *args) {
-    pthread_barrier_wait(&barrier_start_1st_phase_checks); // wait for agencies
+    if (timeline != NULL) timeline_attach(timeline, timeline->num_slots - 1, "controller");
+    // the service runs until its duration has elapsed, reporting meanwhile, and then stops the agencies
+    if (service != NULL) service_run(service, &outstanding_reservations);
+    barrier_wait(&barrier_start_1st_phase_checks, "1st phase checks barrier"); // wait for agencies
+    timings_end(&run_timings, RUN_PHASE_1);
     struct flight_controller_args *controllerArgs = (struct flight_controller_args *) args;// cast to controller args
+    struct perf_thread perf;
+
+    if (pipelined) {
+        // the airlines are already redistributing, so there is no consistent state to check until they finish
+        atomic_store_explicit(&producers_done, 1, memory_order_release);
+        barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
+        // every thread has handed off its records, the run isn't over until they are committed
+        wal_close(reservation_log);
+        timings_end(&run_timings, RUN_PHASE_2);
+        if (perf_counters != NULL) perf_thread_begin(&perf);
+        TIMELINE_BEGIN(checked);
+        printf(service != NULL ? "\nService stopped, checking the final state\n\n"
+                               : "Pipelined run finished, checking the final state\n\n");
+        // the service releases seats, so only its balance of booked & released reservations can be checked
+        if (!check_stack_overflow(controllerArgs->flights)
+            || (service != NULL && !check_service_balance(controllerArgs->flights))
+            || (service == NULL && !check_total_size(controllerArgs->flights))
+            || (service == NULL && !check_reservation_numbers(controllerArgs->flights, controllerArgs->management_center))
+            || !reservations_completion_check(controllerArgs->flights, controllerArgs->management_center)
+            || (reservation_index != NULL && !check_index(controllerArgs->flights, controllerArgs->management_center))) {
+            if (perf_counters != NULL) perf_thread_discard(&perf);
+            pthread_exit((void *) -1);
+        }
+        TIMELINE_END(checked, TIMELINE_CHECK, "final checks", 0);
+        if (flightStats) report_flight_stats(controllerArgs->flights);
+        if (locatedReservation != 0) report_location(locatedReservation);
+#ifdef LATENCY_HISTOGRAMS
+        latency_report(&latencies, service != NULL ? "Service" : "Pipelined run", numOfFlights);
+#endif
+        if (contention != NULL) {
+            contention_report(contention, service != NULL ? "Service" : "Pipelined run", numOfFlights);
+        }
+        if (perf_counters != NULL) {
+            perf_thread_end(perf_counters, &perf, PERF_CHECK_2);
+            perf_report(perf_counters, service != NULL ? service_total_booked(service) : expectedTotalReservations);
+        }
+        timings_end(&run_timings, RUN_CHECK_2);
+        free(controllerArgs);
+        return 0;
+    }
 
     // start phase A checks
+    if (perf_counters != NULL) perf_thread_begin(&perf);
+    TIMELINE_BEGIN(checked_1st);
     if (!check_stack_overflow(controllerArgs->flights)
+        || (expectedFlightReservations != NULL && router == NULL && !check_flight_distribution(controllerArgs->flights))
         || !check_total_size(controllerArgs->flights) ||
-        !check_total_keysum(controllerArgs->flights)) {
+        !check_reservation_numbers(controllerArgs->flights, controllerArgs->management_center)
+        || (reservation_index != NULL && !check_index(controllerArgs->flights, controllerArgs->management_center))) {
+        // let the airlines through both phase 2 barriers without any work, so that every thread can be joined
+        phase_1_failed = 1;
+        barrier_wait(&barrier_start_2nd_phase, "2nd phase barrier");
+        barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
+        if (perf_counters != NULL) perf_thread_discard(&perf);
         pthread_exit((void *) -1);
     }
 
     // --- all checks passed for phase 1 ---
+    TIMELINE_END(checked_1st, TIMELINE_CHECK, "phase 1 checks", 0);
 
+    if (router != NULL) report_routing(controllerArgs->flights);
+#ifdef LATENCY_HISTOGRAMS
+    latency_report(&latencies, "Phase 1", numOfFlights);
+#endif
+    // decided before the counters are cleared for phase 2
+    if (adaptive != NULL) choose_redistribution(controllerArgs);
+    if (seat_board != NULL) {
+        // the airlines that redistribute_directly treats as inserters, published by the phase 2 barrier
+        unsigned int inserters = 0;
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            if (controllerArgs->flights[i]->pending_reservations->size > 0) inserters++;
+        }
+        board_expect_inserters(seat_board, inserters);
+    }
+    if (contentionReports) {
+        contention_report(contention, "Phase 1", numOfFlights);
+    } else if (contention != NULL) {
+        contention_reset(contention);
+    }
+
+    // everyone is waiting at a barrier, so this is a consistent point to snapshot
+    if (controllerArgs->snapshot_path != NULL) {
+        TIMELINE_BEGIN(saved);
+        double start = now_seconds();
+        if (snapshot_save(controllerArgs->snapshot_path, controllerArgs->flights, numOfFlights,
+                          controllerArgs->management_center)) {
+            printf("Snapshot written to %s in %.3f s\n", controllerArgs->snapshot_path, now_seconds() - start);
+        } else {
+            printf("Could not write snapshot to %s\n", controllerArgs->snapshot_path);
+        }
+        TIMELINE_END(saved, TIMELINE_CHECK, "snapshot", 0);
+    }
+
+    if (perf_counters != NULL) perf_thread_end(perf_counters, &perf, PERF_CHECK_1);
     printf("\n---------- Phase Switch ----------\n\n");
+    timings_end(&run_timings, RUN_CHECK_1);
 
     // signal to companies to start phase 2
-    pthread_barrier_wait(&barrier_start_2nd_phase);
+    barrier_wait(&barrier_start_2nd_phase, "2nd phase barrier");
     // wait for companies to finish processing reservations before starting phase 2 checks
-    pthread_barrier_wait(&barrier_start_2nd_phase_checks);
+    barrier_wait(&barrier_start_2nd_phase_checks, "2nd phase checks barrier");
+    // every airline has handed off its records, phase 2 isn't over until they are committed
+    wal_close(reservation_log);
+    timings_end(&run_timings, RUN_PHASE_2);
+    if (perf_counters != NULL) perf_thread_begin(&perf);
+    TIMELINE_BEGIN(checked_2nd);
+    if (seat_board != NULL) {
+        // seats no inserter claimed are still reserved, so plain pushes couldn't take them after the run
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            releaseSeats(controllerArgs->flights[i]->completed_reservations, board_withdraw_seats(seat_board, i));
+        }
+    }
     // repeat phase A checks and phase B check
     // for the total size check we must subtract the number of reservations currently in the management center
     if (!check_stack_overflow(controllerArgs->flights)
+        || !check_reserved_seats(controllerArgs->flights)
         || !check_total_size(controllerArgs->flights) ||
-        !check_total_keysum(controllerArgs->flights)
-        || !reservations_completion_check(controllerArgs->flights, controllerArgs->management_center)) {
+        !check_reservation_numbers(controllerArgs->flights, controllerArgs->management_center)
+        || !reservations_completion_check(controllerArgs->flights, controllerArgs->management_center)
+        || (reservation_index != NULL && !check_index(controllerArgs->flights, controllerArgs->management_center))) {
+        if (perf_counters != NULL) perf_thread_discard(&perf);
         pthread_exit((void *) -1);
     }
 
     // --- all checks passed for phase 2 ---
+    TIMELINE_END(checked_2nd, TIMELINE_CHECK, "phase 2 checks", 0);
+
+    if (flightStats) report_flight_stats(controllerArgs->flights);
+    if (locatedReservation != 0) report_location(locatedReservation);
+#ifdef LATENCY_HISTOGRAMS
+    latency_report(&latencies, "Phase 2", numOfFlights);
+#endif
+    if (adaptive != NULL) {
+        struct contention_counters phase_2[CONTENTION_STRUCTURES];
+        contention_totals(contention, phase_2);
+        adaptive_review(adaptive, phase_2, timings_duration(&run_timings, RUN_PHASE_2));
+    }
+    if (contentionReports) contention_report(contention, "Phase 2", numOfFlights);
+    if (perf_counters != NULL) {
+        // the airlines added their phase 2 counts before the last barrier
+        perf_thread_end(perf_counters, &perf, PERF_CHECK_2);
+        perf_report(perf_counters, expectedTotalReservations);
+    }
+
+    if (seat_board != NULL) {
+        printf("P2P redistribution: %" PRIu64 " reservations moved in %" PRIu64 " seat blocks, none through the center\n",
+               (uint64_t) atomic_load(&seat_board->transferred), (uint64_t) atomic_load(&seat_board->blocks));
+    }
+    timings_end(&run_timings, RUN_CHECK_2);
 
     free(controllerArgs);
     return 0;
 }
 
+/**
+ * Adds what a restored flight's stack & queue hold to the index, before its airline can move any of it
+ */
+static void index_flight(unsigned int flight_index, struct flight_reservations *flight) {
+    struct Reservation chunk[EXPORT_CHUNK];
+    unsigned int count;
+    struct reservation_cursor stackCursor = {0};
+    while ((count = exportStack(flight->completed_reservations, &stackCursor, chunk, EXPORT_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) index_reservation(PLACE_STACK, flight_index, chunk[i]);
+    }
+    struct reservation_cursor queueCursor = {0};
+    while ((count = exportQueue(flight->pending_reservations, &queueCursor, chunk, EXPORT_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) index_reservation(PLACE_QUEUE, flight_index, chunk[i]);
+    }
+}
+
+/**
+ * Adds what the restored center holds to the index
+ */
+static void index_center(struct list *management_center) {
+    struct Reservation chunk[EXPORT_CHUNK];
+    unsigned int count;
+    struct reservation_cursor cursor = {0};
+    while ((count = exportList(management_center, &cursor, chunk, EXPORT_CHUNK)) > 0) {
+        for (unsigned int i = 0; i < count; i++) index_reservation(PLACE_CENTER, 0, chunk[i]);
+    }
+}
+
+/**
+ * Stack capacity of a flight, which depends on its position in the table. Computed in
+ * integers since a float can't represent (3/2)*A^2 exactly at large A.
+ */
+static unsigned int flight_capacity(unsigned int flight) {
+    unsigned long A = numOfFlights;
+    return (3ul * A * A) / 2 - (unsigned long) (numOfFlights - 1 - flight) * A;
+}
+
+/**
+ * Runs both phases of the sequential reference, checking it after each like the controller does
+ * @param capacities The stack capacity of every flight
+ * @return 1 if its checks passed, 0 otherwise
+ */
+static int run_reference(struct reference *reference, const unsigned int *capacities) {
+    if (!reference_init(reference, numOfFlights, capacities) || !reference_run_phase_1(reference, workload)) {
+        printf("Not enough memory for the sequential reference\n");
+        return 0;
+    }
+    if (!reference_check(reference, 0, expectedKeySum)) return 0;
+    if (!reference_run_phase_2(reference)) {
+        printf("Not enough memory for the sequential reference\n");
+        return 0;
+    }
+    return reference_check(reference, 1, expectedKeySum);
+}
+
+/**
+ * Runs the sequential reference after a batch run, reports the run's speedup over it and, where the
+ * final contents are well defined, uses it as an oracle for them
+ * @param flights The run's flights, which must be quiescent
+ * @param elapsed How long the run's phases took, in seconds
+ * @param threads How many threads the run had
+ * @return 1 if the reference passed its checks and agrees with the run, 0 otherwise
+ */
+static int compare_with_reference(struct flight_reservations **flights, double elapsed, unsigned int threads) {
+    unsigned int *capacities = malloc(sizeof(unsigned int) * numOfFlights);
+    if (capacities == NULL) {
+        printf("Not enough memory for the sequential reference\n");
+        return 0;
+    }
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        capacities[i] = flights[i]->completed_reservations->capacity;
+    }
+    struct reference reference;
+    printf("\n");
+    int passed = run_reference(&reference, capacities);
+    if (passed) {
+        double sequential = reference.phase_1_seconds + reference.phase_2_seconds;
+        // the run can't be more parallel than it has threads or CPUs
+        unsigned int cpus = timings_cpus();
+        unsigned int parallelism = cpus > 0 && cpus < threads ? cpus : threads;
+        double speedup = elapsed > 0 ? sequential / elapsed : 0;
+        printf("Sequential reference completed in %.3f ms (phase 1: %.3f ms, phase 2: %.3f ms)\n", sequential * 1e3,
+               reference.phase_1_seconds * 1e3, reference.phase_2_seconds * 1e3);
+        printf("Parallel speedup %.3fx over the reference, efficiency %.1f%% on %u CPUs\n", speedup,
+               100.0 * speedup / parallelism, parallelism);
+        if (pipelined || router != NULL) {
+            // reservations may go to any flight while the agencies still book, so no flight's contents are fixed
+            printf("Oracle: per-flight contents aren't compared for %s runs\n", pipelined ? "pipelined" : "p2c routed");
+        } else {
+            passed = reference_compare(&reference, flights);
+        }
+    }
+    reference_destroy(&reference);
+    free(capacities);
+    return passed;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc > 2) exit(-1);
+    struct run_options options;
+    if (!parse_options(argc, argv, &options)) exit(-1);
+    timings_start(&run_timings);
 
-    // read a physical number and convert to int
-    int A = atoi(argv[1]);
+    // a restart takes A and the whole phase 1 state from the snapshot, or from what the log rebuilds
+    struct snapshot snapshot;
+    const char *restored_path = options.restore_path != NULL ? options.restore_path : options.recover_path;
+    int restoring = restored_path != NULL;
+    if (options.restore_path != NULL) {
+        if (!snapshot_open(options.restore_path, &snapshot)) exit(-1);
+    } else if (options.recover_path != NULL) {
+        struct wal_recovery recovery;
+        double recovery_start = now_seconds();
+        if (!wal_recover(options.recover_path, &snapshot, &recovery)) exit(-1);
+        printf("Recovered %" PRIu64 " reservations (%" PRIu64 " on stacks, %" PRIu64 " pending) from %" PRIu64
+               " log records in %.3f s", recovery.reservations, recovery.stacked, recovery.pending, recovery.records,
+               now_seconds() - recovery_start);
+        if (recovery.ignored_bytes > 0) printf(", ignoring a torn tail of %" PRIu64 " bytes", recovery.ignored_bytes);
+        printf("\n");
+    }
+    if (restoring) {
+        if (options.numOfFlights != 0 && options.numOfFlights != snapshot.header->num_flights) {
+            fprintf(stderr, "%s holds %u flights, not %u\n", restored_path, snapshot.header->num_flights,
+                    options.numOfFlights);
+            exit(-1);
+        }
+        options.numOfFlights = snapshot.header->num_flights;
+    }
+
+    if (options.write_trace_path != NULL) {
+        // only write the synthetic trace of A flights, it can then be replayed with --replay
+        numOfFlights = options.numOfFlights;
+        unsigned int *capacities = malloc(sizeof(unsigned int) * numOfFlights);
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            capacities[i] = flight_capacity(i);
+        }
+        int written = trace_write_synthetic(options.write_trace_path, numOfFlights, capacities);
+        free(capacities);
+        exit(written ? 0 : -1);
+    }
+
+    // a replay takes A and the reservations of phase 1 from the trace
+    struct trace trace;
+    struct trace_partition replay_partition;
+    int replaying = options.replay_path != NULL;
+    if (replaying) {
+        if (!trace_open(options.replay_path, &trace)) exit(-1);
+        if (options.numOfFlights != 0 && options.numOfFlights != trace.header->num_flights) {
+            fprintf(stderr, "Trace %s holds %u flights, not %u\n", options.replay_path,
+                    trace.header->num_flights, options.numOfFlights);
+            exit(-1);
+        }
+        options.numOfFlights = trace.header->num_flights;
+    }
+
+    int A = options.numOfFlights;
+    if (!affinity_init(options.pin_policy)) {
+        fprintf(stderr, "Could not set up %s thread pinning, continuing unpinned\n", pin_policy_name(options.pin_policy));
+    }
 
     // declare the airline companies, flights and agency threads and set global vars
-    pthread_t airlineCompanies[A];
+    // these live on the heap since A^2 entries quickly exceed the main thread's stack at large A
     numOfFlights = A;
     numOfAirlineCompanies = A;
     numOfAgencies = A * A;
-    pthread_t agencies[numOfAgencies];
-    struct agency_args *agencyArguments[numOfAgencies];
-    struct flight_reservations *flights[A]; // reservation i belongs to airline with agency_id (i + 1)
+    // the threads that fill the flights in phase 1, either the agencies or the trace replay workers
+    unsigned int numOfProducers = numOfAgencies;
+    if (restoring) {
+        numOfProducers = 0;
+        snapshot_totals(&snapshot, &expectedTotalReservations, &expectedKeySum);
+    } else if (replaying) {
+        numOfProducers = options.replay_workers != 0 ? options.replay_workers : trace.header->num_agencies;
+        if (numOfProducers == 0) numOfProducers = 1;
+        if (!trace_partition(&trace, numOfProducers, &replay_partition)) exit(-1);
+        expectedTotalReservations = trace.header->record_count;
+        expectedKeySum = trace_keysum(&trace);
+    } else {
+        expectedTotalReservations = expected_total_size(numOfFlights);
+        expectedKeySum = expected_total_keysum(numOfFlights); // (A^6 + A^3) / 2
+    }
+    if (options.exactly_once) {
+        // the bitmap stands for 1..N, so it can only replace the keysum when that's what is expected
+        if (expectedKeySum == (keysum_t) expectedTotalReservations * (expectedTotalReservations + 1) / 2) {
+            exactlyOnceVerification = 1;
+            verificationWorkers = options.verification_workers;
+        } else {
+            printf("Reservations aren't numbered 1..%" PRIu64 ", verifying them with the keysum instead\n\n",
+                   expectedTotalReservations);
+        }
+    }
+    flightStats = options.flight_stats;
+    workloadSeed = options.workload.seed;
+    struct workload agency_workload;
+    if (options.use_workload && !restoring && !replaying) {
+        if (!workload_init(&agency_workload, &options.workload, numOfFlights)) exit(-1);
+        workload = &agency_workload;
+        // the generators are deterministic, so the controller can replay them to know what each flight should get.
+        // Reservation numbers are still i*P + agency_id, which keeps the total size & keysum unchanged.
+        expectedFlightReservations = malloc(sizeof(uint64_t) * numOfFlights);
+        if (!workload_expected_counts(workload, numOfAgencies, numOfFlights, expectedFlightReservations)) exit(-1);
+        expectedTotalReservations = 0;
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            expectedTotalReservations += expectedFlightReservations[i];
+        }
+    }
+    if (options.sequential) {
+        // only the single-threaded baseline, no threads or concurrent structures at all
+        if (restoring || replaying || options.service_seconds > 0) {
+            fprintf(stderr, "The sequential reference only runs the synthetic batch workload\n");
+            exit(-1);
+        }
+        unsigned int *capacities = malloc(sizeof(unsigned int) * numOfFlights);
+        if (capacities == NULL) {
+            printf("Not enough memory for the sequential reference\n");
+            exit(-1);
+        }
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            capacities[i] = flight_capacity(i);
+        }
+        struct reference reference;
+        int passed = run_reference(&reference, capacities);
+        if (passed) {
+            double elapsed = reference.phase_1_seconds + reference.phase_2_seconds;
+            printf("Sequential run completed in %.3f ms (%.0f reservations/s)\n", elapsed * 1e3,
+                   (double) expectedTotalReservations / elapsed);
+        }
+        reference_destroy(&reference);
+        free(capacities);
+        if (workload != NULL) {
+            workload_destroy(workload);
+            free(expectedFlightReservations);
+        }
+        exit(passed ? 0 : -1);
+    }
+    pthread_t *airlineCompanies = malloc(sizeof(pthread_t) * numOfAirlineCompanies);
+    pthread_t *agencies = malloc(sizeof(pthread_t) * numOfProducers);
+    // reservation i belongs to airline with agency_id (i + 1)
+    struct flights_table flights_table;
+    if (!createFlightsTable(&flights_table, numOfFlights)) {
+        exit(-1);
+    }
+    struct flight_reservations **flights = flights_table.flights;
 
     // init controller barrier for phase 1 checks
-    pthread_barrier_init(&barrier_start_1st_phase_checks, NULL, numOfAgencies + 1); // Π agencies plus the controller
+    // Π agencies (or replay workers) plus the controller, or just the controller when phase 1 is restored from a snapshot
+    pthread_barrier_init(&barrier_start_1st_phase_checks, NULL, numOfProducers + 1);
     // init phase 2 barrier for airline companies and the controller
     pthread_barrier_init(&barrier_start_2nd_phase, NULL, numOfAirlineCompanies + 1);
     // init controller barrier for phase 2 checks
     // airline companies will wait before termination at this barrier and the controller can proceed with the checks after waiting on this barrier
     pthread_barrier_init(&barrier_start_2nd_phase_checks, NULL, numOfAirlineCompanies + 1);
 
-    // init inserter airlines lock
-    pthread_mutex_init(&inserter_airlines_lock, NULL);
+    if (options.wal_path != NULL) {
+        // stored in the log, so that a recovery can size the flights without knowing the run's options
+        unsigned int *capacities = malloc(sizeof(unsigned int) * numOfFlights);
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            capacities[i] = restoring ? snapshot_flight_capacity(&snapshot, i)
+                                      : replaying ? trace_flight_capacity(&trace, i) : flight_capacity(i);
+        }
+        reservation_log = wal_open(options.wal_path, options.wal_batch, options.wal_latency_us, numOfFlights, capacities);
+        free(capacities);
+        if (reservation_log == NULL) exit(-1);
+    }
+    double start = now_seconds();
+    timings_end(&run_timings, RUN_SETUP);
+
+    pipelined = options.pipelined;
+    struct service run_service;
+    if (options.service_seconds > 0) {
+        // by default as many reservations may wait for a seat as a whole batch run books
+        uint64_t backlog_limit = options.backlog_limit > 0 ? options.backlog_limit : (uint64_t) numOfAgencies * numOfFlights;
+        if (!service_init(&run_service, options.service_seconds, options.report_interval_ms, backlog_limit,
+                          numOfAgencies, numOfAirlineCompanies)) {
+            exit(-1);
+        }
+        service = &run_service;
+    }
+    atomic_init(&outstanding_reservations, 0);
+    atomic_init(&producers_done, 0);
+
+    struct matching_board board;
+    if (options.p2p_redistribution || options.adaptive_redistribution) {
+        if (!board_init(&board, numOfFlights)) exit(-1);
+        if (options.p2p_redistribution) seat_board = &board;
+    }
+    struct adaptive run_adaptive;
+    if (options.adaptive_redistribution) {
+        adaptive_init(&run_adaptive, options.adaptive_threshold);
+        adaptive = &run_adaptive;
+    }
 
     // create reservation management center
     struct list *management_center = create_list();
 
-    for (int i = 0; i < A * A; i++) {
-        if (i < A) {
-            // init flight reservations table
-            flights[i] = (struct flight_reservations *) malloc(sizeof(struct flight_reservations));
-            // stack capacity depends on the flight's position in the table
-            unsigned int capacity = 1.5f * (A * A) - (A - 1 - i) * A;
-            flights[i]->completed_reservations = createStack(capacity);
-            flights[i]->pending_reservations = createQueue();
+    struct auditor run_auditor;
+    if (options.audit_interval_ms > 0) {
+        if (!auditor_init(&run_auditor, numOfProducers + numOfAirlineCompanies, flights, numOfFlights,
+                          management_center, options.audit_interval_ms)) {
+            exit(-1);
+        }
+        auditor = &run_auditor;
+    }
+#ifdef LATENCY_HISTOGRAMS
+    if (!latency_init(&latencies, numOfProducers + numOfAirlineCompanies)) {
+        exit(-1);
+    }
+#endif
+    struct contention_recorders run_contention;
+    // adaptive runs decide from the counters, even if they aren't reported
+    if (options.contention || adaptive != NULL) {
+        if (!contention_init(&run_contention, numOfProducers + numOfAirlineCompanies)) {
+            exit(-1);
+        }
+        contention = &run_contention;
+        contentionReports = options.contention;
+    }
+    struct reservation_index run_index;
+    if (options.index_reservations) {
+        if (!reservation_index_init(&run_index, expectedTotalReservations)) {
+            exit(-1);
+        }
+        reservation_index = &run_index;
+        locatedReservation = (reservation_number_t) options.locate_reservation;
+    }
+    struct perf_counters run_perf_counters;
+    if (options.perf_counters) {
+        // the threads of both phases, and the controller, count at once in pipelined runs
+        perf_init(&run_perf_counters, numOfProducers + numOfAirlineCompanies + 1);
+        perf_counters = &run_perf_counters;
+    }
+    struct timeline run_timeline;
+    if (options.timeline_path != NULL) {
+        // a ring per agency (or replay worker) and airline, and the controller's last
+        if (!timeline_init(&run_timeline, numOfProducers + numOfAirlineCompanies + 1, options.timeline_events,
+                           (uint64_t) options.timeline_lock_us * 1000)) {
+            exit(-1);
+        }
+        timeline = &run_timeline;
+    }
 
-            // init airline companies
-            struct airline_args *airline_comp_args = (struct airline_args *) malloc(sizeof(struct airline_args));
-            airline_comp_args->flight = flights[i];
-            airline_comp_args->management_center = management_center;
-            pthread_create(&(airlineCompanies[i]), NULL, airline_main, airline_comp_args);
+    if (restoring) {
+        // before any airline starts, so that the index holds the center before it can be moved out of it
+        snapshot_restore_center(&snapshot, management_center);
+        if (reservation_index != NULL) index_center(management_center);
+    }
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        // allocate the flight's stack & queue headers from the group's core, so that they are first touched
+        // (and placed in memory) where its agencies and airline will run. Their nodes are malloc'd later by
+        // the pushing threads, so routed reservations and peer-to-peer transfers land wherever those run.
+        pin_current_thread(affinity_cpu_for_flight(i));
+        unsigned int capacity = restoring ? snapshot_flight_capacity(&snapshot, i)
+                                : replaying ? trace_flight_capacity(&trace, i) : flight_capacity(i);
+        // init flight reservations table
+        if (createFlight(&flights_table, i, capacity) == NULL) {
+            exit(-1);
+        }
+        if (restoring) {
+            snapshot_restore_flight(&snapshot, i, flights[i]);
+            if (reservation_index != NULL) index_flight(i, flights[i]);
+        }
+
+        // init airline companies
+        struct airline_args *airline_comp_args = (struct airline_args *) malloc(sizeof(struct airline_args));
+        airline_comp_args->flight_index = i;
+        airline_comp_args->flight = flights[i];
+        airline_comp_args->flights = flights;
+        airline_comp_args->management_center = management_center;
+        airline_comp_args->cpu = affinity_cpu_for_flight(i);
+        pthread_create(&(airlineCompanies[i]), NULL, airline_main, airline_comp_args);
+    }
+    unpin_current_thread();
+
+    struct router flight_router;
+    if (options.p2c_routing) {
+        unsigned int *capacities = malloc(sizeof(unsigned int) * numOfFlights);
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            capacities[i] = flights[i]->completed_reservations->capacity;
+            // without routing every flight gets its own share, A^2 under the fixed mapping
+            uint64_t share = expectedFlightReservations != NULL ? expectedFlightReservations[i] : numOfAgencies;
+            if (share > capacities[i]) overflowWithoutRouting += share - capacities[i];
+        }
+        if (!router_init(&flight_router, numOfFlights, capacities, options.flexible_fraction)) exit(-1);
+        router = &flight_router;
+        free(capacities);
+    }
+
+    if (restoring) {
+        snapshot_close(&snapshot);
+        printf("Restored phase 1 state from %s in %.3f s\n\n", restored_path, now_seconds() - start);
+    } else if (replaying) {
+        double replay_start = now_seconds();
+        for (unsigned int i = 0; i < numOfProducers; i++) {
+            // init replay workers, each streams the records of its agencies out of the mapped trace
+            struct replay_args *replay_args = malloc(sizeof(struct replay_args));
+            replay_args->worker = i;
+            replay_args->trace = &trace;
+            replay_args->partition = &replay_partition;
+            replay_args->flights = flights;
+            replay_args->paced = options.replay_paced;
+            replay_args->start = replay_start;
+            pthread_create(&(agencies[i]), NULL, replay_main, replay_args);
+        }
+    } else {
+        agencies_start = now_seconds();
+        for (unsigned int i = 0; i < numOfAgencies; i++) {
+            // init agencies
+            struct agency_args *agency_args = malloc(sizeof(struct agency_args));
+            agency_args->agency_id = i + 1;
+            agency_args->flight_index = i % numOfFlights;
+            agency_args->flight = flights[i % numOfFlights]; // the flight for whose reservations the agency is responsible
+            agency_args->flights = flights;
+            agency_args->cpu = affinity_cpu_for_flight(i % numOfFlights);
+            pthread_create(&(agencies[i]), NULL, agency_main, agency_args);
         }
-        // init agencies
-        agencyArguments[i] = malloc(sizeof(struct agency_args));
-        agencyArguments[i]->agency_id = i + 1;
-        agencyArguments[i]->flight = flights[i % A]; // the flight for whose reservations the agency is responsible
-        pthread_create(&(agencies[i]), NULL, agency_main, agencyArguments[i]);
     }
 
 
+    // every flight exists by now, so the auditor can start looking at them
+    if (auditor != NULL && !auditor_start(auditor)) exit(-1);
+
     // init the flight controller
     struct flight_controller_args *controllerArgs = malloc(sizeof(struct flight_controller_args));
     controllerArgs->id = 0;
     controllerArgs->flights = flights;
     controllerArgs->management_center = management_center;
+    controllerArgs->snapshot_path = options.snapshot_path;
+    controllerArgs->board = adaptive != NULL ? &board : NULL;
     pthread_create(&flight_controller, NULL, flight_controller_main, controllerArgs);
 
     // wait for agencies, airlines and controller threads to finish
-    for (unsigned int i = 0; i < numOfAgencies; i++) {
+    for (unsigned int i = 0; i < numOfProducers; i++) {
         pthread_join(agencies[i], NULL);
     }
+    if (replaying) {
+        trace_partition_destroy(&replay_partition);
+        trace_close(&trace);
+    }
     for (unsigned int i = 0; i < numOfAirlineCompanies; i++) {
         pthread_join(airlineCompanies[i], NULL);
     }
-    pthread_join(flight_controller, NULL);
+    void *controller_result;
+    pthread_join(flight_controller, &controller_result);
+    // stopped after the controller, so that its exact final audit is reported next to the controller's checks
+    int audit_passed = 1;
+    if (auditor != NULL) {
+        audit_passed = auditor_stop(auditor);
+        printf(audit_passed ? "Online audit check passed\n" : "Online audit check failed\n");
+    }
+
+    // the controller commits the log once phase 2 ends, unless it stopped before then
+    wal_close(reservation_log);
+    uint64_t booked_reservations = service != NULL ? service_total_booked(service) : expectedTotalReservations;
+    if (service != NULL) {
+        service_print_summary(service, now_seconds() - start);
+    } else {
+        // the same interval as the timings record, so durable and in-memory runs compare directly
+        double elapsed = timings_run_seconds(&run_timings);
+        printf("Run completed in %.3f s (%.0f reservations/s%s)\n", elapsed,
+               elapsed > 0 ? (double) booked_reservations / elapsed : 0, reservation_log != NULL ? ", durable" : "");
+    }
+    if (reservation_log != NULL) {
+        wal_print_stats(reservation_log);
+        wal_destroy(reservation_log);
+    }
+    if (timeline != NULL && !timeline_write(timeline, options.timeline_path)) {
+        printf("Could not write the timeline to %s\n", options.timeline_path);
+    }
+    int reference_passed = 1;
+    if (options.reference) {
+        if (service != NULL || restoring || replaying) {
+            printf("The sequential reference only models the synthetic batch run, skipping it\n");
+        } else if (controller_result != NULL) {
+            printf("The checks failed, skipping the sequential reference\n");
+        } else {
+            reference_passed = compare_with_reference(flights, timings_duration(&run_timings, RUN_PHASE_1) +
+                                                               timings_duration(&run_timings, RUN_PHASE_2),
+                                                      numOfProducers + numOfAirlineCompanies);
+        }
+    }
 
     // ---------- Memory de-allocation & cleanup ----------
 
@@ -399,13 +1844,56 @@ int main(int argc, char *argv[]) {
     pthread_barrier_destroy(&barrier_start_1st_phase_checks);
     pthread_barrier_destroy(&barrier_start_2nd_phase);
     pthread_barrier_destroy(&barrier_start_2nd_phase_checks);
-    pthread_mutex_destroy(&inserter_airlines_lock);
 
     // free memory for flight stacks, queues and the flight itself
-    for (int i = 0; i < numOfFlights; i++) {
-        destroyStack(flights[i]->completed_reservations);
-        destroyQueue(flights[i]->pending_reservations);
-        free(flights[i]);
-    }
+    destroyFlightsTable(&flights_table);
     destroyList(management_center);
+    free(agencies);
+    free(airlineCompanies);
+    if (workload != NULL) {
+        workload_destroy(workload);
+        free(expectedFlightReservations);
+    }
+    if (router != NULL) router_destroy(router);
+    if (options.p2p_redistribution || adaptive != NULL) board_destroy(&board);
+    if (service != NULL) service_destroy(service);
+    if (auditor != NULL) auditor_destroy(auditor);
+#ifdef LATENCY_HISTOGRAMS
+    latency_destroy(&latencies);
+#endif
+    if (contention != NULL) contention_destroy(contention);
+    if (timeline != NULL) timeline_destroy(timeline);
+    if (reservation_index != NULL) reservation_index_destroy(reservation_index);
+    affinity_destroy();
+    timings_end(&run_timings, RUN_TEARDOWN);
+
+    if (options.timings_path != NULL) {
+        struct run_record record;
+        record.num_flights = numOfFlights;
+        record.agencies = numOfProducers;
+        record.airlines = numOfAirlineCompanies;
+        record.backend = service != NULL ? "service" : pipelined ? "pipelined"
+                         : adaptive != NULL ? (seat_board != NULL ? "adaptive-p2p" : "adaptive-center")
+                         : options.p2p_redistribution ? "p2p" : "center";
+        record.routing = options.p2c_routing ? "p2c" : "home";
+        record.durable = reservation_log != NULL;
+        record.workload = replaying ? "replay" : options.recover_path != NULL ? "recover" : restoring ? "restore"
+                          : options.workload.distribution == FLIGHTS_ZIPF ? "zipf" : "fixed";
+#if defined(CACHE_LAYOUT) && defined(UNROLLED_NODES)
+        record.layout = "cache+unrolled";
+#elif defined(CACHE_LAYOUT)
+        record.layout = "cache";
+#elif defined(UNROLLED_NODES)
+        record.layout = "unrolled";
+#else
+        record.layout = "default";
+#endif
+        record.reservations = booked_reservations;
+        record.checks_passed = controller_result == NULL && audit_passed && reference_passed;
+        if (!timings_append(options.timings_path, &record, &run_timings)) {
+            fprintf(stderr, "Could not append the timings to %s\n", options.timings_path);
+        }
+    }
+    // a failed check fails the run, e.g. for scripts running it
+    return controller_result == NULL && audit_passed && reference_passed ? 0 : -1;
 }
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "matching_board.h"
+#include "../contention/contention.h"
+#include <stdlib.h>
+
+int board_init(struct matching_board *board, unsigned int numOfFlights) {
+    board->num_flights = numOfFlights;
+    board->offers = aligned_alloc(_Alignof(struct seat_offer), sizeof(struct seat_offer) * numOfFlights);
+    if (board->offers == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        atomic_init(&board->offers[i].seats, 0);
+        atomic_init(&board->offers[i].waiting, 0);
+    }
+    board->inserters = 0;
+    atomic_init(&board->posted_inserters, 0);
+    atomic_init(&board->ready_airlines, 0);
+    atomic_init(&board->blocks, 0);
+    atomic_init(&board->transferred, 0);
+    return 1;
+}
+
+void board_expect_inserters(struct matching_board *board, unsigned int inserters) {
+    board->inserters = inserters;
+}
+
+void board_post_waiting(struct matching_board *board, unsigned int flight, unsigned int count) {
+    atomic_fetch_add_explicit(&board->offers[flight].waiting, count, memory_order_relaxed);
+    // released after the count, so that a consumer that sees every inserter posted sees all the counts
+    atomic_fetch_add_explicit(&board->posted_inserters, 1, memory_order_release);
+}
+
+unsigned int board_cover_waiting(struct matching_board *board, unsigned int start, unsigned int max,
+                                 unsigned int *flight) {
+    for (unsigned int n = 0; n < board->num_flights; n++) {
+        unsigned int i = (start + n) % board->num_flights;
+        unsigned int waiting = atomic_load_explicit(&board->offers[i].waiting, memory_order_relaxed);
+        while (waiting > 0) {
+            unsigned int take = waiting < max ? waiting : max;
+            // on failure waiting is reloaded with the current count and the cover is retried
+            if (atomic_compare_exchange_weak_explicit(&board->offers[i].waiting, &waiting, waiting - take,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *flight = i;
+                return take;
+            }
+            CONTENTION_COUNT(CONTENTION_BOARD, retries);
+        }
+    }
+    return 0;
+}
+
+void board_uncover_waiting(struct matching_board *board, unsigned int flight, unsigned int count) {
+    atomic_fetch_add_explicit(&board->offers[flight].waiting, count, memory_order_relaxed);
+}
+
+int board_covered(struct matching_board *board) {
+    if (atomic_load_explicit(&board->posted_inserters, memory_order_acquire) < board->inserters) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < board->num_flights; i++) {
+        if (atomic_load_explicit(&board->offers[i].waiting, memory_order_relaxed) > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void board_offer_seats(struct matching_board *board, unsigned int flight, unsigned int seats) {
+    atomic_fetch_add_explicit(&board->offers[flight].seats, seats, memory_order_release);
+}
+
+void board_airline_ready(struct matching_board *board) {
+    atomic_fetch_add_explicit(&board->ready_airlines, 1, memory_order_release);
+}
+
+unsigned int board_claim_seats(struct matching_board *board, unsigned int start, unsigned int want,
+                               unsigned int *flight) {
+    for (unsigned int n = 0; n < board->num_flights; n++) {
+        unsigned int i = (start + n) % board->num_flights;
+        unsigned int seats = atomic_load_explicit(&board->offers[i].seats, memory_order_acquire);
+        while (seats > 0) {
+            unsigned int take = seats < want ? seats : want;
+            // on failure seats is reloaded with the current offer and the claim is retried
+            if (atomic_compare_exchange_weak_explicit(&board->offers[i].seats, &seats, seats - take,
+                                                      memory_order_acq_rel, memory_order_acquire)) {
+                atomic_fetch_add_explicit(&board->blocks, 1, memory_order_relaxed);
+                *flight = i;
+                return take;
+            }
+            CONTENTION_COUNT(CONTENTION_BOARD, retries);
+        }
+    }
+    return 0;
+}
+
+void board_complete_transfer(struct matching_board *board, unsigned int count) {
+    atomic_fetch_add_explicit(&board->transferred, count, memory_order_relaxed);
+}
+
+unsigned int board_withdraw_seats(struct matching_board *board, unsigned int flight) {
+    return atomic_exchange_explicit(&board->offers[flight].seats, 0, memory_order_acq_rel);
+}
+
+int board_exhausted(struct matching_board *board, unsigned int numOfAirlines) {
+    if (atomic_load_explicit(&board->ready_airlines, memory_order_acquire) < numOfAirlines) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < board->num_flights; i++) {
+        if (atomic_load_explicit(&board->offers[i].seats, memory_order_acquire) > 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void board_destroy(struct matching_board *board) {
+    free(board->offers);
+    board->offers = NULL;
+}
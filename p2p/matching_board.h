@@ -0,0 +1,110 @@
+#ifndef HY486_PROJECT_MATCHING_BOARD_H
+#define HY486_PROJECT_MATCHING_BOARD_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Seats a flight has reserved on its stack and offers to inserter airlines, and the reservations
+ * waiting in its queue that no offered seat covers yet. Padded so that claims on different flights
+ * don't false-share.
+ */
+struct seat_offer {
+    _Alignas(64) atomic_uint seats;
+    atomic_uint waiting;
+};
+
+/**
+ * @brief A lock-free board that matches overflow reservations with free seats in phase 2.
+ *
+ * Inserter airlines post how many reservations are waiting in their pending queue. Under-full
+ * airlines cover waiting reservations with a CAS, reserve that many free seats on their own stack
+ * and post them as an offer, so no more seats are reserved than there are reservations to fill
+ * them; they stop once their stack is full or every inserter has posted and nothing is left to
+ * cover. Inserter airlines claim blocks of seats from the offers with a CAS and move reservations
+ * from their pending queue straight into the claimed seats, bypassing the management center.
+ */
+struct matching_board {
+    unsigned int num_flights;
+    struct seat_offer *offers;
+    unsigned int inserters; // airlines that will post waiting reservations, set before phase 2
+    atomic_uint posted_inserters;
+    atomic_uint ready_airlines; // airlines that have posted all they are going to post
+    atomic_uint_fast64_t blocks; // successful claims
+    atomic_uint_fast64_t transferred; // reservations moved through the board
+};
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int board_init(struct matching_board *board, unsigned int numOfFlights);
+
+/**
+ * Sets how many inserter airlines will post waiting reservations. Called by the controller before
+ * the phase 2 barrier, which publishes it to the airlines.
+ */
+void board_expect_inserters(struct matching_board *board, unsigned int inserters);
+
+/**
+ * Posts the reservations waiting in the given inserter flight's queue. Called once per inserter.
+ */
+void board_post_waiting(struct matching_board *board, unsigned int flight, unsigned int count);
+
+/**
+ * Covers up to max waiting reservations of a single flight, scanning the flights round robin from start.
+ * The caller then reserves and offers that many seats, and gives back with board_uncover_waiting what
+ * it couldn't reserve.
+ * @param flight Set to the flight whose reservations were covered
+ * @return The number of reservations covered, 0 if none are waiting uncovered right now
+ */
+unsigned int board_cover_waiting(struct matching_board *board, unsigned int start, unsigned int max,
+                                 unsigned int *flight);
+
+/**
+ * Gives back count reservations covered with board_cover_waiting for which no seats were offered.
+ */
+void board_uncover_waiting(struct matching_board *board, unsigned int flight, unsigned int count);
+
+/**
+ * @return 1 if every inserter has posted and all its waiting reservations are covered, i.e. no more
+ * seats are needed
+ */
+int board_covered(struct matching_board *board);
+
+/**
+ * Offers seats already reserved on the given flight's stack.
+ */
+void board_offer_seats(struct matching_board *board, unsigned int flight, unsigned int seats);
+
+/**
+ * Marks the calling airline as done posting (seats or reservations).
+ */
+void board_airline_ready(struct matching_board *board);
+
+/**
+ * Claims up to want seats from a single offer, scanning the flights round robin from start.
+ * @param flight Set to the flight whose seats were claimed
+ * @return The number of seats claimed, 0 if no seats are offered right now
+ */
+unsigned int board_claim_seats(struct matching_board *board, unsigned int start, unsigned int want,
+                               unsigned int *flight);
+
+/**
+ * Records that count claimed seats were filled.
+ */
+void board_complete_transfer(struct matching_board *board, unsigned int count);
+
+/**
+ * Takes back the seats still offered on a flight once no airline claims any more.
+ * @return The number of seats withdrawn, which are still reserved on the flight's stack
+ */
+unsigned int board_withdraw_seats(struct matching_board *board, unsigned int flight);
+
+/**
+ * @return 1 if every airline has posted and no seats are left, i.e. no more seats will ever be offered
+ */
+int board_exhausted(struct matching_board *board, unsigned int numOfAirlines);
+
+void board_destroy(struct matching_board *board);
+
+#endif //HY486_PROJECT_MATCHING_BOARD_H
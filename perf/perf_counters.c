@@ -0,0 +1,186 @@
+#define _GNU_SOURCE
+#include "perf_counters.h"
+#include <inttypes.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const char *phase_names[PERF_PHASES] = {"phase 1", "check 1", "phase 2", "check 2"};
+
+static const uint64_t hardware_events[PERF_HARDWARE_VALUES] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+};
+
+/**
+ * Descriptors left for everything else the process opens (stdio, the log, snapshots, traces)
+ */
+#define PERF_SPARE_FDS 64
+
+void perf_init(struct perf_counters *counters, unsigned int num_threads) {
+    for (int phase = 0; phase < PERF_PHASES; phase++) {
+        for (int value = 0; value < PERF_VALUES; value++) {
+            atomic_init(&counters->totals[phase][value], 0);
+        }
+        atomic_init(&counters->threads[phase], 0);
+        atomic_init(&counters->hardware_threads[phase], 0);
+        atomic_init(&counters->multiplexed_threads[phase], 0);
+    }
+    struct rlimit limit;
+    uint64_t needed = (uint64_t) num_threads * PERF_HARDWARE_VALUES + PERF_SPARE_FDS;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < needed) {
+        fprintf(stderr, "Counting %u threads needs about %" PRIu64 " file descriptors but only %" PRIu64
+                        " may be open, some threads will only get the getrusage values (raise it with ulimit -n)\n",
+                num_threads, needed, (uint64_t) limit.rlim_cur);
+    }
+}
+
+static int open_event(uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group_fd == -1; // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+/**
+ * Reads the getrusage values of the calling thread
+ */
+static void read_usage(uint64_t *values) {
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) != 0) {
+        memset(values + PERF_HARDWARE_VALUES, 0, sizeof(uint64_t) * (PERF_VALUES - PERF_HARDWARE_VALUES));
+        return;
+    }
+    values[PERF_CONTEXT_SWITCHES] = (uint64_t) (usage.ru_nvcsw + usage.ru_nivcsw);
+    values[PERF_PAGE_FAULTS] = (uint64_t) (usage.ru_minflt + usage.ru_majflt);
+    values[PERF_CPU_NS] = (uint64_t) (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000ull +
+                          (uint64_t) (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ull;
+    values[PERF_SYS_NS] = (uint64_t) usage.ru_stime.tv_sec * 1000000000ull + (uint64_t) usage.ru_stime.tv_usec * 1000ull;
+}
+
+/**
+ * Reads the hardware values of a group and how long it was enabled and actually counting
+ * @return 1 if successful, 0 otherwise
+ */
+static int read_group(int group_fd, uint64_t *values, uint64_t *time_enabled, uint64_t *time_running) {
+    // the number of events, the times, then the values in opening order
+    uint64_t buffer[3 + PERF_HARDWARE_VALUES];
+    if (read(group_fd, buffer, sizeof(buffer)) != (ssize_t) sizeof(buffer)) {
+        return 0;
+    }
+    *time_enabled = buffer[1];
+    *time_running = buffer[2];
+    memcpy(values, buffer + 3, sizeof(uint64_t) * PERF_HARDWARE_VALUES);
+    return 1;
+}
+
+/**
+ * Disables the group and closes its descriptors
+ */
+static void close_group(struct perf_thread *thread) {
+    if (thread->group_fd == -1) return;
+    ioctl(thread->group_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (int i = 0; i < PERF_HARDWARE_VALUES; i++) close(thread->fds[i]);
+    thread->group_fd = -1;
+}
+
+void perf_thread_begin(struct perf_thread *thread) {
+    memset(thread->start, 0, sizeof(thread->start));
+    thread->time_enabled = thread->time_running = 0;
+    thread->group_fd = open_event(hardware_events[0], -1);
+    thread->fds[0] = thread->group_fd;
+    for (int i = 1; thread->group_fd != -1 && i < PERF_HARDWARE_VALUES; i++) {
+        thread->fds[i] = open_event(hardware_events[i], thread->group_fd);
+        if (thread->fds[i] == -1) {
+            // no partial groups, e.g. LLC misses without a counter left
+            for (int j = 0; j < i; j++) close(thread->fds[j]);
+            thread->group_fd = -1;
+        }
+    }
+    if (thread->group_fd != -1) {
+        ioctl(thread->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(thread->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        read_group(thread->group_fd, thread->start, &thread->time_enabled, &thread->time_running);
+    }
+    read_usage(thread->start);
+}
+
+void perf_thread_end(struct perf_counters *counters, struct perf_thread *thread, enum perf_phase phase) {
+    uint64_t end[PERF_VALUES];
+    memset(end, 0, sizeof(end));
+    uint64_t time_enabled = 0, time_running = 0;
+    int hardware = thread->group_fd != -1 && read_group(thread->group_fd, end, &time_enabled, &time_running);
+    read_usage(end);
+    uint64_t enabled = time_enabled - thread->time_enabled;
+    uint64_t running = time_running - thread->time_running;
+    if (hardware && running == 0) hardware = 0; // never got onto the PMU, so there's nothing to scale
+    int multiplexed = hardware && running < enabled;
+    for (int value = 0; value < PERF_VALUES; value++) {
+        uint64_t counted = end[value] - thread->start[value];
+        if (value < PERF_HARDWARE_VALUES) {
+            if (!hardware) continue;
+            // the group only counted while it was on the PMU, so extrapolate to the whole time it was enabled
+            if (multiplexed) counted = (uint64_t) ((double) counted * (double) enabled / (double) running);
+        }
+        atomic_fetch_add_explicit(&counters->totals[phase][value], counted, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&counters->threads[phase], 1, memory_order_relaxed);
+    if (hardware) atomic_fetch_add_explicit(&counters->hardware_threads[phase], 1, memory_order_relaxed);
+    if (multiplexed) atomic_fetch_add_explicit(&counters->multiplexed_threads[phase], 1, memory_order_relaxed);
+    close_group(thread);
+}
+
+void perf_thread_discard(struct perf_thread *thread) {
+    close_group(thread);
+}
+
+void perf_report(struct perf_counters *counters, uint64_t reservations) {
+    printf("\nPerformance counters (%" PRIu64 " reservations):\n", reservations);
+    printf("%-8s %8s %16s %16s %6s %14s %10s %10s %10s %10s %10s\n", "phase", "threads", "cycles", "instructions",
+           "IPC", "LLC misses", "misses/res", "ctx sw", "faults", "CPU (ms)", "sys (ms)");
+    for (int phase = 0; phase < PERF_PHASES; phase++) {
+        unsigned int threads = atomic_load(&counters->threads[phase]);
+        if (threads == 0) continue;
+        uint64_t values[PERF_VALUES];
+        for (int value = 0; value < PERF_VALUES; value++) {
+            values[value] = atomic_load(&counters->totals[phase][value]);
+        }
+        unsigned int hardware_threads = atomic_load(&counters->hardware_threads[phase]);
+        char threads_column[24];
+        snprintf(threads_column, sizeof(threads_column), "%u", threads);
+        if (hardware_threads == 0) {
+            printf("%-8s %8s %16s %16s %6s %14s %10s", phase_names[phase], threads_column, "n/a", "n/a", "n/a", "n/a", "n/a");
+        } else {
+            if (hardware_threads < threads) {
+                // some threads fell back to getrusage, so the hardware values are partial
+                snprintf(threads_column, sizeof(threads_column), "%u/%u", hardware_threads, threads);
+            }
+            printf("%-8s %8s %16" PRIu64 " %16" PRIu64 " %6.2f %14" PRIu64 " %10.3f", phase_names[phase], threads_column,
+                   values[PERF_CYCLES], values[PERF_INSTRUCTIONS],
+                   values[PERF_CYCLES] > 0 ? (double) values[PERF_INSTRUCTIONS] / (double) values[PERF_CYCLES] : 0,
+                   values[PERF_LLC_MISSES],
+                   reservations > 0 ? (double) values[PERF_LLC_MISSES] / (double) reservations : 0);
+        }
+        printf(" %10" PRIu64 " %10" PRIu64 " %10.3f %10.3f\n", values[PERF_CONTEXT_SWITCHES], values[PERF_PAGE_FAULTS],
+               (double) values[PERF_CPU_NS] / 1e6, (double) values[PERF_SYS_NS] / 1e6);
+    }
+    unsigned int multiplexed = 0;
+    for (int phase = 0; phase < PERF_PHASES; phase++) multiplexed += atomic_load(&counters->multiplexed_threads[phase]);
+    if (multiplexed > 0) {
+        printf("%u thread phase(s) shared the PMU with other events, their hardware counts are scaled estimates\n",
+               multiplexed);
+    }
+    if (atomic_load(&counters->hardware_threads[PERF_PHASE_1]) == 0 &&
+        atomic_load(&counters->hardware_threads[PERF_PHASE_2]) == 0) {
+        printf("Hardware counters unavailable, only the getrusage values were counted\n");
+    }
+}
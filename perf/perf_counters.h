@@ -0,0 +1,85 @@
+#ifndef HY486_PROJECT_PERF_COUNTERS_H
+#define HY486_PROJECT_PERF_COUNTERS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * The phases counters are attributed to. The phases are measured on the agencies (phase 1) and
+ * the airlines (phase 2), the checks on the controller.
+ */
+enum perf_phase {
+    PERF_PHASE_1,
+    PERF_CHECK_1,
+    PERF_PHASE_2,
+    PERF_CHECK_2,
+    PERF_PHASES
+};
+
+enum perf_value {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_HARDWARE_VALUES, // the values above come from perf_event_open, the ones below from getrusage
+    PERF_CONTEXT_SWITCHES = PERF_HARDWARE_VALUES,
+    PERF_PAGE_FAULTS,
+    PERF_CPU_NS, // user + system time
+    PERF_SYS_NS, // of which system time, which the user-space hardware counters don't see
+    PERF_VALUES
+};
+
+/**
+ * Totals of every phase over all the threads that ran it
+ */
+struct perf_counters {
+    _Atomic uint64_t totals[PERF_PHASES][PERF_VALUES];
+    atomic_uint threads[PERF_PHASES]; // threads counted in each phase
+    atomic_uint hardware_threads[PERF_PHASES]; // of which had hardware counters
+    atomic_uint multiplexed_threads[PERF_PHASES]; // of which shared the PMU, so their counts were scaled up
+};
+
+/**
+ * The counters of one thread over one phase, private to it
+ */
+struct perf_thread {
+    int group_fd; // -1 if hardware counters couldn't be opened
+    int fds[PERF_HARDWARE_VALUES]; // the group's events, the leader first
+    uint64_t start[PERF_VALUES];
+    uint64_t time_enabled; // of the group at the start, for scaling multiplexed counts
+    uint64_t time_running;
+};
+
+/**
+ * Every counted thread holds a descriptor per hardware event. If the limit on open descriptors
+ * leaves too few for the given number of threads, it warns that some of them will only get the
+ * getrusage values, without raising the limit.
+ * @param num_threads The most threads counted at once
+ */
+void perf_init(struct perf_counters *counters, unsigned int num_threads);
+
+/**
+ * Starts counting the calling thread. Cycles, instructions and last-level cache misses come from a
+ * perf_event_open group on the thread (user space only, so that it works with perf_event_paranoid
+ * at 2), context switches, page faults, CPU and system time from getrusage(RUSAGE_THREAD), which is exact
+ * per thread and needs no file descriptor. Without perf events (e.g. in VMs or out of descriptors)
+ * only the getrusage values are counted.
+ */
+void perf_thread_begin(struct perf_thread *thread);
+
+/**
+ * Stops counting the calling thread and adds what it counted to a phase. Hardware counts are scaled by
+ * the share of the time the group was actually on the PMU, if it had to be multiplexed with others.
+ */
+void perf_thread_end(struct perf_counters *counters, struct perf_thread *thread, enum perf_phase phase);
+
+/**
+ * Stops counting the calling thread without adding anything, e.g. on a path that abandons the run
+ */
+void perf_thread_discard(struct perf_thread *thread);
+
+/**
+ * Prints the totals, IPC and cache misses per reservation of every phase that was counted
+ */
+void perf_report(struct perf_counters *counters, uint64_t reservations);
+
+#endif //HY486_PROJECT_PERF_COUNTERS_H
@@ -3,9 +3,32 @@
 //
 
 #include "queue.h"
+#include "../latency/latency.h"
+#include "../contention/contention.h"
 #include <stdlib.h>
 #include <stdio.h>
 
+struct queue *createQueue() {
+    // aligned_alloc, since a CACHE_LAYOUT queue is aligned to a cache line
+    struct queue *queue = (struct queue *) aligned_alloc(_Alignof(struct queue), sizeof(struct queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (!initQueue(queue)) {
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+void destroyQueue(struct queue *queue) {
+    finalizeQueue(queue);
+    free(queue);
+}
+
+#ifndef UNROLLED_NODES
+// the unrolled variant of the functions below is in unrolled_queue.c
+
 // Helper functions to create dummy nodes in order to make working
 // with empty and non-empty cases easier
 struct queue_reservation *create_dummy_node() {
@@ -17,64 +40,134 @@ struct queue_reservation *create_dummy_node() {
     return node;
 }
 
-struct queue *createQueue() {
-    struct queue *queue = (struct queue *) malloc(sizeof(struct queue));
-    if (queue == NULL) {
-        return NULL;
-    }
-
+int initQueue(struct queue *queue) {
     // Create dummy nodes for head and tail
     queue->head = create_dummy_node();
+    if (queue->head == NULL) {
+        return 0;
+    }
     queue->tail = queue->head;
     queue->size = 0;
+    queue->removals = 0;
 
     pthread_mutex_init(&(queue->head_lock), NULL);
     pthread_mutex_init(&(queue->tail_lock), NULL);
-
-    return queue;
+    return 1;
 }
 
 void enqueue(struct queue *queue, struct Reservation reservation) {
+    LATENCY_START();
     struct queue_reservation *new_node = (struct queue_reservation *) malloc(sizeof(struct queue_reservation));
     if (new_node == NULL) {
+        LATENCY_STOP(LATENCY_ENQUEUE);
         return; //todo: maybe return an error code in order to satisfy totality (slide 2 - lec 5)
     }
     new_node->reservation = reservation;
     new_node->next = NULL;
 
     // Acquire tail lock first to ensure proper linking
-    pthread_mutex_lock(&(queue->tail_lock));
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
 
     // Update tail pointer atomically (for concurrent access)
     queue->tail->next = new_node;
     queue->tail = new_node;
     queue->size += 1;
     pthread_mutex_unlock(&(queue->tail_lock));
+    LATENCY_STOP(LATENCY_ENQUEUE);
+}
+
+unsigned int enqueueBulk(struct queue *queue, const struct Reservation *reservations, unsigned int count) {
+    struct queue_reservation *first = NULL;
+    struct queue_reservation *last = NULL;
+    unsigned int built = 0;
+    for (; built < count; built++) {
+        struct queue_reservation *new_node = (struct queue_reservation *) malloc(sizeof(struct queue_reservation));
+        if (new_node == NULL) {
+            break;
+        }
+        new_node->reservation = reservations[built];
+        new_node->next = NULL;
+        if (last == NULL) {
+            first = new_node;
+        } else {
+            last->next = new_node;
+        }
+        last = new_node;
+    }
+    if (built == 0) {
+        return 0;
+    }
+
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    queue->tail->next = first;
+    queue->tail = last;
+    queue->size += built;
+    pthread_mutex_unlock(&(queue->tail_lock));
+    return built;
 }
 
 struct Reservation dequeue(struct queue *queue) {
+    LATENCY_START();
     // Acquire the head lock to ensure proper reading
-    pthread_mutex_lock(&(queue->head_lock));
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
 
     // Check for empty queue (dummy node check)
     if (queue->head->next == NULL) {
         pthread_mutex_unlock(&(queue->head_lock));
+        CONTENTION_COUNT(CONTENTION_QUEUE, empty_polls);
         //todo: maybe return an error code in order to satisfy totality (slide 2 - lec 5)
+        LATENCY_STOP(LATENCY_DEQUEUE);
         return (struct Reservation) {-1, -1};
     }
 
-    // Move head pointer (atomicity not crucial here)
-    struct queue_reservation *temp = queue->head->next;
-    struct Reservation reservation = temp->reservation;
-    queue->head->next = temp->next;
-    free(temp);
+    // The first node becomes the new dummy and the old dummy is released. Unlinking the first node
+    // instead would leave the tail pointing at freed memory whenever the last reservation is removed
+    // while an enqueue is about to link behind it.
+    struct queue_reservation *old_head = queue->head;
+    struct queue_reservation *first = old_head->next;
+    struct Reservation reservation = first->reservation;
+    queue->head = first;
     queue->size -= 1;
+    queue->removals++;
     pthread_mutex_unlock(&(queue->head_lock));
+    free(old_head);
+    LATENCY_STOP(LATENCY_DEQUEUE);
 
     return reservation;
 }
 
-void destroyQueue(struct queue *queue) {
+unsigned int forEachInQueue(struct queue *queue, reservation_visitor visit, void *context) {
+    unsigned int visited = 0;
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    for (struct queue_reservation *node = queue->head->next; node != NULL; node = node->next) {
+        visited++;
+        if (!visit(&node->reservation, context)) break;
+    }
+    pthread_mutex_unlock(&(queue->tail_lock));
+    pthread_mutex_unlock(&(queue->head_lock));
+    return visited;
+}
+
+unsigned int exportQueue(struct queue *queue, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max) {
+    unsigned int copied = 0;
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    check_cursor(cursor, queue->removals, "exportQueue");
+    const struct queue_reservation *node = cursor->started ? cursor->node : queue->head->next; // skip the dummy
+    for (; node != NULL && copied < max; node = node->next) {
+        out[copied++] = node->reservation;
+    }
+    cursor->removals = queue->removals;
+    pthread_mutex_unlock(&(queue->tail_lock));
+    pthread_mutex_unlock(&(queue->head_lock));
+    cursor->node = node;
+    cursor->started = 1;
+    return copied;
+}
+
+void finalizeQueue(struct queue *queue) {
     struct queue_reservation *node = queue->head->next;
 
     while (node != NULL) {
@@ -86,5 +179,6 @@ void destroyQueue(struct queue *queue) {
     free(queue->head);
     pthread_mutex_destroy(&queue->tail_lock);
     pthread_mutex_destroy(&queue->head_lock);
-    free(queue);
-}
\ No newline at end of file
+}
+
+#endif
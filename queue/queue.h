@@ -6,33 +6,116 @@
 #define HY486_PROJECT_QUEUE_H
 
 #include "../common/reservations.h"
+#include "../layout/layout.h"
 #include <pthread.h>
+#include <stdatomic.h>
 
+#ifdef UNROLLED_NODES
+/**
+ * Reservations per node of the unrolled queue
+ */
+#define QUEUE_BLOCK_RESERVATIONS 32
+
+/**
+ * A block of reservations, enqueued at last and dequeued from first. Once next is set the
+ * block is sealed: no enqueuer writes to it again, even if it isn't full.
+ */
+struct queue_block {
+    _Atomic(struct queue_block *) next;
+    unsigned int first; // next reservation to dequeue, only accessed under the head lock
+    _Atomic unsigned int last; // where the next reservation is enqueued, written under the tail lock
+    struct Reservation reservations[QUEUE_BLOCK_RESERVATIONS];
+};
+#else
 struct queue_reservation {
     struct Reservation reservation;
     struct queue_reservation *next;
 };
+#endif
 
 /**
  * @brief An unbounded total queue that uses locks for
  * the head and tail.
+ *
+ * With CACHE_LAYOUT each end shares a cache line with its lock, so that enqueuers and dequeuers
+ * only share the size, which both of them write and which gets a line of its own. With UNROLLED_NODES (queue/unrolled_queue.c) each node holds a
+ * block of reservations instead of one, and the head block stands in for the dummy node.
  */
 struct queue {
-    unsigned int size;
+    // the dequeuers' end
+    HOT_FIELD pthread_mutex_t head_lock;
+#ifdef UNROLLED_NODES
+    struct queue_block *head;
+#else
     struct queue_reservation *head;
+#endif
+    unsigned long removals; // dequeues so far, so that a walk can tell its cursor is stale
+    // the enqueuers' end
+    HOT_FIELD pthread_mutex_t tail_lock;
+#ifdef UNROLLED_NODES
+    struct queue_block *tail;
+#else
     struct queue_reservation *tail;
-    pthread_mutex_t head_lock;
-    pthread_mutex_t tail_lock;
+#endif
+    // updated under the tail lock by enqueue and under the head lock by dequeue, so it must be atomic
+    // once both ends are used concurrently (e.g. in pipelined runs)
+    HOT_FIELD _Atomic unsigned int size;
 };
 
+#ifndef UNROLLED_NODES
 struct queue_reservation *create_dummy_node();
+#endif
 
 struct queue *createQueue();
 
+/**
+ * Initializes a queue in memory the caller owns, e.g. a slot of the flights table
+ * @return 0 if the dummy node could not be allocated, 1 otherwise
+ */
+int initQueue(struct queue *queue);
+
 void enqueue(struct queue *queue, struct Reservation reservation);
 
+/**
+ * Enqueues the given reservations in order with a single acquisition of the tail lock. The linked
+ * queue links its nodes together before taking it, the unrolled one tops up its tail block first
+ * and only allocates a block every QUEUE_BLOCK_RESERVATIONS reservations after that.
+ * @return The number of reservations enqueued
+ */
+unsigned int enqueueBulk(struct queue *queue, const struct Reservation *reservations, unsigned int count);
+
 struct Reservation dequeue(struct queue *queue);
 
+/**
+ * Calls visit for every reservation, from head to tail, while holding both of the queue's locks.
+ * @return The number of reservations visited
+ */
+unsigned int forEachInQueue(struct queue *queue, reservation_visitor visit, void *context);
+
+/**
+ * Copies up to max reservations, from head to tail, into out, continuing where the cursor left off.
+ * Each chunk is copied under both locks, so that the caller can work on flat memory outside of them,
+ * but nothing may be dequeued between the chunks of one export (see check_cursor).
+ * @return The number of reservations copied, 0 once every reservation has been exported
+ */
+unsigned int exportQueue(struct queue *queue, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max);
+
+#ifdef UNROLLED_NODES
+/**
+ * Hands out what is left of the next block of reservations, without copying. Only the unrolled
+ * queue keeps its reservations in arrays, the linked one is read with exportQueue.
+ * The queue must be quiescent while its spans are in use (see check_cursor).
+ * @return 1 if a span was handed out, 0 once the queue has been exhausted
+ */
+int nextQueueSpan(struct queue *queue, struct reservation_cursor *cursor, struct reservation_span *span);
+#endif
+
 void destroyQueue(struct queue *queue);
 
+/**
+ * Frees the nodes of a queue initialized with initQueue, but not the queue itself
+ */
+void finalizeQueue(struct queue *queue);
+
 #endif //HY486_PROJECT_QUEUE_H
\ No newline at end of file
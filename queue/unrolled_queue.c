@@ -0,0 +1,211 @@
+#include "queue.h"
+#include "../latency/latency.h"
+#include "../contention/contention.h"
+#include <stdlib.h>
+
+#ifdef UNROLLED_NODES
+
+/**
+ * @return An empty, unsealed block, or NULL if it could not be allocated
+ */
+static struct queue_block *create_block(void) {
+    struct queue_block *block = (struct queue_block *) malloc(sizeof(struct queue_block));
+    if (block == NULL) {
+        return NULL;
+    }
+    atomic_init(&block->next, NULL);
+    block->first = 0;
+    atomic_init(&block->last, 0);
+    return block;
+}
+
+int initQueue(struct queue *queue) {
+    // an empty block plays the part of the dummy node, the head & tail start out sharing it
+    queue->head = create_block();
+    if (queue->head == NULL) {
+        return 0;
+    }
+    queue->tail = queue->head;
+    queue->size = 0;
+    queue->removals = 0;
+
+    pthread_mutex_init(&(queue->head_lock), NULL);
+    pthread_mutex_init(&(queue->tail_lock), NULL);
+    return 1;
+}
+
+void enqueue(struct queue *queue, struct Reservation reservation) {
+    LATENCY_START();
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    struct queue_block *tail = queue->tail;
+    unsigned int last = atomic_load_explicit(&tail->last, memory_order_relaxed); // only enqueuers write it
+    if (last == QUEUE_BLOCK_RESERVATIONS) {
+        // only every QUEUE_BLOCK_RESERVATIONS enqueues, so allocating under the lock is rare
+        struct queue_block *block = create_block();
+        if (block == NULL) {
+            pthread_mutex_unlock(&(queue->tail_lock));
+            LATENCY_STOP(LATENCY_ENQUEUE);
+            return;
+        }
+        block->reservations[0] = reservation;
+        atomic_store_explicit(&block->last, 1, memory_order_relaxed);
+        // publishes the new block's reservation along with it and seals the full one
+        atomic_store_explicit(&tail->next, block, memory_order_release);
+        queue->tail = block;
+    } else {
+        tail->reservations[last] = reservation;
+        atomic_store_explicit(&tail->last, last + 1, memory_order_release);
+    }
+    queue->size += 1;
+    pthread_mutex_unlock(&(queue->tail_lock));
+    LATENCY_STOP(LATENCY_ENQUEUE);
+}
+
+unsigned int enqueueBulk(struct queue *queue, const struct Reservation *reservations, unsigned int count) {
+    unsigned int built = 0;
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    struct queue_block *tail = queue->tail;
+    while (built < count) {
+        unsigned int last = atomic_load_explicit(&tail->last, memory_order_relaxed); // only enqueuers write it
+        if (last < QUEUE_BLOCK_RESERVATIONS) {
+            // top up the tail block first, as enqueue would
+            unsigned int room = QUEUE_BLOCK_RESERVATIONS - last;
+            unsigned int fill = count - built < room ? count - built : room;
+            for (unsigned int i = 0; i < fill; i++) {
+                tail->reservations[last + i] = reservations[built + i];
+            }
+            atomic_store_explicit(&tail->last, last + fill, memory_order_release);
+            built += fill;
+            continue;
+        }
+        // a block per QUEUE_BLOCK_RESERVATIONS reservations after that, as enqueue allocates them
+        struct queue_block *block = create_block();
+        if (block == NULL) {
+            break;
+        }
+        unsigned int fill = count - built < QUEUE_BLOCK_RESERVATIONS ? count - built : QUEUE_BLOCK_RESERVATIONS;
+        for (unsigned int i = 0; i < fill; i++) {
+            block->reservations[i] = reservations[built + i];
+        }
+        atomic_store_explicit(&block->last, fill, memory_order_relaxed);
+        // publishes the new block's reservations along with it and seals the full one
+        atomic_store_explicit(&tail->next, block, memory_order_release);
+        queue->tail = tail = block;
+        built += fill;
+    }
+    queue->size += built;
+    pthread_mutex_unlock(&(queue->tail_lock));
+    return built;
+}
+
+struct Reservation dequeue(struct queue *queue) {
+    LATENCY_START();
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
+    struct queue_block *block = queue->head;
+    struct queue_block *consumed = NULL;
+    while (block->first == atomic_load_explicit(&block->last, memory_order_acquire)) {
+        struct queue_block *next = atomic_load_explicit(&block->next, memory_order_acquire);
+        if (next == NULL) {
+            pthread_mutex_unlock(&(queue->head_lock));
+            CONTENTION_COUNT(CONTENTION_QUEUE, empty_polls);
+            LATENCY_STOP(LATENCY_DEQUEUE);
+            return (struct Reservation) {-1, -1};
+        }
+        // next is set, so the block is sealed, but an enqueue may have landed in it before that
+        if (block->first != atomic_load_explicit(&block->last, memory_order_relaxed)) {
+            break;
+        }
+        // sealed and consumed, so the tail has moved on and no enqueuer touches it anymore. As with
+        // the dummy node, the head only leaves a block once there is a next one to move to.
+        queue->head = next;
+        consumed = block;
+        block = next;
+    }
+    struct Reservation reservation = block->reservations[block->first++];
+    queue->size -= 1;
+    queue->removals++;
+    pthread_mutex_unlock(&(queue->head_lock));
+    free(consumed);
+    LATENCY_STOP(LATENCY_DEQUEUE);
+
+    return reservation;
+}
+
+unsigned int forEachInQueue(struct queue *queue, reservation_visitor visit, void *context) {
+    unsigned int visited = 0;
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    for (struct queue_block *block = queue->head; block != NULL; block = atomic_load(&block->next)) {
+        unsigned int last = atomic_load(&block->last);
+        for (unsigned int i = block->first; i < last; i++) {
+            visited++;
+            if (!visit(&block->reservations[i], context)) {
+                pthread_mutex_unlock(&(queue->tail_lock));
+                pthread_mutex_unlock(&(queue->head_lock));
+                return visited;
+            }
+        }
+    }
+    pthread_mutex_unlock(&(queue->tail_lock));
+    pthread_mutex_unlock(&(queue->head_lock));
+    return visited;
+}
+
+unsigned int exportQueue(struct queue *queue, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max) {
+    unsigned int copied = 0;
+    contention_lock(&(queue->head_lock), CONTENTION_QUEUE);
+    contention_lock(&(queue->tail_lock), CONTENTION_QUEUE);
+    check_cursor(cursor, queue->removals, "exportQueue");
+    const struct queue_block *block = cursor->started ? cursor->node : queue->head;
+    unsigned int index = cursor->started ? cursor->offset : (block != NULL ? block->first : 0);
+    while (block != NULL && copied < max) {
+        unsigned int last = atomic_load(&block->last);
+        while (index < last && copied < max) {
+            out[copied++] = block->reservations[index++];
+        }
+        if (index == last) {
+            block = atomic_load(&block->next);
+            index = block != NULL ? block->first : 0;
+        }
+    }
+    cursor->removals = queue->removals;
+    pthread_mutex_unlock(&(queue->tail_lock));
+    pthread_mutex_unlock(&(queue->head_lock));
+    cursor->node = block;
+    cursor->offset = index;
+    cursor->started = 1;
+    return copied;
+}
+
+int nextQueueSpan(struct queue *queue, struct reservation_cursor *cursor, struct reservation_span *span) {
+    check_cursor(cursor, queue->removals, "nextQueueSpan");
+    const struct queue_block *block = cursor->started ? cursor->node : queue->head;
+    cursor->started = 1;
+    cursor->removals = queue->removals;
+    // only the head block can be empty, but skipping any keeps empty spans out
+    while (block != NULL && block->first == atomic_load(&block->last)) {
+        block = atomic_load(&block->next);
+    }
+    if (block == NULL) {
+        cursor->node = NULL;
+        return 0;
+    }
+    span->reservations = &block->reservations[block->first];
+    span->count = atomic_load(&block->last) - block->first;
+    cursor->node = atomic_load(&block->next);
+    return 1;
+}
+
+void finalizeQueue(struct queue *queue) {
+    struct queue_block *block = queue->head;
+    while (block != NULL) {
+        struct queue_block *temp = block;
+        block = atomic_load(&block->next);
+        free(temp);
+    }
+    pthread_mutex_destroy(&queue->tail_lock);
+    pthread_mutex_destroy(&queue->head_lock);
+}
+
+#endif
@@ -0,0 +1,75 @@
+#include "routing.h"
+#include <stdlib.h>
+
+/**
+ * splitmix64
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+int router_init(struct router *router, unsigned int numOfFlights, const unsigned int *capacities,
+                double flexible_fraction) {
+    router->num_flights = numOfFlights;
+    router->flexible_fraction = flexible_fraction;
+    router->hints = aligned_alloc(_Alignof(struct load_hint), sizeof(struct load_hint) * numOfFlights);
+    if (router->hints == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        atomic_init(&router->hints[i].free_seats, capacities[i]);
+    }
+    atomic_init(&router->flexible, 0);
+    atomic_init(&router->rerouted, 0);
+    return 1;
+}
+
+void router_agency_init(struct router_agency *agency, uint64_t seed, int agency_id) {
+    // a different stream than the workload generator of the same agency
+    uint64_t state = ~seed ^ ((uint64_t) agency_id * 0xA24BAED4963EE407ull);
+    agency->rng = next_random(&state);
+    agency->flexible = 0;
+    agency->rerouted = 0;
+}
+
+unsigned int router_choose(struct router *router, struct router_agency *agency, unsigned int flight) {
+    if (router->num_flights < 2) {
+        return flight;
+    }
+    uint64_t r = next_random(&agency->rng);
+    if ((r >> 11) * (1.0 / 9007199254740992.0) >= router->flexible_fraction) {
+        return flight; // this reservation is bound to its flight
+    }
+    agency->flexible++;
+
+    // the second choice is any flight other than the first
+    unsigned int other = next_random(&agency->rng) % (router->num_flights - 1);
+    if (other >= flight) other++;
+
+    unsigned int free_seats = atomic_load_explicit(&router->hints[flight].free_seats, memory_order_relaxed);
+    unsigned int other_free_seats = atomic_load_explicit(&router->hints[other].free_seats, memory_order_relaxed);
+    if (other_free_seats > free_seats) {
+        agency->rerouted++;
+        return other;
+    }
+    return flight;
+}
+
+void router_note_push(struct router *router, unsigned int flight, unsigned int size, unsigned int capacity) {
+    if ((size - 1) / ROUTING_HINT_PERIOD != size / ROUTING_HINT_PERIOD || size >= capacity) {
+        atomic_store_explicit(&router->hints[flight].free_seats, capacity - size, memory_order_relaxed);
+    }
+}
+
+void router_agency_finish(struct router *router, struct router_agency *agency) {
+    atomic_fetch_add_explicit(&router->flexible, agency->flexible, memory_order_relaxed);
+    atomic_fetch_add_explicit(&router->rerouted, agency->rerouted, memory_order_relaxed);
+}
+
+void router_destroy(struct router *router) {
+    free(router->hints);
+    router->hints = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef HY486_PROJECT_ROUTING_H
+#define HY486_PROJECT_ROUTING_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Pushes between two refreshes of a flight's load hint
+ */
+#define ROUTING_HINT_PERIOD 8
+
+/**
+ * The free seats of a flight as last published by a pusher. Padded to its own cache line
+ * so that reading hints doesn't contend with the stack's top/size/lock line.
+ */
+struct load_hint {
+    _Alignas(64) atomic_uint free_seats;
+};
+
+/**
+ * @brief Power-of-two-choices routing of flexible reservations.
+ *
+ * A flexible reservation samples a second, random flight and is booked on whichever of
+ * the two has more free seats according to the load hints. Hints are refreshed every
+ * ROUTING_HINT_PERIOD pushes, so they are at most that many seats stale.
+ */
+struct router {
+    unsigned int num_flights;
+    double flexible_fraction; // share of reservations that may be moved to another flight
+    struct load_hint *hints;
+    atomic_uint_fast64_t flexible; // totals, added once by each agency when it finishes
+    atomic_uint_fast64_t rerouted;
+};
+
+/**
+ * Routing state private to an agency thread
+ */
+struct router_agency {
+    uint64_t rng;
+    uint64_t flexible;
+    uint64_t rerouted;
+};
+
+/**
+ * @param capacities The stack capacity of every flight, i.e. its initial free seats
+ * @return 1 if successful, 0 otherwise
+ */
+int router_init(struct router *router, unsigned int numOfFlights, const unsigned int *capacities,
+                double flexible_fraction);
+
+void router_agency_init(struct router_agency *agency, uint64_t seed, int agency_id);
+
+/**
+ * @param flight The flight the reservation was meant for
+ * @return The flight to book the reservation on
+ */
+unsigned int router_choose(struct router *router, struct router_agency *agency, unsigned int flight);
+
+/**
+ * Called after a successful push, refreshes the flight's hint whenever the size crosses a multiple
+ * of ROUTING_HINT_PERIOD and once the stack becomes full.
+ * @param size The stack's size right after the push, as pushSized reports it
+ */
+void router_note_push(struct router *router, unsigned int flight, unsigned int size, unsigned int capacity);
+
+/**
+ * Adds the agency's counters to the router's totals.
+ */
+void router_agency_finish(struct router *router, struct router_agency *agency);
+
+void router_destroy(struct router *router);
+
+#endif //HY486_PROJECT_ROUTING_H
@@ -0,0 +1,243 @@
+#include "reference.h"
+#include "../simd/reservation_stats.h"
+#include "../stack/stack.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Reservations exported from a stack at a time
+ */
+#define REFERENCE_CHUNK 1024
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+int reference_init(struct reference *reference, unsigned int num_flights, const unsigned int *capacities) {
+    memset(reference, 0, sizeof(struct reference));
+    reference->num_flights = num_flights;
+    reference->num_agencies = num_flights * num_flights;
+    reference->total = (uint64_t) reference->num_agencies * num_flights;
+    reference->flights = calloc(num_flights > 0 ? num_flights : 1, sizeof(struct reference_flight));
+    reference->booked_flight = malloc(sizeof(unsigned int) * (reference->total > 0 ? reference->total : 1));
+    if (reference->flights == NULL || reference->booked_flight == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < num_flights; i++) {
+        reference->flights[i].capacity = capacities[i];
+        reference->flights[i].stack = malloc(sizeof(struct Reservation) * (capacities[i] > 0 ? capacities[i] : 1));
+        if (reference->flights[i].stack == NULL) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * @return 1 if successful, 0 if the queue couldn't grow
+ */
+static int enqueue_reference(struct reference_flight *flight, struct Reservation reservation) {
+    if (flight->queue_tail == flight->queue_capacity) {
+        uint64_t capacity = flight->queue_capacity > 0 ? flight->queue_capacity * 2 : 64;
+        struct Reservation *queue = realloc(flight->queue, sizeof(struct Reservation) * capacity);
+        if (queue == NULL) {
+            return 0;
+        }
+        flight->queue = queue;
+        flight->queue_capacity = capacity;
+    }
+    flight->queue[flight->queue_tail++] = reservation;
+    return 1;
+}
+
+/**
+ * Inserts into the sorted center, shifting the higher reservation numbers up by one
+ */
+static void insert_reference(struct reference *reference, struct Reservation reservation) {
+    uint64_t low = reference->center_head, high = reference->center_tail;
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        if (reference->center[middle].reservation_number < reservation.reservation_number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    memmove(&reference->center[low + 1], &reference->center[low],
+            sizeof(struct Reservation) * (reference->center_tail - low));
+    reference->center[low] = reservation;
+    reference->center_tail++;
+}
+
+int reference_run_phase_1(struct reference *reference, const struct workload *workload) {
+    double start = now_seconds();
+    unsigned int numOfAgencies = reference->num_agencies;
+    for (unsigned int agency_id = 1; agency_id <= numOfAgencies; agency_id++) {
+        unsigned int home_flight = (agency_id - 1) % reference->num_flights;
+        struct workload_agency generator;
+        if (workload != NULL) workload_agency_init(workload, &generator, (int) agency_id);
+        for (unsigned int i = 0; i < reference->num_flights; i++) {
+            struct Reservation reservation = {(int) agency_id,
+                                              (reservation_number_t) i * numOfAgencies + agency_id};
+            unsigned int flight_index = workload != NULL ? workload_next_flight(workload, &generator, home_flight)
+                                                         : home_flight;
+            struct reference_flight *flight = &reference->flights[flight_index];
+            if (flight->size < flight->capacity) {
+                flight->stack[flight->size++] = reservation;
+            } else if (!enqueue_reference(flight, reservation)) {
+                return 0;
+            }
+            flight->booked++;
+            flight->booked_keysum += reservation.reservation_number;
+            reference->booked_flight[reservation.reservation_number - 1] = flight_index;
+        }
+    }
+    reference->phase_1_seconds = now_seconds() - start;
+    return 1;
+}
+
+int reference_run_phase_2(struct reference *reference) {
+    double start = now_seconds();
+    uint64_t pending = 0;
+    for (unsigned int i = 0; i < reference->num_flights; i++) {
+        pending += reference->flights[i].queue_tail - reference->flights[i].queue_head;
+    }
+    reference->center = malloc(sizeof(struct Reservation) * (pending > 0 ? pending : 1));
+    if (reference->center == NULL) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < reference->num_flights; i++) {
+        struct reference_flight *flight = &reference->flights[i];
+        while (flight->queue_head < flight->queue_tail) {
+            insert_reference(reference, flight->queue[flight->queue_head++]);
+        }
+    }
+    for (unsigned int i = 0; i < reference->num_flights; i++) {
+        struct reference_flight *flight = &reference->flights[i];
+        if (flight->booked > flight->capacity) continue; // an inserter, its stack is full
+        while (flight->size < flight->capacity && reference->center_head < reference->center_tail) {
+            flight->stack[flight->size++] = reference->center[reference->center_head++];
+        }
+    }
+    reference->phase_2_seconds = now_seconds() - start;
+    return 1;
+}
+
+int reference_check(const struct reference *reference, int phase_2, keysum_t expected_keysum) {
+    int result = 1;
+    uint64_t total = 0;
+    struct reservation_stats stats;
+    reservation_stats_init(&stats);
+    for (unsigned int i = 0; i < reference->num_flights; i++) {
+        const struct reference_flight *flight = &reference->flights[i];
+        if (flight->size > flight->capacity) {
+            printf("Sequential reference: flight %u stack overflow check failed (capacity: %u, found: %u)\n", i,
+                   flight->capacity, flight->size);
+            result = 0;
+        }
+        if (phase_2 && flight->queue_head != flight->queue_tail) {
+            printf("Sequential reference: found non empty pending reservations queue for flight #%u\n", i);
+            result = 0;
+        }
+        reservation_stats_add(&stats, flight->stack, flight->size);
+        reservation_stats_add(&stats, flight->queue + flight->queue_head, flight->queue_tail - flight->queue_head);
+        total += flight->size + (flight->queue_tail - flight->queue_head);
+    }
+    if (reference->center != NULL) {
+        reservation_stats_add(&stats, reference->center + reference->center_head,
+                              reference->center_tail - reference->center_head);
+        total += reference->center_tail - reference->center_head;
+    }
+    if (phase_2 && reference->center_head != reference->center_tail) {
+        printf("Sequential reference: reservations center was not empty!\n");
+        result = 0;
+    }
+    if (total != reference->total) {
+        printf("Sequential reference: total size check failed (expected: %" PRIu64 ", found: %" PRIu64 ")\n",
+               reference->total, total);
+        result = 0;
+    }
+    if (stats.sum != expected_keysum) {
+        char expected[KEYSUM_STR_LEN], found[KEYSUM_STR_LEN];
+        printf("Sequential reference: total keysum check failed (expected: %s, found: %s)\n",
+               format_keysum(expected_keysum, expected), format_keysum(stats.sum, found));
+        result = 0;
+    }
+    if (result) {
+        printf("Sequential reference: phase %d checks passed (%" PRIu64 " reservations)\n", phase_2 ? 2 : 1, total);
+    }
+    return result;
+}
+
+int reference_compare(const struct reference *reference, struct flight_reservations **flights) {
+    int result = 1;
+    uint64_t moved = 0, reference_moved = 0;
+    for (unsigned int i = 0; i < reference->num_flights; i++) {
+        const struct reference_flight *expected = &reference->flights[i];
+        int inserter = expected->booked > expected->capacity;
+        uint64_t size = 0, own = 0, strays = 0;
+        keysum_t own_keysum = 0;
+
+        struct reservation_cursor cursor = {0};
+        struct Reservation chunk[REFERENCE_CHUNK];
+        unsigned int count;
+        while ((count = exportStack(flights[i]->completed_reservations, &cursor, chunk, REFERENCE_CHUNK)) > 0) {
+            for (unsigned int r = 0; r < count; r++) {
+                reservation_number_t number = chunk[r].reservation_number;
+                size++;
+                if (number < 1 || (uint64_t) number > reference->total) {
+                    strays++;
+                } else if (reference->booked_flight[number - 1] == i) {
+                    own++;
+                    own_keysum += number;
+                } else if (reference->flights[reference->booked_flight[number - 1]].booked <=
+                           reference->flights[reference->booked_flight[number - 1]].capacity) {
+                    strays++; // taken from a flight that had room for it
+                }
+            }
+        }
+        moved += size - own;
+        reference_moved += expected->size - (inserter ? expected->capacity : expected->booked);
+
+        if (inserter && (size != expected->capacity || own != expected->capacity)) {
+            printf("Oracle: flight %u should hold %u of its own reservations, found %" PRIu64 " of %" PRIu64 "\n", i,
+                   expected->capacity, own, size);
+            result = 0;
+        } else if (!inserter && (own != expected->booked || own_keysum != expected->booked_keysum)) {
+            printf("Oracle: flight %u should hold all %" PRIu64 " of its own reservations, found %" PRIu64 "\n", i,
+                   expected->booked, own);
+            result = 0;
+        }
+        if (strays > 0) {
+            printf("Oracle: flight %u holds %" PRIu64 " reservations no overflowing flight handed over\n", i, strays);
+            result = 0;
+        }
+    }
+    if (moved != reference_moved) {
+        printf("Oracle: %" PRIu64 " reservations were redistributed, the reference redistributed %" PRIu64 "\n", moved,
+               reference_moved);
+        result = 0;
+    }
+    if (result) {
+        printf("Oracle: final per-flight contents agree with the sequential reference (%" PRIu64
+               " reservations redistributed)\n", moved);
+    }
+    return result;
+}
+
+void reference_destroy(struct reference *reference) {
+    if (reference->flights != NULL) {
+        for (unsigned int i = 0; i < reference->num_flights; i++) {
+            free(reference->flights[i].stack);
+            free(reference->flights[i].queue);
+        }
+    }
+    free(reference->flights);
+    free(reference->center);
+    free(reference->booked_flight);
+}
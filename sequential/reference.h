@@ -0,0 +1,85 @@
+#ifndef HY486_PROJECT_REFERENCE_H
+#define HY486_PROJECT_REFERENCE_H
+
+#include <stdint.h>
+#include "../common/keysum.h"
+#include "../common/reservations.h"
+#include "../workload/workload.h"
+
+/**
+ * A flight of the sequential reference, with a plain array for its stack and its queue
+ */
+struct reference_flight {
+    struct Reservation *stack;
+    unsigned int capacity;
+    unsigned int size;
+    struct Reservation *queue;
+    uint64_t queue_head; // next reservation to dequeue
+    uint64_t queue_tail; // where the next reservation is enqueued
+    uint64_t queue_capacity; // grown by doubling
+    uint64_t booked; // reservations the agencies booked for the flight in phase 1
+    keysum_t booked_keysum;
+};
+
+/**
+ * A single-threaded run of both phases over plain arrays, as a baseline for the concurrent run
+ * and an oracle for its final per-flight contents
+ */
+struct reference {
+    struct reference_flight *flights;
+    unsigned int num_flights;
+    unsigned int num_agencies;
+    struct Reservation *center; // sorted by reservation number, elements center_head..center_tail-1
+    uint64_t center_head;
+    uint64_t center_tail;
+    unsigned int *booked_flight; // the flight reservation number n was booked for, at n - 1
+    uint64_t total; // reservations booked, i.e. A^3
+    double phase_1_seconds;
+    double phase_2_seconds;
+};
+
+/**
+ * @param capacities The stack capacity of every flight
+ * @return 1 if successful, 0 if out of memory
+ */
+int reference_init(struct reference *reference, unsigned int num_flights, const unsigned int *capacities);
+
+/**
+ * Phase 1 on a single thread. Agency 1 to A^2 in turn books the same reservations as agency_main,
+ * i*A^2 + agency_id for i < A on its home flight or the one the workload picks, pushing them while the
+ * flight's stack has room and enqueueing them otherwise.
+ * @param workload The agencies' workload, NULL for the fixed mapping
+ * @return 1 if successful, 0 if out of memory
+ */
+int reference_run_phase_1(struct reference *reference, const struct workload *workload);
+
+/**
+ * Phase 2 on a single thread. As in airline_main, every airline with pending reservations drains its
+ * queue into a sorted array standing in for the center, after which every airline with room left takes
+ * the lowest reservations from it until its stack is full or the center is empty.
+ * @return 1 if successful, 0 if out of memory
+ */
+int reference_run_phase_2(struct reference *reference);
+
+/**
+ * Runs the controller's checks on the reference, the phase 2 ones if phase 2 has run
+ * @param expected_keysum The sum of all reservation numbers
+ * @return 1 if they all passed, 0 otherwise
+ */
+int reference_check(const struct reference *reference, int phase_2, keysum_t expected_keysum);
+
+/**
+ * @brief Compares the final per-flight contents of a concurrent run with the reference.
+ *
+ * Which reservations a flight ends up with depends on the interleaving, so only what every correct run
+ * agrees on is compared: a flight booked beyond its capacity keeps a full stack of its own reservations,
+ * every other flight keeps all of its own reservations (the same set as in the reference), and the
+ * reservations it took on top of those were all booked for overflowing flights, as many in total as in
+ * the reference. The concurrent flights must be quiescent.
+ * @return 1 if the contents agree, 0 otherwise
+ */
+int reference_compare(const struct reference *reference, struct flight_reservations **flights);
+
+void reference_destroy(struct reference *reference);
+
+#endif //HY486_PROJECT_REFERENCE_H
@@ -0,0 +1,136 @@
+#include "service.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @return The resident set size of the process in bytes, 0 if it can't be read
+ */
+static uint64_t resident_bytes(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) {
+        return 0;
+    }
+    unsigned long size, resident;
+    int read = fscanf(statm, "%lu %lu", &size, &resident);
+    fclose(statm);
+    return read == 2 ? (uint64_t) resident * (uint64_t) sysconf(_SC_PAGESIZE) : 0;
+}
+
+static struct service_counters *create_counters(unsigned int count) {
+    struct service_counters *counters = aligned_alloc(_Alignof(struct service_counters),
+                                                      sizeof(struct service_counters) * count);
+    if (counters == NULL) {
+        return NULL;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        atomic_init(&counters[i].booked, 0);
+        atomic_init(&counters[i].latency_ns, 0);
+        atomic_init(&counters[i].max_latency_ns, 0);
+        atomic_init(&counters[i].released, 0);
+    }
+    return counters;
+}
+
+int service_init(struct service *service, double duration, unsigned int interval_ms, uint64_t backlog_limit,
+                 unsigned int numOfAgencies, unsigned int numOfAirlines) {
+    service->duration = duration;
+    service->interval_ms = interval_ms;
+    service->backlog_limit = backlog_limit;
+    service->num_agencies = numOfAgencies;
+    service->num_airlines = numOfAirlines;
+    service->agencies = create_counters(numOfAgencies);
+    service->airlines = create_counters(numOfAirlines);
+    if (service->agencies == NULL || service->airlines == NULL) {
+        free(service->agencies);
+        free(service->airlines);
+        return 0;
+    }
+    atomic_init(&service->stop, 0);
+    return 1;
+}
+
+uint64_t service_total_booked(struct service *service) {
+    uint64_t booked = 0;
+    for (unsigned int i = 0; i < service->num_agencies; i++) {
+        booked += atomic_load_explicit(&service->agencies[i].booked, memory_order_relaxed);
+    }
+    return booked;
+}
+
+uint64_t service_total_released(struct service *service) {
+    uint64_t released = 0;
+    for (unsigned int i = 0; i < service->num_airlines; i++) {
+        released += atomic_load_explicit(&service->airlines[i].released, memory_order_relaxed);
+    }
+    return released;
+}
+
+void service_run(struct service *service, const atomic_uint_fast64_t *backlog) {
+    double start = now_seconds();
+    double last = start;
+    uint64_t last_booked = 0, last_released = 0, last_latency_ns = 0;
+    printf("Service running for %.0f s, reporting every %u ms (backlog limit %" PRIu64 ")\n\n",
+           service->duration, service->interval_ms, service->backlog_limit);
+
+    while (1) {
+        double remaining = service->duration - (last - start);
+        double interval = service->interval_ms / 1000.0;
+        if (remaining < interval) interval = remaining;
+        if (interval > 0) {
+            struct timespec ts = {(time_t) interval, (long) ((interval - (time_t) interval) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
+
+        double now = now_seconds();
+        uint64_t booked = 0, latency_ns = 0, max_latency_ns = 0;
+        for (unsigned int i = 0; i < service->num_agencies; i++) {
+            booked += atomic_load_explicit(&service->agencies[i].booked, memory_order_relaxed);
+            latency_ns += atomic_load_explicit(&service->agencies[i].latency_ns, memory_order_relaxed);
+            uint64_t max = atomic_exchange_explicit(&service->agencies[i].max_latency_ns, 0, memory_order_relaxed);
+            if (max > max_latency_ns) max_latency_ns = max;
+        }
+        uint64_t released = service_total_released(service);
+        uint64_t interval_booked = booked - last_booked;
+        double avg_latency_us = interval_booked > 0 ? (double) (latency_ns - last_latency_ns) / interval_booked / 1e3 : 0;
+
+        printf("[%8.1f s] booked %10.0f/s  released %10.0f/s  latency avg %8.2f us  max %9.2f us  "
+               "backlog %8" PRIu64 "  rss %8.1f MiB\n",
+               now - start, interval_booked / (now - last), (released - last_released) / (now - last),
+               avg_latency_us, max_latency_ns / 1e3,
+               (uint64_t) atomic_load_explicit(backlog, memory_order_relaxed), resident_bytes() / 1048576.0);
+        fflush(stdout);
+
+        last = now;
+        last_booked = booked;
+        last_released = released;
+        last_latency_ns = latency_ns;
+        if (now - start >= service->duration) break;
+    }
+    atomic_store_explicit(&service->stop, 1, memory_order_release);
+}
+
+void service_print_summary(struct service *service, double elapsed) {
+    uint64_t booked = service_total_booked(service);
+    uint64_t latency_ns = 0;
+    for (unsigned int i = 0; i < service->num_agencies; i++) {
+        latency_ns += atomic_load_explicit(&service->agencies[i].latency_ns, memory_order_relaxed);
+    }
+    printf("Service booked %" PRIu64 " and released %" PRIu64 " reservations in %.3f s "
+           "(%.0f reservations/s, average booking latency %.2f us)\n",
+           booked, service_total_released(service), elapsed, booked / elapsed,
+           booked > 0 ? (double) latency_ns / booked / 1e3 : 0);
+}
+
+void service_destroy(struct service *service) {
+    free(service->agencies);
+    free(service->airlines);
+}
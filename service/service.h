@@ -0,0 +1,85 @@
+#ifndef HY486_PROJECT_SERVICE_H
+#define HY486_PROJECT_SERVICE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Counters of a single agency or airline. Only their owner writes them and the reporter reads
+ * them once per interval, so they sit on their own cache line and are updated without RMWs.
+ */
+struct service_counters {
+    _Alignas(64) atomic_uint_fast64_t booked; // agencies: reservations booked
+    atomic_uint_fast64_t latency_ns; // agencies: total time spent in book_reservation
+    atomic_uint_fast64_t max_latency_ns; // agencies: slowest booking since the reporter last reset it
+    atomic_uint_fast64_t released; // airlines: completed seats released back to capacity
+};
+
+/**
+ * @brief Long-running service mode.
+ *
+ * Agencies keep booking until the configured duration has elapsed, while airlines keep
+ * redistributing overflow and release completed seats back to their flight's capacity.
+ * Memory stays bounded because agencies hold off while the backlog (reservations in the
+ * queues or the center) is at its limit. The reporter prints throughput, booking latency,
+ * backlog and resident memory every interval.
+ */
+struct service {
+    double duration; // seconds
+    unsigned int interval_ms;
+    uint64_t backlog_limit;
+    unsigned int num_agencies;
+    unsigned int num_airlines;
+    struct service_counters *agencies;
+    struct service_counters *airlines;
+    atomic_int stop; // set by the reporter once the duration has elapsed
+};
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int service_init(struct service *service, double duration, unsigned int interval_ms, uint64_t backlog_limit,
+                 unsigned int numOfAgencies, unsigned int numOfAirlines);
+
+static inline int service_stopped(struct service *service) {
+    return atomic_load_explicit(&service->stop, memory_order_acquire);
+}
+
+static inline void service_note_booking(struct service_counters *counters, uint64_t latency_ns) {
+    atomic_store_explicit(&counters->booked,
+                          atomic_load_explicit(&counters->booked, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&counters->latency_ns,
+                          atomic_load_explicit(&counters->latency_ns, memory_order_relaxed) + latency_ns,
+                          memory_order_relaxed);
+    // the reporter resets the maximum, so this one has to be a CAS
+    uint64_t max = atomic_load_explicit(&counters->max_latency_ns, memory_order_relaxed);
+    while (latency_ns > max &&
+           !atomic_compare_exchange_weak_explicit(&counters->max_latency_ns, &max, latency_ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static inline void service_note_release(struct service_counters *counters) {
+    atomic_store_explicit(&counters->released,
+                          atomic_load_explicit(&counters->released, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+/**
+ * Reports every interval until the duration has elapsed, then tells the agencies to stop.
+ * @param backlog The number of reservations currently in the queues or the center
+ */
+void service_run(struct service *service, const atomic_uint_fast64_t *backlog);
+
+uint64_t service_total_booked(struct service *service);
+
+uint64_t service_total_released(struct service *service);
+
+/**
+ * Prints the totals over the whole run
+ * @param elapsed Seconds from the start of the run until every thread finished
+ */
+void service_print_summary(struct service *service, double elapsed);
+
+void service_destroy(struct service *service);
+
+#endif //HY486_PROJECT_SERVICE_H
@@ -0,0 +1,244 @@
+#include "reservation_stats.h"
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/**
+ * Reservations a vector kernel adds up in 64-bit lanes before folding them into the 128-bit sum,
+ * small enough that the lanes can't overflow even with 64-bit reservation numbers below 2^50
+ */
+#define KERNEL_BLOCK 4096
+
+/**
+ * Magnitude from which the 64-bit kernel's lanes could overflow within a block, see KERNEL_BLOCK
+ */
+#define KERNEL_LANE_LIMIT (1ll << 50)
+
+typedef void (*stats_kernel)(struct reservation_stats *stats, const struct Reservation *reservations, size_t count);
+
+static void stats_scalar(struct reservation_stats *stats, const struct Reservation *reservations, size_t count) {
+    keysum_t sum = 0;
+    reservation_number_t min = stats->min, max = stats->max;
+    for (size_t i = 0; i < count; i++) {
+        reservation_number_t number = reservations[i].reservation_number;
+        sum += number;
+        if (number < min) min = number;
+        if (number > max) max = number;
+    }
+    stats->count += count;
+    stats->sum += sum;
+    stats->min = min;
+    stats->max = max;
+}
+
+#ifdef HAVE_X86_SIMD
+#ifndef LARGE_SCALE
+_Static_assert(sizeof(struct Reservation) == 8 && offsetof(struct Reservation, reservation_number) == 4,
+               "the 32-bit kernels expect reservation numbers in the odd 32-bit lanes");
+
+/**
+ * Eight reservations per iteration as two 256-bit loads, where the reservation numbers are the odd
+ * 32-bit lanes. The agency ids are blended out with neutral values for min & max, and the 64-bit
+ * lanes shifted right by 32 (then sign-extended) give the numbers to sum.
+ */
+__attribute__((target("avx2")))
+static void stats_avx2(struct reservation_stats *stats, const struct Reservation *reservations, size_t count) {
+    const int32_t *words = (const int32_t *) reservations;
+    const __m256i highest = _mm256_set1_epi32(INT32_MAX);
+    const __m256i lowest = _mm256_set1_epi32(INT32_MIN);
+    const __m256i sign = _mm256_set1_epi64x(0x80000000ll);
+    __m256i min = highest, max = lowest;
+    keysum_t sum = 0;
+    size_t i = 0;
+    while (i + 8 <= count) {
+        __m256i lanes = _mm256_setzero_si256();
+        size_t block_end = i + KERNEL_BLOCK;
+        for (; i + 8 <= count && i < block_end; i += 8) {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (words + 2 * i));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (words + 2 * i + 8));
+            min = _mm256_min_epi32(min, _mm256_blend_epi32(a, highest, 0x55));
+            min = _mm256_min_epi32(min, _mm256_blend_epi32(b, highest, 0x55));
+            max = _mm256_max_epi32(max, _mm256_blend_epi32(a, lowest, 0x55));
+            max = _mm256_max_epi32(max, _mm256_blend_epi32(b, lowest, 0x55));
+            __m256i numbers_a = _mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(a, 32), sign), sign);
+            __m256i numbers_b = _mm256_sub_epi64(_mm256_xor_si256(_mm256_srli_epi64(b, 32), sign), sign);
+            lanes = _mm256_add_epi64(lanes, _mm256_add_epi64(numbers_a, numbers_b));
+        }
+        int64_t partial[4];
+        _mm256_storeu_si256((__m256i *) partial, lanes);
+        for (int lane = 0; lane < 4; lane++) sum += partial[lane];
+    }
+
+    int32_t mins[8], maxs[8];
+    _mm256_storeu_si256((__m256i *) mins, min);
+    _mm256_storeu_si256((__m256i *) maxs, max);
+    for (int lane = 0; lane < 8; lane++) {
+        if (mins[lane] < stats->min) stats->min = mins[lane];
+        if (maxs[lane] > stats->max) stats->max = maxs[lane];
+    }
+    stats->count += i;
+    stats->sum += sum;
+    stats_scalar(stats, reservations + i, count - i);
+}
+
+/**
+ * Same as the AVX2 kernel, four reservations per iteration in 128-bit registers
+ */
+__attribute__((target("sse4.1")))
+static void stats_sse41(struct reservation_stats *stats, const struct Reservation *reservations, size_t count) {
+    const int32_t *words = (const int32_t *) reservations;
+    const __m128i highest = _mm_set1_epi32(INT32_MAX);
+    const __m128i lowest = _mm_set1_epi32(INT32_MIN);
+    const __m128i sign = _mm_set1_epi64x(0x80000000ll);
+    __m128i min = highest, max = lowest;
+    keysum_t sum = 0;
+    size_t i = 0;
+    while (i + 4 <= count) {
+        __m128i lanes = _mm_setzero_si128();
+        size_t block_end = i + KERNEL_BLOCK;
+        for (; i + 4 <= count && i < block_end; i += 4) {
+            __m128i a = _mm_loadu_si128((const __m128i *) (words + 2 * i));
+            __m128i b = _mm_loadu_si128((const __m128i *) (words + 2 * i + 4));
+            // 16-bit blend mask 0x33 picks the even 32-bit lanes, i.e. the agency ids
+            min = _mm_min_epi32(min, _mm_blend_epi16(a, highest, 0x33));
+            min = _mm_min_epi32(min, _mm_blend_epi16(b, highest, 0x33));
+            max = _mm_max_epi32(max, _mm_blend_epi16(a, lowest, 0x33));
+            max = _mm_max_epi32(max, _mm_blend_epi16(b, lowest, 0x33));
+            __m128i numbers_a = _mm_sub_epi64(_mm_xor_si128(_mm_srli_epi64(a, 32), sign), sign);
+            __m128i numbers_b = _mm_sub_epi64(_mm_xor_si128(_mm_srli_epi64(b, 32), sign), sign);
+            lanes = _mm_add_epi64(lanes, _mm_add_epi64(numbers_a, numbers_b));
+        }
+        int64_t partial[2];
+        _mm_storeu_si128((__m128i *) partial, lanes);
+        sum += partial[0];
+        sum += partial[1];
+    }
+
+    int32_t mins[4], maxs[4];
+    _mm_storeu_si128((__m128i *) mins, min);
+    _mm_storeu_si128((__m128i *) maxs, max);
+    for (int lane = 0; lane < 4; lane++) {
+        if (mins[lane] < stats->min) stats->min = mins[lane];
+        if (maxs[lane] > stats->max) stats->max = maxs[lane];
+    }
+    stats->count += i;
+    stats->sum += sum;
+    stats_scalar(stats, reservations + i, count - i);
+}
+#else
+_Static_assert(sizeof(struct Reservation) == 16 && offsetof(struct Reservation, reservation_number) == 8,
+               "the 64-bit kernel expects reservation numbers in the odd 64-bit lanes");
+
+/**
+ * Two reservations per 256-bit load, where the reservation numbers are the odd 64-bit lanes and the
+ * even ones hold the agency id and padding. Those are masked to 0 for the sum and blended with neutral
+ * values for min & max, which AVX2 can only compute for 64-bit lanes with a compare and a blend.
+ * Nothing bounds the numbers of a replayed trace, so a block that has seen one beyond KERNEL_LANE_LIMIT
+ * is summed again, with the rest, on the scalar path.
+ */
+__attribute__((target("avx2")))
+static void stats_avx2(struct reservation_stats *stats, const struct Reservation *reservations, size_t count) {
+    const int64_t *words = (const int64_t *) reservations;
+    const __m256i numbers_only = _mm256_set_epi64x(-1, 0, -1, 0);
+    const __m256i highest = _mm256_set1_epi64x(INT64_MAX);
+    const __m256i lowest = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i upper_limit = _mm256_set1_epi64x(KERNEL_LANE_LIMIT - 1);
+    const __m256i lower_limit = _mm256_set1_epi64x(-KERNEL_LANE_LIMIT + 1);
+    __m256i min = highest, max = lowest;
+    keysum_t sum = 0;
+    size_t i = 0;
+    while (i + 4 <= count) {
+        __m256i lanes = _mm256_setzero_si256();
+        size_t block_start = i;
+        size_t block_end = i + KERNEL_BLOCK;
+        for (; i + 4 <= count && i < block_end; i += 4) {
+            __m256i a = _mm256_loadu_si256((const __m256i *) (words + 2 * i));
+            __m256i b = _mm256_loadu_si256((const __m256i *) (words + 2 * i + 4));
+            __m256i low_a = _mm256_blend_epi32(a, highest, 0x33), low_b = _mm256_blend_epi32(b, highest, 0x33);
+            __m256i high_a = _mm256_blend_epi32(a, lowest, 0x33), high_b = _mm256_blend_epi32(b, lowest, 0x33);
+            min = _mm256_blendv_epi8(min, low_a, _mm256_cmpgt_epi64(min, low_a));
+            min = _mm256_blendv_epi8(min, low_b, _mm256_cmpgt_epi64(min, low_b));
+            max = _mm256_blendv_epi8(max, high_a, _mm256_cmpgt_epi64(high_a, max));
+            max = _mm256_blendv_epi8(max, high_b, _mm256_cmpgt_epi64(high_b, max));
+            lanes = _mm256_add_epi64(lanes, _mm256_add_epi64(_mm256_and_si256(a, numbers_only),
+                                                             _mm256_and_si256(b, numbers_only)));
+        }
+        // min & max only grow apart, so checking them covers every number of the block
+        __m256i beyond = _mm256_or_si256(_mm256_cmpgt_epi64(max, upper_limit), _mm256_cmpgt_epi64(lower_limit, min));
+        if (_mm256_movemask_epi8(beyond) != 0) {
+            i = block_start; // the lanes may have wrapped around
+            break;
+        }
+        int64_t partial[4];
+        _mm256_storeu_si256((__m256i *) partial, lanes);
+        for (int lane = 0; lane < 4; lane++) sum += partial[lane];
+    }
+
+    int64_t mins[4], maxs[4];
+    _mm256_storeu_si256((__m256i *) mins, min);
+    _mm256_storeu_si256((__m256i *) maxs, max);
+    for (int lane = 0; lane < 4; lane++) {
+        if (mins[lane] < stats->min) stats->min = mins[lane];
+        if (maxs[lane] > stats->max) stats->max = maxs[lane];
+    }
+    stats->count += i;
+    stats->sum += sum;
+    stats_scalar(stats, reservations + i, count - i);
+}
+#endif
+#endif
+
+static stats_kernel kernel = stats_scalar;
+static const char *kernel_isa = "scalar";
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void pick_kernel(void) {
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = stats_avx2;
+        kernel_isa = "avx2";
+        return;
+    }
+#ifndef LARGE_SCALE
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernel = stats_sse41;
+        kernel_isa = "sse4.1";
+    }
+#endif
+#endif
+}
+
+void reservation_stats_init(struct reservation_stats *stats) {
+    stats->count = 0;
+    stats->sum = 0;
+    stats->min = RESERVATION_NUMBER_MAX;
+    stats->max = RESERVATION_NUMBER_MIN;
+}
+
+void reservation_stats_add(struct reservation_stats *stats, const struct Reservation *reservations, size_t count) {
+    pthread_once(&kernel_once, pick_kernel);
+    kernel(stats, reservations, count);
+}
+
+void reservation_stats_merge(struct reservation_stats *into, const struct reservation_stats *from) {
+    into->count += from->count;
+    into->sum += from->sum;
+    if (from->min < into->min) into->min = from->min;
+    if (from->max > into->max) into->max = from->max;
+}
+
+void agency_histogram_add(uint64_t *histogram, unsigned int num_agencies, const struct Reservation *reservations,
+                          size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        unsigned int id = (unsigned int) reservations[i].agency_id;
+        if (id - 1 < num_agencies) histogram[id - 1]++; // ids 1..num_agencies, 0 wraps around and is skipped
+    }
+}
+
+const char *reservation_stats_isa(void) {
+    pthread_once(&kernel_once, pick_kernel);
+    return kernel_isa;
+}
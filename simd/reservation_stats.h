@@ -0,0 +1,45 @@
+#ifndef HY486_PROJECT_RESERVATION_STATS_H
+#define HY486_PROJECT_RESERVATION_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/keysum.h"
+#include "../common/reservations.h"
+
+/**
+ * Count, sum and range of the reservation numbers of an array of reservations
+ */
+struct reservation_stats {
+    uint64_t count;
+    keysum_t sum;
+    reservation_number_t min; // RESERVATION_NUMBER_MAX while count is 0
+    reservation_number_t max; // RESERVATION_NUMBER_MIN while count is 0
+};
+
+void reservation_stats_init(struct reservation_stats *stats);
+
+/**
+ * @brief Adds an array of reservations to the statistics.
+ *
+ * Runs a vectorized kernel picked once at runtime: AVX2 where the CPU has it, then SSE4.1,
+ * then plain C. The kernels load whole reservations and mask out the agency ids in registers,
+ * so they stream the array at its 8-byte (16-byte under LARGE_SCALE) stride without gathers.
+ * There is no SSE4.1 kernel for 64-bit reservation numbers, which falls back to plain C.
+ */
+void reservation_stats_add(struct reservation_stats *stats, const struct Reservation *reservations, size_t count);
+
+void reservation_stats_merge(struct reservation_stats *into, const struct reservation_stats *from);
+
+/**
+ * Counts the reservations of every agency: histogram[id - 1] for agency ids 1..num_agencies, ids outside
+ * that range are skipped. AVX2 has no conflict-free scatter, so this one is plain C in every build.
+ */
+void agency_histogram_add(uint64_t *histogram, unsigned int num_agencies, const struct Reservation *reservations,
+                          size_t count);
+
+/**
+ * @return The name of the kernels reservation_stats_add runs, "avx2", "sse4.1" or "scalar"
+ */
+const char *reservation_stats_isa(void);
+
+#endif //HY486_PROJECT_RESERVATION_STATS_H
@@ -0,0 +1,213 @@
+#include "snapshot.h"
+#include "../stack/stack.h"
+#include "../queue/queue.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Reservations written to the file per exported chunk of a queue or the center
+ */
+#define SNAPSHOT_CHUNK 4096
+
+int snapshot_save(const char *path, struct flight_reservations **flights, unsigned int numOfFlights,
+                  struct list *management_center) {
+    struct snapshot_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.reservation_size = sizeof(struct Reservation);
+    header.num_flights = numOfFlights;
+
+    struct snapshot_flight *entries = calloc(numOfFlights, sizeof(struct snapshot_flight));
+    if (entries == NULL) {
+        return 0;
+    }
+    uint64_t next = 0;
+    unsigned int largest = SNAPSHOT_CHUNK; // largest stack or export chunk, to size the staging buffer
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        entries[i].capacity = flights[i]->completed_reservations->capacity;
+        entries[i].stack_count = flights[i]->completed_reservations->size;
+        entries[i].queue_count = flights[i]->pending_reservations->size;
+        entries[i].first = next;
+        next += entries[i].stack_count + entries[i].queue_count;
+        if (entries[i].stack_count > largest) largest = entries[i].stack_count;
+    }
+    header.center_first = next;
+    header.center_count = management_center->size;
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *file = fopen(tmp_path, "wb");
+    struct Reservation *staging = malloc(sizeof(struct Reservation) * largest);
+    if (file == NULL || staging == NULL) {
+        perror("snapshot");
+        if (file != NULL) fclose(file);
+        free(staging);
+        free(entries);
+        return 0;
+    }
+
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(entries, sizeof(struct snapshot_flight), numOfFlights, file) == numOfFlights;
+
+    unsigned int count;
+    for (unsigned int i = 0; ok && i < numOfFlights; i++) {
+        // the stack is exported top to bottom, but is stored bottom to top so that it can be pushed back in order
+        struct reservation_cursor stack_cursor = {0};
+        count = exportStack(flights[i]->completed_reservations, &stack_cursor, staging, entries[i].stack_count);
+        for (unsigned int low = 0, high = count; low + 1 < high; low++, high--) {
+            struct Reservation swap = staging[low];
+            staging[low] = staging[high - 1];
+            staging[high - 1] = swap;
+        }
+        ok = fwrite(staging, sizeof(struct Reservation), count, file) == count;
+
+        struct reservation_cursor queue_cursor = {0};
+        while (ok && (count = exportQueue(flights[i]->pending_reservations, &queue_cursor, staging, SNAPSHOT_CHUNK)) > 0) {
+            ok = fwrite(staging, sizeof(struct Reservation), count, file) == count;
+        }
+    }
+    struct reservation_cursor center_cursor = {0};
+    while (ok && (count = exportList(management_center, &center_cursor, staging, SNAPSHOT_CHUNK)) > 0) {
+        ok = fwrite(staging, sizeof(struct Reservation), count, file) == count;
+    }
+
+    ok = ok && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+    free(staging);
+    free(entries);
+
+    if (!ok || rename(tmp_path, path) != 0) {
+        perror("snapshot");
+        unlink(tmp_path);
+        return 0;
+    }
+    return 1;
+}
+
+int snapshot_open(const char *path, struct snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(struct snapshot));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("snapshot");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct snapshot_header)) {
+        fprintf(stderr, "snapshot: %s is too short\n", path);
+        close(fd);
+        return 0;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (mapping == MAP_FAILED) {
+        perror("snapshot mmap");
+        return 0;
+    }
+    snapshot->mapping = mapping;
+    snapshot->length = st.st_size;
+    snapshot->header = (const struct snapshot_header *) mapping;
+
+    const struct snapshot_header *header = snapshot->header;
+    if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0 || header->version != SNAPSHOT_VERSION) {
+        fprintf(stderr, "snapshot: %s is not a version %d snapshot\n", path, SNAPSHOT_VERSION);
+        snapshot_close(snapshot);
+        return 0;
+    }
+    if (header->reservation_size != sizeof(struct Reservation)) {
+        fprintf(stderr, "snapshot: %s was written by a build with %u-byte reservations (this one uses %zu)\n",
+                path, header->reservation_size, sizeof(struct Reservation));
+        snapshot_close(snapshot);
+        return 0;
+    }
+    // every size is computed with overflow checks, since a corrupt header could otherwise wrap them around
+    size_t reservations_offset, expected, count;
+    if (header->num_flights == 0 ||
+        __builtin_mul_overflow((size_t) header->num_flights, sizeof(struct snapshot_flight), &reservations_offset) ||
+        __builtin_add_overflow(reservations_offset, sizeof(struct snapshot_header), &reservations_offset) ||
+        __builtin_add_overflow(header->center_first, header->center_count, &count) ||
+        __builtin_mul_overflow(count, sizeof(struct Reservation), &expected) ||
+        __builtin_add_overflow(expected, reservations_offset, &expected) || snapshot->length != expected) {
+        fprintf(stderr, "snapshot: %s is truncated or corrupt (%zu bytes)\n", path, snapshot->length);
+        snapshot_close(snapshot);
+        return 0;
+    }
+    snapshot->flights = (const struct snapshot_flight *) ((const char *) mapping + sizeof(struct snapshot_header));
+    snapshot->reservations = (const struct Reservation *) ((const char *) mapping + reservations_offset);
+
+    // the flights' reservations must follow each other without gaps or overlaps up to the center's,
+    // and no stack may hold more than its capacity, so that restoring never reads or pushes out of bounds.
+    // Reservations only wait in a queue once its stack is full, so no run leaves a queue next to a free seat
+    uint64_t next = 0;
+    for (uint32_t i = 0; i < header->num_flights; i++) {
+        const struct snapshot_flight *entry = &snapshot->flights[i];
+        if (entry->first != next || entry->stack_count > entry->capacity ||
+            (entry->queue_count > 0 && entry->stack_count != entry->capacity) ||
+            entry->stack_count + (uint64_t) entry->queue_count > header->center_first - next) {
+            fprintf(stderr, "snapshot: %s has a corrupt entry for flight %u\n", path, i);
+            snapshot_close(snapshot);
+            return 0;
+        }
+        next += entry->stack_count + (uint64_t) entry->queue_count;
+    }
+    if (next != header->center_first) {
+        fprintf(stderr, "snapshot: %s has reservations that belong to no flight\n", path);
+        snapshot_close(snapshot);
+        return 0;
+    }
+
+    // -1 is the empty sentinel of pop, dequeue & deleteAndGet, and the center is restored with
+    // appendSortedBulk, which needs strictly increasing numbers to keep the list's invariants
+    for (uint64_t r = 0; r < header->center_first + header->center_count; r++) {
+        const struct Reservation *reservation = &snapshot->reservations[r];
+        const char *problem = NULL;
+        if (reservation->reservation_number == -1) {
+            problem = "reservation number -1, which marks an empty queue or list";
+        } else if (r > header->center_first && reservation->reservation_number <= reservation[-1].reservation_number) {
+            problem = "a management center that isn't strictly ascending";
+        }
+        if (problem != NULL) {
+            fprintf(stderr, "snapshot: reservation %" PRIu64 " of %s has %s\n", r, path, problem);
+            snapshot_close(snapshot);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+unsigned int snapshot_flight_capacity(struct snapshot *snapshot, unsigned int flight) {
+    return snapshot->flights[flight].capacity;
+}
+
+void snapshot_restore_flight(struct snapshot *snapshot, unsigned int flight, struct flight_reservations *restored) {
+    const struct snapshot_flight *entry = &snapshot->flights[flight];
+    const struct Reservation *reservations = snapshot->reservations + entry->first;
+    pushBulk(restored->completed_reservations, reservations, entry->stack_count);
+    enqueueBulk(restored->pending_reservations, reservations + entry->stack_count, entry->queue_count);
+}
+
+void snapshot_restore_center(struct snapshot *snapshot, struct list *management_center) {
+    appendSortedBulk(management_center, snapshot->reservations + snapshot->header->center_first,
+                     snapshot->header->center_count);
+}
+
+void snapshot_totals(struct snapshot *snapshot, uint64_t *count, keysum_t *keysum) {
+    *count = snapshot->header->center_first + snapshot->header->center_count;
+    *keysum = 0;
+    for (uint64_t i = 0; i < *count; i++) {
+        *keysum += snapshot->reservations[i].reservation_number;
+    }
+}
+
+void snapshot_close(struct snapshot *snapshot) {
+    if (snapshot->mapping != NULL) {
+        munmap(snapshot->mapping, snapshot->length);
+    }
+    memset(snapshot, 0, sizeof(struct snapshot));
+}
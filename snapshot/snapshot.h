@@ -0,0 +1,85 @@
+#ifndef HY486_PROJECT_SNAPSHOT_H
+#define HY486_PROJECT_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/keysum.h"
+#include "../common/reservations.h"
+#include "../list/lazy_list.h"
+
+#define SNAPSHOT_MAGIC "HYSNAP\0\0"
+#define SNAPSHOT_VERSION 1
+
+/**
+ * A snapshot file is laid out as:
+ * - the header
+ * - one snapshot_flight entry per flight
+ * - every flight's stack reservations (bottom to top) followed by its queue reservations (head to tail)
+ * - the management center's reservations (in ascending order)
+ */
+struct snapshot_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reservation_size; // sizeof(struct Reservation), differs between LARGE_SCALE and regular builds
+    uint32_t num_flights;
+    uint32_t reserved;
+    uint64_t center_count;
+    uint64_t center_first; // index of the center's first reservation
+};
+
+struct snapshot_flight {
+    uint32_t capacity;
+    uint32_t stack_count;
+    uint32_t queue_count;
+    uint32_t reserved;
+    uint64_t first; // index of the flight's first reservation
+};
+
+/**
+ * A snapshot file mapped in memory
+ */
+struct snapshot {
+    void *mapping;
+    size_t length;
+    const struct snapshot_header *header;
+    const struct snapshot_flight *flights;
+    const struct Reservation *reservations;
+};
+
+/**
+ * Writes the flights table and the center to the given path. The structures must be
+ * quiescent, e.g. between the two phases. The file is written under a temporary name
+ * and renamed once synced, so an existing snapshot is never left half-written.
+ * @return 1 if successful, 0 otherwise
+ */
+int snapshot_save(const char *path, struct flight_reservations **flights, unsigned int numOfFlights,
+                  struct list *management_center);
+
+/**
+ * Maps and validates a snapshot file.
+ * @return 1 if successful, 0 otherwise
+ */
+int snapshot_open(const char *path, struct snapshot *snapshot);
+
+/**
+ * @return The stack capacity the flight was saved with
+ */
+unsigned int snapshot_flight_capacity(struct snapshot *snapshot, unsigned int flight);
+
+/**
+ * Bulk-loads the stack & queue of a flight from the snapshot. They must be empty and
+ * the stack created with snapshot_flight_capacity seats.
+ */
+void snapshot_restore_flight(struct snapshot *snapshot, unsigned int flight, struct flight_reservations *restored);
+
+void snapshot_restore_center(struct snapshot *snapshot, struct list *management_center);
+
+/**
+ * Counts and sums the reservations held by the snapshot. Snapshots are only written once the
+ * phase 1 checks pass, so these are what the checks should expect after a restart.
+ */
+void snapshot_totals(struct snapshot *snapshot, uint64_t *count, keysum_t *keysum);
+
+void snapshot_close(struct snapshot *snapshot);
+
+#endif //HY486_PROJECT_SNAPSHOT_H
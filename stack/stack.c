@@ -3,21 +3,33 @@
 //
 
 #include "stack.h"
+#include "../latency/latency.h"
+#include "../contention/contention.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 struct stack *createStack(unsigned int capacity) {
-    struct stack *newStack = (struct stack *) malloc(sizeof(struct stack));
+    // aligned_alloc, since a CACHE_LAYOUT stack is aligned to a cache line
+    struct stack *newStack = (struct stack *) aligned_alloc(_Alignof(struct stack), sizeof(struct stack));
     if (newStack == NULL) {
         return NULL;
     }
-    newStack->top = NULL;
-    pthread_mutex_init(&(newStack->top_lock), NULL);
-    newStack->size = 0;
-    newStack->capacity = capacity;
+    initStack(newStack, capacity);
     return newStack;
 }
 
+void initStack(struct stack *stack, unsigned int capacity) {
+    stack->top = NULL;
+    pthread_mutex_init(&(stack->top_lock), NULL);
+    stack->size = 0;
+    stack->reserved = 0;
+    stack->removals = 0;
+    stack->capacity = capacity;
+#ifdef UNROLLED_NODES
+    stack->spare = NULL;
+#endif
+}
+
 bool isStackFull(struct stack *stack) {
     return stack->size == stack->capacity;
 }
@@ -26,57 +38,202 @@ bool hasStackOverflowed(struct stack *stack) {
     return stack->size > stack->capacity;
 }
 
-void push(struct stack *stack, struct Reservation reservation) {
-    if (stack->size == stack->capacity) {
+unsigned int reserveSeats(struct stack *stack, unsigned int count) {
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    unsigned int freeSeats = stack->capacity - stack->size - stack->reserved;
+    if (count > freeSeats) {
+        count = freeSeats;
+    }
+    stack->reserved += count;
+    pthread_mutex_unlock(&(stack->top_lock));
+    return count;
+}
+
+void releaseSeats(struct stack *stack, unsigned int count) {
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    stack->reserved -= count;
+    pthread_mutex_unlock(&(stack->top_lock));
+}
+
+void destroyStack(struct stack *stack) {
+    if (stack == NULL) {
         return;
     }
+    finalizeStack(stack);
+    free(stack);
+}
+
+bool push(struct stack *stack, struct Reservation reservation) {
+    unsigned int size;
+    return pushSized(stack, reservation, &size);
+}
+
+#ifndef UNROLLED_NODES
+// the unrolled variant of the functions below is in unrolled_stack.c
+
+bool pushSized(struct stack *stack, struct Reservation reservation, unsigned int *size) {
+    LATENCY_START();
+    if (stack->size + stack->reserved >= stack->capacity) {
+        LATENCY_STOP(LATENCY_PUSH);
+        return false;
+    }
 
     // create thew new reservation
     struct stack_reservation *newNode = (struct stack_reservation *) malloc(sizeof(struct stack_reservation));
     if (newNode == NULL) {
-        return;
+        LATENCY_STOP(LATENCY_PUSH);
+        return false;
     }
     newNode->reservation = reservation;
-    newNode->next = stack->top;
 
     // Lock the stack before modifying it
-    pthread_mutex_lock(&(stack->top_lock));
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    // another pusher may have filled the stack (or moved top) since the unlocked check above
+    if (stack->size + stack->reserved >= stack->capacity) {
+        pthread_mutex_unlock(&(stack->top_lock));
+        free(newNode);
+        LATENCY_STOP(LATENCY_PUSH);
+        return false;
+    }
+    newNode->next = stack->top;
     stack->top = newNode;
-    stack->size += 1;
+    *size = ++stack->size;
     pthread_mutex_unlock(&(stack->top_lock));
+    LATENCY_STOP(LATENCY_PUSH);
+    return true;
 }
 
-struct Reservation pop(struct stack *stack) {
-    if (stack->top == NULL) {
-        // Handle empty stack
-        printf("Could not retrieve reservation from stack. Stack is empty!");
-        return (struct Reservation) {0}; // Or a placeholder for empty reservation
+/**
+ * Links the reservations into a chain bottom-up, exactly like pushing each one would, and
+ * splices it on top with a single lock acquisition.
+ * @param fromReserved Whether the reservations take seats previously claimed with reserveSeats
+ * @return The number of reservations pushed, less than count only if allocation failed or,
+ * unless fromReserved, the stack filled up meanwhile
+ */
+static unsigned int spliceChain(struct stack *stack, const struct Reservation *reservations, unsigned int count,
+                                bool fromReserved) {
+    struct stack_reservation *chainTop = NULL;
+    struct stack_reservation *chainBottom = NULL;
+    unsigned int built = 0;
+    for (; built < count; built++) {
+        struct stack_reservation *newNode = (struct stack_reservation *) malloc(sizeof(struct stack_reservation));
+        if (newNode == NULL) {
+            break;
+        }
+        newNode->reservation = reservations[built];
+        newNode->next = chainTop;
+        if (chainBottom == NULL) {
+            chainBottom = newNode;
+        }
+        chainTop = newNode;
     }
 
+    struct stack_reservation *surplus = NULL;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    if (!fromReserved) {
+        // concurrent pushes may have taken seats since the caller checked, drop the latest reservations like push would
+        unsigned int freeSeats = stack->capacity - stack->size - stack->reserved;
+        for (; built > freeSeats; built--) {
+            struct stack_reservation *dropped = chainTop;
+            chainTop = chainTop->next;
+            dropped->next = surplus;
+            surplus = dropped;
+        }
+    }
+    if (built > 0) {
+        chainBottom->next = stack->top;
+        stack->top = chainTop;
+        stack->size += built;
+    }
+    if (fromReserved) {
+        stack->reserved -= count; // seats that could not be filled are given back
+    }
+    pthread_mutex_unlock(&(stack->top_lock));
+    while (surplus != NULL) {
+        struct stack_reservation *next = surplus->next;
+        free(surplus);
+        surplus = next;
+    }
+    return built;
+}
+
+unsigned int pushBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count) {
+    // read without the lock, only so that no more nodes are built than could fit, the splice checks again
+    if (count > stack->capacity - stack->size - stack->reserved) {
+        count = stack->capacity - stack->size - stack->reserved;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return spliceChain(stack, reservations, count, false);
+}
+
+unsigned int pushReservedBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count) {
+    if (count == 0) {
+        return 0;
+    }
+    return spliceChain(stack, reservations, count, true);
+}
+
+struct Reservation pop(struct stack *stack) {
+    LATENCY_START();
     // Lock the stack before modifying it
-    pthread_mutex_lock(&(stack->top_lock));
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    // checked under the lock, since a concurrent pop may take the last reservation
+    if (stack->top == NULL) {
+        pthread_mutex_unlock(&(stack->top_lock));
+        CONTENTION_COUNT(CONTENTION_STACK, empty_polls);
+        LATENCY_STOP(LATENCY_POP);
+        return (struct Reservation) {-1, -1};
+    }
     struct stack_reservation *temp = stack->top;
     struct Reservation reservation = temp->reservation;
     stack->top = temp->next;
     stack->size -= 1;
+    stack->removals++;
     free(temp);
     pthread_mutex_unlock(&(stack->top_lock));
+    LATENCY_STOP(LATENCY_POP);
 
     return reservation;
 }
 
-void destroyStack(struct stack *stack) {
-    if (stack == NULL) {
-        return;
+unsigned int forEachInStack(struct stack *stack, reservation_visitor visit, void *context) {
+    unsigned int visited = 0;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    for (struct stack_reservation *node = stack->top; node != NULL; node = node->next) {
+        visited++;
+        if (!visit(&node->reservation, context)) break;
     }
+    pthread_mutex_unlock(&(stack->top_lock));
+    return visited;
+}
 
+unsigned int exportStack(struct stack *stack, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max) {
+    unsigned int copied = 0;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    check_cursor(cursor, stack->removals, "exportStack");
+    const struct stack_reservation *node = cursor->started ? cursor->node : stack->top;
+    for (; node != NULL && copied < max; node = node->next) {
+        out[copied++] = node->reservation;
+    }
+    cursor->removals = stack->removals;
+    pthread_mutex_unlock(&(stack->top_lock));
+    cursor->node = node;
+    cursor->started = 1;
+    return copied;
+}
+
+void finalizeStack(struct stack *stack) {
     // Lock the stack before destroying elements
-    pthread_mutex_lock(&(stack->top_lock));
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
     while (stack->top != NULL) {
         struct stack_reservation *temp = stack->top;
         stack->top = temp->next;
         free(temp);
     }
     pthread_mutex_destroy(&(stack->top_lock));
-    free(stack);
-}
\ No newline at end of file
+}
+
+#endif
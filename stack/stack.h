@@ -8,7 +8,23 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include "../common/reservations.h"
+#include "../layout/layout.h"
 
+#ifdef UNROLLED_NODES
+/**
+ * Reservations per node of the unrolled stack
+ */
+#define STACK_BLOCK_RESERVATIONS 32
+
+/**
+ * A block of flight reservations, filled from index 0 up, so that the last one is on top
+ */
+struct stack_block {
+    struct stack_block *next; // the block below
+    unsigned int count; // never 0 while the block is on the stack
+    struct Reservation reservations[STACK_BLOCK_RESERVATIONS];
+};
+#else
 /**
  * A flight reservations
  */
@@ -16,28 +32,119 @@ struct stack_reservation {
     struct Reservation reservation;
     struct stack_reservation *next;
 };
+#endif
 
 /**
  * @brief A coarsed-grained lock-based stack for storing flight reservations
  *
+ * With CACHE_LAYOUT the lock and everything it guards share one cache line, apart from the
+ * read-mostly capacity, so that a push or pop only pulls a single line.
+ * With UNROLLED_NODES (stack/unrolled_stack.c) each node holds a block of reservations instead of one,
+ * so a block is only allocated or freed every STACK_BLOCK_RESERVATIONS pushes or pops.
  */
 struct stack {
+    unsigned int capacity; // maximum number of reservations that can be stored in the stack, read-mostly
+    // written together under top_lock
+    HOT_FIELD pthread_mutex_t top_lock;
+#ifdef UNROLLED_NODES
+    struct stack_block *top;
+    struct stack_block *spare; // an emptied block kept for the next push, so a push & pop at a boundary don't malloc & free
+#else
     struct stack_reservation *top;
-    pthread_mutex_t top_lock;
+#endif
     unsigned int size; // number of reservations currently stored in the stack
-    unsigned int capacity; // maximum number of reservations that can be stored in the stack
+    unsigned int reserved; // free seats promised to pending transfers, plain pushes can't take them
+    unsigned long removals; // pops so far, so that a walk can tell its cursor is stale
 };
 
 struct stack *createStack(unsigned int capacity);
 
+/**
+ * Initializes a stack in memory the caller owns, e.g. a slot of the flights table
+ */
+void initStack(struct stack *stack, unsigned int capacity);
+
 bool isStackFull(struct stack *stack);
 
 bool hasStackOverflowed(struct stack *stack);
 
-void push(struct stack *stack, struct Reservation reservation);
+/**
+ * @return false if the stack was full (or the node could not be allocated), in which case nothing is pushed
+ */
+bool push(struct stack *stack, struct Reservation reservation);
+
+/**
+ * Like push, but also reports the stack's size right after the push, read under the lock
+ * @param size Set to the size including the pushed reservation, only if it was pushed
+ */
+bool pushSized(struct stack *stack, struct Reservation reservation, unsigned int *size);
+
+/**
+ * Pushes the given reservations as if push was called for each of them in order, so
+ * the last one ends up on top, with a single acquisition of the lock, under which the free seats
+ * are checked again, so concurrent pushes can't overfill the stack. The linked stack links its
+ * nodes together before taking the lock, the unrolled one tops up its top block first and only
+ * takes a block every STACK_BLOCK_RESERVATIONS reservations after that. Reservations beyond the
+ * capacity are dropped.
+ * @return The number of reservations pushed
+ */
+unsigned int pushBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count);
+
+/**
+ * Atomically claims up to count free seats, which only pushReservedBulk can then fill.
+ * @return The number of seats claimed
+ */
+unsigned int reserveSeats(struct stack *stack, unsigned int count);
+
+/**
+ * Gives back count seats claimed with reserveSeats that will never be filled.
+ */
+void releaseSeats(struct stack *stack, unsigned int count);
+
+/**
+ * Like pushBulk, but fills seats previously claimed with reserveSeats, so it never runs out of
+ * capacity. Claimed seats are released even if some nodes could not be allocated.
+ * @return The number of reservations pushed
+ */
+unsigned int pushReservedBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count);
 
+/**
+ * @return The reservation on top, or one numbered -1 if the stack is empty (like dequeue & deleteAndGet)
+ */
 struct Reservation pop(struct stack *stack);
 
+/**
+ * Calls visit for every reservation, from top to bottom, while holding the stack's lock.
+ * @return The number of reservations visited
+ */
+unsigned int forEachInStack(struct stack *stack, reservation_visitor visit, void *context);
+
+/**
+ * Copies up to max reservations, from top to bottom, into out, continuing where the cursor left off.
+ * Each chunk is copied under the lock, so that the caller can work on flat memory outside of it,
+ * but nothing may be popped between the chunks of one export (see check_cursor). Pushes between
+ * chunks are allowed and not exported: the unrolled stack's cursor counts its block's remaining
+ * reservations from the bottom, so those landing in the cursor's block don't shift it.
+ * @return The number of reservations copied, 0 once every reservation has been exported
+ */
+unsigned int exportStack(struct stack *stack, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max);
+
+#ifdef UNROLLED_NODES
+/**
+ * Hands out the next block of reservations, bottom to top within the block, without copying. Only
+ * the unrolled stack keeps its reservations in arrays, the linked one is read with exportStack.
+ * The stack must be quiescent while its spans are in use (see check_cursor).
+ * @return 1 if a span was handed out, 0 once the stack has been exhausted
+ */
+int nextStackSpan(struct stack *stack, struct reservation_cursor *cursor, struct reservation_span *span);
+#endif
+
 void destroyStack(struct stack *stack);
 
+/**
+ * Frees the nodes of a stack initialized with initStack, but not the stack itself
+ */
+void finalizeStack(struct stack *stack);
+
 #endif //HY486_PROJECT_STACK_H
@@ -0,0 +1,219 @@
+#include "stack.h"
+#include "../latency/latency.h"
+#include "../contention/contention.h"
+#include <stdlib.h>
+
+#ifdef UNROLLED_NODES
+
+/**
+ * Takes the spare block, or allocates one. Must be called with the stack's lock held.
+ * @return NULL if no block could be allocated
+ */
+static struct stack_block *take_block(struct stack *stack) {
+    struct stack_block *block = stack->spare;
+    if (block != NULL) {
+        stack->spare = NULL;
+    } else {
+        block = (struct stack_block *) malloc(sizeof(struct stack_block));
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+    block->count = 0;
+    return block;
+}
+
+bool pushSized(struct stack *stack, struct Reservation reservation, unsigned int *size) {
+    LATENCY_START();
+    if (stack->size + stack->reserved >= stack->capacity) {
+        LATENCY_STOP(LATENCY_PUSH);
+        return false;
+    }
+
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    // another pusher may have filled the stack (or moved top) since the unlocked check above
+    if (stack->size + stack->reserved >= stack->capacity) {
+        pthread_mutex_unlock(&(stack->top_lock));
+        LATENCY_STOP(LATENCY_PUSH);
+        return false;
+    }
+    struct stack_block *top = stack->top;
+    if (top == NULL || top->count == STACK_BLOCK_RESERVATIONS) {
+        // only every STACK_BLOCK_RESERVATIONS pushes, so allocating under the lock is rare
+        struct stack_block *block = take_block(stack);
+        if (block == NULL) {
+            pthread_mutex_unlock(&(stack->top_lock));
+            LATENCY_STOP(LATENCY_PUSH);
+            return false;
+        }
+        block->next = top;
+        stack->top = top = block;
+    }
+    top->reservations[top->count++] = reservation;
+    *size = ++stack->size;
+    pthread_mutex_unlock(&(stack->top_lock));
+    LATENCY_STOP(LATENCY_PUSH);
+    return true;
+}
+
+/**
+ * Pushes the reservations in order under a single lock acquisition, exactly like pushing each one
+ * would: the free slots of the top block are filled first, and a block is only taken (the spare one,
+ * or a new one) every STACK_BLOCK_RESERVATIONS reservations after that, as push takes them.
+ * @param fromReserved Whether the reservations take seats previously claimed with reserveSeats
+ * @return The number of reservations pushed, less than count only if allocation failed or,
+ * unless fromReserved, the stack filled up meanwhile
+ */
+static unsigned int spliceBlocks(struct stack *stack, const struct Reservation *reservations, unsigned int count,
+                                 bool fromReserved) {
+    unsigned int claimed = count;
+    unsigned int pushed = 0;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    if (!fromReserved) {
+        // concurrent pushes may have taken seats since the caller checked, drop the latest reservations like push would
+        unsigned int freeSeats = stack->capacity - stack->size - stack->reserved;
+        if (count > freeSeats) {
+            count = freeSeats;
+        }
+    }
+    struct stack_block *top = stack->top;
+    while (pushed < count) {
+        if (top == NULL || top->count == STACK_BLOCK_RESERVATIONS) {
+            struct stack_block *block = take_block(stack);
+            if (block == NULL) {
+                break;
+            }
+            block->next = top;
+            stack->top = top = block;
+        }
+        unsigned int room = STACK_BLOCK_RESERVATIONS - top->count;
+        unsigned int fill = count - pushed < room ? count - pushed : room;
+        for (unsigned int i = 0; i < fill; i++) {
+            top->reservations[top->count + i] = reservations[pushed + i];
+        }
+        top->count += fill;
+        pushed += fill;
+    }
+    stack->size += pushed;
+    if (fromReserved) {
+        stack->reserved -= claimed; // seats that could not be filled are given back
+    }
+    pthread_mutex_unlock(&(stack->top_lock));
+    return pushed;
+}
+
+unsigned int pushBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count) {
+    if (count == 0) {
+        return 0;
+    }
+    return spliceBlocks(stack, reservations, count, false);
+}
+
+unsigned int pushReservedBulk(struct stack *stack, const struct Reservation *reservations, unsigned int count) {
+    if (count == 0) {
+        return 0;
+    }
+    return spliceBlocks(stack, reservations, count, true);
+}
+
+struct Reservation pop(struct stack *stack) {
+    LATENCY_START();
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    // checked under the lock, since a concurrent pop may take the last reservation
+    struct stack_block *top = stack->top;
+    if (top == NULL) {
+        pthread_mutex_unlock(&(stack->top_lock));
+        CONTENTION_COUNT(CONTENTION_STACK, empty_polls);
+        LATENCY_STOP(LATENCY_POP);
+        return (struct Reservation) {-1, -1};
+    }
+    struct Reservation reservation = top->reservations[--top->count];
+    stack->size -= 1;
+    stack->removals++;
+    struct stack_block *emptied = NULL;
+    if (top->count == 0) {
+        stack->top = top->next;
+        // keep one empty block around, so that pushing right after doesn't allocate again
+        if (stack->spare == NULL) {
+            stack->spare = top;
+        } else {
+            emptied = top;
+        }
+    }
+    pthread_mutex_unlock(&(stack->top_lock));
+    free(emptied);
+    LATENCY_STOP(LATENCY_POP);
+
+    return reservation;
+}
+
+unsigned int forEachInStack(struct stack *stack, reservation_visitor visit, void *context) {
+    unsigned int visited = 0;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    for (struct stack_block *block = stack->top; block != NULL; block = block->next) {
+        for (unsigned int i = block->count; i-- > 0;) {
+            visited++;
+            if (!visit(&block->reservations[i], context)) {
+                pthread_mutex_unlock(&(stack->top_lock));
+                return visited;
+            }
+        }
+    }
+    pthread_mutex_unlock(&(stack->top_lock));
+    return visited;
+}
+
+unsigned int exportStack(struct stack *stack, struct reservation_cursor *cursor, struct Reservation *out,
+                         unsigned int max) {
+    unsigned int copied = 0;
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    check_cursor(cursor, stack->removals, "exportStack");
+    const struct stack_block *block = cursor->started ? cursor->node : stack->top;
+    // the block's reservations still to copy, counted from its bottom, so that pushes landing on
+    // top of it between two chunks don't shift the ones already exported
+    unsigned int remaining = cursor->started ? cursor->offset : (block != NULL ? block->count : 0);
+    while (block != NULL && copied < max) {
+        unsigned int take = remaining < max - copied ? remaining : max - copied;
+        for (unsigned int i = 0; i < take; i++) {
+            out[copied++] = block->reservations[--remaining];
+        }
+        if (remaining == 0) {
+            block = block->next;
+            remaining = block != NULL ? block->count : 0;
+        }
+    }
+    cursor->removals = stack->removals;
+    pthread_mutex_unlock(&(stack->top_lock));
+    cursor->node = block;
+    cursor->offset = remaining;
+    cursor->started = 1;
+    return copied;
+}
+
+int nextStackSpan(struct stack *stack, struct reservation_cursor *cursor, struct reservation_span *span) {
+    check_cursor(cursor, stack->removals, "nextStackSpan");
+    const struct stack_block *block = cursor->started ? cursor->node : stack->top;
+    cursor->started = 1;
+    cursor->removals = stack->removals;
+    if (block == NULL) {
+        return 0;
+    }
+    span->reservations = block->reservations;
+    span->count = block->count;
+    cursor->node = block->next;
+    return 1;
+}
+
+void finalizeStack(struct stack *stack) {
+    contention_lock(&(stack->top_lock), CONTENTION_STACK);
+    while (stack->top != NULL) {
+        struct stack_block *temp = stack->top;
+        stack->top = temp->next;
+        free(temp);
+    }
+    free(stack->spare);
+    stack->spare = NULL;
+    pthread_mutex_destroy(&(stack->top_lock));
+}
+
+#endif
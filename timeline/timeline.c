@@ -0,0 +1,134 @@
+#include "timeline.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *kind_names[TIMELINE_KINDS] = {"work", "barrier", "drain", "batch", "lock wait", "check"};
+
+__thread struct timeline_ring *timeline_slot = NULL;
+
+/**
+ * The timeline the rings belong to, for the threshold & capacity of the recording threads
+ */
+static struct timeline *recorded = NULL;
+
+uint64_t timeline_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + (uint64_t) ts.tv_nsec;
+}
+
+int timeline_init(struct timeline *timeline, unsigned int num_slots, unsigned int capacity,
+                  uint64_t lock_wait_threshold_ns) {
+    if (capacity > TIMELINE_MAX_EVENTS) capacity = TIMELINE_MAX_EVENTS;
+    unsigned int rounded = 1;
+    while (rounded < capacity) rounded <<= 1; // can't wrap, capacity is at most 2^24
+    size_t size = sizeof(struct timeline_ring) * (num_slots > 0 ? num_slots : 1);
+    timeline->rings = aligned_alloc(_Alignof(struct timeline_ring), size);
+    if (timeline->rings == NULL) {
+        return 0;
+    }
+    memset(timeline->rings, 0, size);
+    for (unsigned int i = 0; i < num_slots; i++) {
+        atomic_init(&timeline->rings[i].head, 0);
+    }
+    timeline->num_slots = num_slots;
+    timeline->capacity = rounded;
+    timeline->origin_ns = timeline_now();
+    timeline->lock_wait_threshold_ns = lock_wait_threshold_ns;
+    recorded = timeline;
+    return 1;
+}
+
+void timeline_attach(struct timeline *timeline, unsigned int slot, const char *name) {
+    struct timeline_ring *ring = &timeline->rings[slot];
+    // allocated by the thread itself, so the ring's pages are first touched where it runs
+    ring->events = malloc(sizeof(struct timeline_event) * timeline->capacity);
+    if (ring->events == NULL) {
+        return; // the thread goes unrecorded
+    }
+    snprintf(ring->thread_name, sizeof(ring->thread_name), "%s", name);
+    timeline_slot = ring;
+}
+
+void timeline_record(enum timeline_kind kind, const char *name, uint64_t start_ns, uint32_t count) {
+    struct timeline_ring *ring = timeline_slot;
+    if (ring == NULL) return;
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    struct timeline_event *event = &ring->events[head & (recorded->capacity - 1)];
+    event->start_ns = start_ns;
+    event->duration_ns = timeline_now() - start_ns;
+    event->name = name;
+    event->kind = kind;
+    event->count = count;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+void timeline_lock_wait(const char *name, uint64_t start_ns, uint64_t waited_ns) {
+    if (waited_ns < recorded->lock_wait_threshold_ns) return;
+    timeline_record(TIMELINE_LOCK_WAIT, name, start_ns, 0);
+}
+
+/**
+ * Prints a time as microseconds since the trace's origin, the unit of trace-event timestamps
+ */
+static void print_us(FILE *file, uint64_t ns) {
+    fprintf(file, "%" PRIu64 ".%03" PRIu64, ns / 1000, ns % 1000);
+}
+
+int timeline_write(struct timeline *timeline, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        return 0;
+    }
+    long pid = (long) getpid();
+    uint64_t written = 0, dropped = 0;
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":0,\"args\":{\"name\":\"hy486_project\"}}",
+            pid);
+    for (unsigned int slot = 0; slot < timeline->num_slots; slot++) {
+        struct timeline_ring *ring = &timeline->rings[slot];
+        if (ring->events == NULL) continue;
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                pid, slot + 1, ring->thread_name);
+        fprintf(file, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"sort_index\":%u}}",
+                pid, slot + 1, slot);
+
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t first = head > timeline->capacity ? head - timeline->capacity : 0;
+        dropped += first;
+        for (uint64_t i = first; i < head; i++) {
+            const struct timeline_event *event = &ring->events[i & (timeline->capacity - 1)];
+            // the origin is taken before any thread starts, but clamp in case a clock step says otherwise
+            uint64_t start = event->start_ns > timeline->origin_ns ? event->start_ns - timeline->origin_ns : 0;
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%ld,\"tid\":%u,\"ts\":",
+                    event->name, kind_names[event->kind], pid, slot + 1);
+            print_us(file, start);
+            fprintf(file, ",\"dur\":");
+            print_us(file, event->duration_ns);
+            if (event->count > 0) fprintf(file, ",\"args\":{\"reservations\":%u}", event->count);
+            fprintf(file, "}");
+            written++;
+        }
+    }
+    fprintf(file, "\n]}\n");
+    int ok = !ferror(file);
+    if (fclose(file) != 0) ok = 0;
+    if (ok) {
+        printf("Timeline of %" PRIu64 " events written to %s", written, path);
+        if (dropped > 0) printf(" (%" PRIu64 " older events overwritten, raise --timeline-events to keep them)", dropped);
+        printf("\n");
+    }
+    return ok;
+}
+
+void timeline_destroy(struct timeline *timeline) {
+    for (unsigned int slot = 0; slot < timeline->num_slots; slot++) {
+        free(timeline->rings[slot].events);
+    }
+    free(timeline->rings);
+    if (recorded == timeline) recorded = NULL;
+}
@@ -0,0 +1,107 @@
+#ifndef HY486_PROJECT_TIMELINE_H
+#define HY486_PROJECT_TIMELINE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "../layout/layout.h"
+
+/**
+ * The kinds of timeline events, which become the trace's categories
+ */
+enum timeline_kind {
+    TIMELINE_WORK, // a thread's share of a phase, e.g. an agency's bookings
+    TIMELINE_BARRIER, // from entering a barrier until leaving it
+    TIMELINE_DRAIN, // an airline emptying its queue or filling its stack
+    TIMELINE_BATCH, // a block of reservations moved at once
+    TIMELINE_LOCK_WAIT, // a lock wait over the threshold
+    TIMELINE_CHECK, // a controller check
+    TIMELINE_KINDS
+};
+
+/**
+ * The most events a ring may keep, so that rounding up to a power of two and sizing the ring can't overflow
+ */
+#define TIMELINE_MAX_EVENTS (1u << 24)
+
+/**
+ * A span of a thread's activity. The name must outlive the timeline, e.g. a string literal.
+ */
+struct timeline_event {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    const char *name;
+    uint32_t kind;
+    uint32_t count; // reservations the event moved, 0 if it isn't about any
+};
+
+/**
+ * The events of one thread. Only the thread itself writes its ring, overwriting the oldest events
+ * once it's full, and publishes each one by advancing head with a release store.
+ */
+struct timeline_ring {
+    _Alignas(CACHE_LINE_SIZE) _Atomic uint64_t head; // events written so far
+    struct timeline_event *events;
+    char thread_name[32]; // empty if no thread attached to the slot
+};
+
+/**
+ * A ring per agency (or replay worker), airline and the controller, written out at exit
+ */
+struct timeline {
+    struct timeline_ring *rings;
+    unsigned int num_slots;
+    unsigned int capacity; // events per ring, a power of two
+    uint64_t origin_ns; // the trace's time 0
+    uint64_t lock_wait_threshold_ns;
+};
+
+/**
+ * The calling thread's ring, NULL unless a timeline is recorded (--timeline) for it
+ */
+extern __thread struct timeline_ring *timeline_slot;
+
+uint64_t timeline_now(void);
+
+/**
+ * @param capacity Events kept per thread, rounded up to a power of two, at most TIMELINE_MAX_EVENTS
+ * @param lock_wait_threshold_ns Shorter lock waits aren't recorded
+ * @return 1 if successful, 0 otherwise
+ */
+int timeline_init(struct timeline *timeline, unsigned int num_slots, unsigned int capacity,
+                  uint64_t lock_wait_threshold_ns);
+
+/**
+ * Makes the calling thread record its events into a slot
+ * @param name The thread's name in the trace
+ */
+void timeline_attach(struct timeline *timeline, unsigned int slot, const char *name);
+
+/**
+ * Records a span of the calling thread that started at start_ns (from timeline_now) and ends now.
+ * Does nothing if the thread has no ring.
+ */
+void timeline_record(enum timeline_kind kind, const char *name, uint64_t start_ns, uint32_t count);
+
+/**
+ * Records a lock wait of the calling thread, if it took longer than the threshold
+ */
+void timeline_lock_wait(const char *name, uint64_t start_ns, uint64_t waited_ns);
+
+/**
+ * Opens a span in the current scope, to be closed with TIMELINE_END. Costs a thread-local load and a
+ * branch without a ring.
+ */
+#define TIMELINE_BEGIN(span) uint64_t span = timeline_slot != NULL ? timeline_now() : 0
+#define TIMELINE_END(span, kind, name, count) \
+    do { if (timeline_slot != NULL) timeline_record((kind), (name), (span), (count)); } while (0)
+
+/**
+ * Writes the events of all threads as Chrome trace-event JSON, which Perfetto and chrome://tracing
+ * load, one track per thread. The threads must have finished.
+ * @return 1 if successful, 0 otherwise
+ */
+int timeline_write(struct timeline *timeline, const char *path);
+
+void timeline_destroy(struct timeline *timeline);
+
+#endif //HY486_PROJECT_TIMELINE_H
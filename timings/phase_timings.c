@@ -0,0 +1,97 @@
+#define _GNU_SOURCE
+#include "phase_timings.h"
+#include <inttypes.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+static const char *phase_names[RUN_PHASES] = {"setup", "phase1", "check1", "phase2", "check2", "teardown"};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+void timings_start(struct phase_timings *timings) {
+    memset(timings, 0, sizeof(struct phase_timings));
+    timings->start = now_seconds();
+}
+
+void timings_end(struct phase_timings *timings, enum run_phase phase) {
+    timings->ends[phase] = now_seconds();
+}
+
+/**
+ * @return When the phase ended, or when the latest phase before it did if it never ended
+ */
+static double phase_end(const struct phase_timings *timings, int phase) {
+    for (; phase >= 0; phase--) {
+        if (timings->ends[phase] != 0) return timings->ends[phase];
+    }
+    return timings->start;
+}
+
+double timings_duration(const struct phase_timings *timings, enum run_phase phase) {
+    if (timings->ends[phase] == 0) return 0;
+    return timings->ends[phase] - phase_end(timings, (int) phase - 1);
+}
+
+double timings_run_seconds(const struct phase_timings *timings) {
+    return phase_end(timings, RUN_CHECK_2) - phase_end(timings, RUN_SETUP);
+}
+
+unsigned int timings_cpus(void) {
+    // e.g. fewer than online under taskset, which is how a sweep varies them
+    cpu_set_t allowed;
+    return sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? (unsigned int) CPU_COUNT(&allowed) : 0;
+}
+
+int timings_append(const char *path, const struct run_record *record, const struct phase_timings *timings) {
+    FILE *file = fopen(path, "a");
+    if (file == NULL) {
+        return 0;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long peak_rss_kb = usage.ru_maxrss; // kilobytes on Linux
+    unsigned int cpus = timings_cpus();
+    double total = phase_end(timings, RUN_PHASES - 1) - timings->start;
+    // what the "Run completed" line measures
+    double run = timings_run_seconds(timings);
+    double throughput = run > 0 ? (double) record->reservations / run : 0;
+
+    size_t length = strlen(path);
+    if (length >= 5 && strcmp(path + length - 5, ".json") == 0) {
+        fprintf(file, "{\"A\": %u, \"agencies\": %u, \"airlines\": %u, \"cpus\": %u, \"backend\": \"%s\", "
+                      "\"routing\": \"%s\", \"workload\": \"%s\", \"layout\": \"%s\", \"durable\": %s, "
+                      "\"checks\": \"%s\"",
+                record->num_flights, record->agencies, record->airlines, cpus, record->backend,
+                record->routing, record->workload, record->layout, record->durable ? "true" : "false",
+                record->checks_passed ? "passed" : "failed");
+        for (int phase = 0; phase < RUN_PHASES; phase++) {
+            fprintf(file, ", \"%s_s\": %.6f", phase_names[phase], timings_duration(timings, phase));
+        }
+        fprintf(file, ", \"total_s\": %.6f, \"reservations\": %" PRIu64 ", \"reservations_per_s\": %.0f, "
+                      "\"peak_rss_kb\": %ld}\n", total, record->reservations, throughput, peak_rss_kb);
+    } else {
+        fseek(file, 0, SEEK_END);
+        if (ftell(file) == 0) {
+            fprintf(file, "A,agencies,airlines,cpus,backend,routing,workload,layout,durable,checks");
+            for (int phase = 0; phase < RUN_PHASES; phase++) {
+                fprintf(file, ",%s_s", phase_names[phase]);
+            }
+            fprintf(file, ",total_s,reservations,reservations_per_s,peak_rss_kb\n");
+        }
+        fprintf(file, "%u,%u,%u,%u,%s,%s,%s,%s,%s,%s", record->num_flights, record->agencies, record->airlines,
+                cpus, record->backend, record->routing, record->workload, record->layout,
+                record->durable ? "yes" : "no", record->checks_passed ? "passed" : "failed");
+        for (int phase = 0; phase < RUN_PHASES; phase++) {
+            fprintf(file, ",%.6f", timings_duration(timings, phase));
+        }
+        fprintf(file, ",%.6f,%" PRIu64 ",%.0f,%ld\n", total, record->reservations, throughput, peak_rss_kb);
+    }
+    return fclose(file) == 0;
+}
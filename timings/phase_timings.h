@@ -0,0 +1,74 @@
+#ifndef HY486_PROJECT_PHASE_TIMINGS_H
+#define HY486_PROJECT_PHASE_TIMINGS_H
+
+#include <stdint.h>
+
+/**
+ * The phases of a run, in the order they end
+ */
+enum run_phase {
+    RUN_SETUP, // parsing the options, generating the workload & allocating the flights table
+    RUN_PHASE_1, // booking, until the agencies reach the phase 1 checks barrier
+    RUN_CHECK_1, // the phase 1 checks, reports and snapshot
+    RUN_PHASE_2, // redistribution, until the airlines reach the phase 2 checks barrier
+    RUN_CHECK_2, // the final checks and reports
+    RUN_TEARDOWN, // joining the threads and freeing everything
+    RUN_PHASES
+};
+
+/**
+ * When each phase of a run ended. A phase that never ends (e.g. the phase 1 checks of a pipelined
+ * run) takes no time, as if it ended right when the one before it did.
+ */
+struct phase_timings {
+    double start;
+    double ends[RUN_PHASES]; // 0 for phases that haven't ended
+};
+
+/**
+ * What a run was, to tell apart the records of a sweep
+ */
+struct run_record {
+    unsigned int num_flights; // A
+    unsigned int agencies;
+    unsigned int airlines;
+    const char *backend; // e.g. "center", "p2p", "adaptive-p2p", "pipelined" or "service"
+    const char *routing;
+    const char *workload;
+    const char *layout; // "default", "cache", "unrolled" or "cache+unrolled"
+    uint64_t reservations; // booked in the run
+    int durable; // whether every operation was logged with --wal
+    int checks_passed;
+};
+
+void timings_start(struct phase_timings *timings);
+
+/**
+ * Records that a phase ended now. Safe to call from the controller while the main thread waits.
+ */
+void timings_end(struct phase_timings *timings, enum run_phase phase);
+
+/**
+ * @return How long a phase took, in seconds
+ */
+double timings_duration(const struct phase_timings *timings, enum run_phase phase);
+
+/**
+ * @return How long booking & redistribution took, until the final checks ended, in seconds
+ */
+double timings_run_seconds(const struct phase_timings *timings);
+
+/**
+ * @return The CPUs the calling thread may run on, 0 if unknown
+ */
+unsigned int timings_cpus(void);
+
+/**
+ * Appends the record, the CPUs the run could use, the duration of every phase, the reservations per second
+ * and the peak resident memory to a file. Paths ending in ".json" get a JSON object per line, anything else a CSV row, with
+ * a header if the file is new or empty, so that the runs of a sweep accumulate in one file.
+ * @return 1 if successful, 0 otherwise
+ */
+int timings_append(const char *path, const struct run_record *record, const struct phase_timings *timings);
+
+#endif //HY486_PROJECT_PHASE_TIMINGS_H
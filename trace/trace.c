@@ -0,0 +1,184 @@
+#include "trace.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @return The bytes the capacities take, padded to keep the records 8-byte aligned
+ */
+static size_t capacities_size(uint32_t numOfFlights) {
+    return sizeof(uint32_t) * (((size_t) numOfFlights + 1) & ~(size_t) 1);
+}
+
+int trace_open(const char *path, struct trace *trace) {
+    memset(trace, 0, sizeof(struct trace));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("trace");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct trace_header)) {
+        fprintf(stderr, "trace: %s is too short\n", path);
+        close(fd);
+        return 0;
+    }
+    void *mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (mapping == MAP_FAILED) {
+        perror("trace mmap");
+        return 0;
+    }
+    // records are streamed front to back by every worker
+    madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    trace->mapping = mapping;
+    trace->length = st.st_size;
+    trace->header = (const struct trace_header *) mapping;
+
+    const struct trace_header *header = trace->header;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0 || header->version != TRACE_VERSION ||
+        header->record_size != sizeof(struct trace_record)) {
+        fprintf(stderr, "trace: %s is not a version %d trace\n", path, TRACE_VERSION);
+        trace_close(trace);
+        return 0;
+    }
+    if (header->num_flights == 0 || header->num_agencies == 0) {
+        fprintf(stderr, "trace: %s has no flights or agencies\n", path);
+        trace_close(trace);
+        return 0;
+    }
+    size_t records_offset = sizeof(struct trace_header) + capacities_size(header->num_flights);
+    size_t expected;
+    if (__builtin_mul_overflow(header->record_count, sizeof(struct trace_record), &expected) ||
+        __builtin_add_overflow(expected, records_offset, &expected) || trace->length != expected) {
+        fprintf(stderr, "trace: %s is truncated or corrupt (%zu bytes)\n", path, trace->length);
+        trace_close(trace);
+        return 0;
+    }
+    trace->capacities = (const uint32_t *) ((const char *) mapping + sizeof(struct trace_header));
+    trace->records = (const struct trace_record *) ((const char *) mapping + records_offset);
+
+    // checked once here rather than while replaying, so that a bad record can't be skipped silently
+    for (uint64_t r = 0; r < header->record_count; r++) {
+        const struct trace_record *record = &trace->records[r];
+        const char *problem = NULL;
+        if (record->agency_id < 1 || (uint32_t) record->agency_id > header->num_agencies) {
+            problem = "an agency outside the trace's agencies";
+        } else if (record->flight >= header->num_flights) {
+            problem = "a flight outside the trace's flights";
+        } else if (record->reservation_number == -1) {
+            problem = "reservation number -1, which marks an empty queue or list";
+        } else if ((reservation_number_t) record->reservation_number != record->reservation_number) {
+            problem = "a reservation number that doesn't fit this build (see LARGE_SCALE)";
+        }
+        if (problem != NULL) {
+            fprintf(stderr, "trace: record %" PRIu64 " of %s has %s\n", r, path, problem);
+            trace_close(trace);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+keysum_t trace_keysum(const struct trace *trace) {
+    return ((keysum_t) trace->header->keysum_high << 64) | trace->header->keysum_low;
+}
+
+unsigned int trace_flight_capacity(const struct trace *trace, unsigned int flight) {
+    return trace->capacities[flight];
+}
+
+int trace_partition(const struct trace *trace, unsigned int num_workers, struct trace_partition *partition) {
+    partition->num_workers = num_workers;
+    partition->offsets = calloc((size_t) num_workers + 1, sizeof(uint64_t));
+    partition->indices = malloc(sizeof(uint64_t) * (trace->header->record_count > 0 ? trace->header->record_count : 1));
+    if (partition->offsets == NULL || partition->indices == NULL) {
+        fprintf(stderr, "trace: could not allocate the replay partition\n");
+        trace_partition_destroy(partition);
+        return 0;
+    }
+    // a counting sort by worker, which keeps the trace order within each worker's share
+    const struct trace_record *records = trace->records;
+    for (uint64_t r = 0; r < trace->header->record_count; r++) {
+        partition->offsets[(uint32_t) (records[r].agency_id - 1) % num_workers + 1]++;
+    }
+    for (unsigned int w = 0; w < num_workers; w++) {
+        partition->offsets[w + 1] += partition->offsets[w];
+    }
+    uint64_t *next = malloc(sizeof(uint64_t) * num_workers);
+    if (next == NULL) {
+        fprintf(stderr, "trace: could not allocate the replay partition\n");
+        trace_partition_destroy(partition);
+        return 0;
+    }
+    memcpy(next, partition->offsets, sizeof(uint64_t) * num_workers);
+    for (uint64_t r = 0; r < trace->header->record_count; r++) {
+        partition->indices[next[(uint32_t) (records[r].agency_id - 1) % num_workers]++] = r;
+    }
+    free(next);
+    return 1;
+}
+
+void trace_partition_destroy(struct trace_partition *partition) {
+    free(partition->offsets);
+    free(partition->indices);
+    partition->offsets = NULL;
+    partition->indices = NULL;
+}
+
+int trace_write_synthetic(const char *path, unsigned int numOfFlights, const unsigned int *capacities) {
+    uint64_t numOfAgencies = (uint64_t) numOfFlights * numOfFlights;
+    struct trace_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(struct trace_record);
+    header.num_flights = numOfFlights;
+    header.num_agencies = numOfAgencies;
+    header.record_count = expected_total_size(numOfFlights);
+    keysum_t keysum = expected_total_keysum(numOfFlights);
+    header.keysum_low = (uint64_t) keysum;
+    header.keysum_high = (uint64_t) (keysum >> 64);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror("trace");
+        return 0;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (unsigned int i = 0; ok && i < numOfFlights; i++) {
+        uint32_t capacity = capacities[i];
+        ok = fwrite(&capacity, sizeof(capacity), 1, file) == 1;
+    }
+    if (ok && numOfFlights % 2 == 1) {
+        uint32_t padding = 0;
+        ok = fwrite(&padding, sizeof(padding), 1, file) == 1;
+    }
+    // same numbering as agency_main: the i-th reservation of agency X is i*P + X and goes to flight (X-1) mod A
+    for (unsigned int i = 0; ok && i < numOfFlights; i++) {
+        for (uint64_t agency_id = 1; ok && agency_id <= numOfAgencies; agency_id++) {
+            struct trace_record record;
+            record.agency_id = (int32_t) agency_id;
+            record.flight = (agency_id - 1) % numOfFlights;
+            record.reservation_number = (int64_t) i * numOfAgencies + agency_id;
+            record.timestamp_ns = (uint64_t) i * 1000;
+            ok = fwrite(&record, sizeof(record), 1, file) == 1;
+        }
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        perror("trace");
+    }
+    return ok;
+}
+
+void trace_close(struct trace *trace) {
+    if (trace->mapping != NULL) {
+        munmap(trace->mapping, trace->length);
+    }
+    memset(trace, 0, sizeof(struct trace));
+}
@@ -0,0 +1,89 @@
+#ifndef HY486_PROJECT_TRACE_H
+#define HY486_PROJECT_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/keysum.h"
+#include "../common/reservations.h"
+
+#define TRACE_MAGIC "HYTRACE\0"
+#define TRACE_VERSION 2
+
+/**
+ * A trace file is the header, the stack capacity of every flight (num_flights uint32_t values,
+ * padded with a zero to an even count so that the records stay 8-byte aligned) and record_count
+ * trace_record entries in timestamp order.
+ */
+struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size; // sizeof(struct trace_record)
+    uint32_t num_flights;
+    uint32_t num_agencies;
+    uint64_t record_count;
+    uint64_t keysum_low; // sum of all reservation numbers, split in two 64-bit halves
+    uint64_t keysum_high;
+};
+
+struct trace_record {
+    int32_t agency_id; // 1..num_agencies
+    uint32_t flight; // position in the flights table
+    int64_t reservation_number; // never -1, which the queues & list return when they're empty
+    uint64_t timestamp_ns; // offset from the start of the trace
+};
+
+/**
+ * A trace file mapped in memory
+ */
+struct trace {
+    void *mapping;
+    size_t length;
+    const struct trace_header *header;
+    const uint32_t *capacities;
+    const struct trace_record *records;
+};
+
+/**
+ * The records of a trace split between the replay workers by agency, agency X going to worker
+ * (X - 1) mod num_workers, so that every agency's reservations are booked by a single worker
+ * in the order of the trace
+ */
+struct trace_partition {
+    unsigned int num_workers;
+    uint64_t *offsets; // worker w replays the records indices[offsets[w]] up to indices[offsets[w + 1] - 1]
+    uint64_t *indices; // positions of the records, in trace order within each worker's share
+};
+
+/**
+ * Maps and validates a trace file, rejecting it if any record has an agency, flight or
+ * reservation number that this build can't book.
+ * @return 1 if successful, 0 otherwise
+ */
+int trace_open(const char *path, struct trace *trace);
+
+keysum_t trace_keysum(const struct trace *trace);
+
+/**
+ * @return The stack capacity the trace gives the flight
+ */
+unsigned int trace_flight_capacity(const struct trace *trace, unsigned int flight);
+
+/**
+ * Splits the records of an open trace between the given number of workers, by agency.
+ * @return 1 if successful, 0 otherwise
+ */
+int trace_partition(const struct trace *trace, unsigned int num_workers, struct trace_partition *partition);
+
+void trace_partition_destroy(struct trace_partition *partition);
+
+/**
+ * Writes the reservations that the agencies of a regular run with A flights would
+ * produce as a trace, with each agency booking one reservation per microsecond.
+ * @param capacities The stack capacity of every flight
+ * @return 1 if successful, 0 otherwise
+ */
+int trace_write_synthetic(const char *path, unsigned int numOfFlights, const unsigned int *capacities);
+
+void trace_close(struct trace *trace);
+
+#endif //HY486_PROJECT_TRACE_H
@@ -0,0 +1,308 @@
+#include "exactly_once.h"
+#include "../stack/stack.h"
+#include "../queue/queue.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+/**
+ * Reservations a worker exports from a structure at a time
+ */
+#define VERIFICATION_CHUNK 1024
+
+/**
+ * State shared by the verification workers
+ */
+struct verification {
+    struct flight_reservations **flights;
+    unsigned int num_flights;
+    struct list *management_center;
+    uint64_t expected;
+    _Atomic uint64_t *bitmap; // bit n - 1 stands for reservation number n
+    size_t words;
+    unsigned int num_workers;
+    atomic_uint next_task; // flights 0..A-1, then the center
+    pthread_mutex_t start_lock;
+    pthread_cond_t start_cond;
+    int released; // the walked barrier is set up, the workers can start walking
+    pthread_barrier_t walked; // every reservation has been marked, the bitmap can be counted
+    pthread_mutex_t result_lock;
+    struct exactly_once_result *result;
+};
+
+struct verification_worker {
+    struct verification *verification;
+    unsigned int index;
+    pthread_t thread;
+    int started;
+};
+
+/**
+ * Counters of a single worker, merged into the result once it's done
+ */
+struct worker_tally {
+    uint64_t found;
+    uint64_t duplicates;
+    uint64_t strays;
+    reservation_number_t first_duplicate;
+};
+
+static void mark(struct verification *verification, struct worker_tally *tally, reservation_number_t number) {
+    tally->found++;
+    if (number < 1 || (uint64_t) number > verification->expected) {
+        tally->strays++;
+        return;
+    }
+    uint64_t bit = (uint64_t) number - 1;
+    uint64_t mask = 1ull << (bit & 63);
+    _Atomic uint64_t *word = &verification->bitmap[bit >> 6];
+    uint64_t old;
+    if (verification->num_workers > 1) {
+        old = atomic_fetch_or_explicit(word, mask, memory_order_relaxed);
+    } else {
+        // nobody else writes the bitmap, so the locked RMW isn't needed
+        old = atomic_load_explicit(word, memory_order_relaxed);
+        atomic_store_explicit(word, old | mask, memory_order_relaxed);
+    }
+    if (old & mask) {
+        if (tally->duplicates++ == 0) tally->first_duplicate = number;
+    }
+}
+
+static void mark_chunk(struct verification *verification, struct worker_tally *tally,
+                       const struct Reservation *chunk, unsigned int count) {
+    for (unsigned int i = 0; i < count; i++) {
+        mark(verification, tally, chunk[i].reservation_number);
+    }
+}
+
+#ifdef UNROLLED_NODES
+/**
+ * Marks a flight's stack and queue block by block, in place, since the containers are quiescent
+ * while they are verified
+ */
+static void walk_flight(struct verification *verification, struct worker_tally *tally, unsigned int flight) {
+    struct reservation_span span;
+    struct reservation_cursor stack_cursor = {0};
+    while (nextStackSpan(verification->flights[flight]->completed_reservations, &stack_cursor, &span)) {
+        mark_chunk(verification, tally, span.reservations, span.count);
+    }
+    struct reservation_cursor queue_cursor = {0};
+    while (nextQueueSpan(verification->flights[flight]->pending_reservations, &queue_cursor, &span)) {
+        mark_chunk(verification, tally, span.reservations, span.count);
+    }
+}
+#else
+/**
+ * Marks a flight's stack and queue, exported a chunk at a time so that no lock is held while marking
+ */
+static void walk_flight(struct verification *verification, struct worker_tally *tally, unsigned int flight) {
+    struct Reservation chunk[VERIFICATION_CHUNK];
+    unsigned int count;
+    struct reservation_cursor stack_cursor = {0};
+    while ((count = exportStack(verification->flights[flight]->completed_reservations, &stack_cursor, chunk,
+                                VERIFICATION_CHUNK)) > 0) {
+        mark_chunk(verification, tally, chunk, count);
+    }
+    struct reservation_cursor queue_cursor = {0};
+    while ((count = exportQueue(verification->flights[flight]->pending_reservations, &queue_cursor, chunk,
+                                VERIFICATION_CHUNK)) > 0) {
+        mark_chunk(verification, tally, chunk, count);
+    }
+}
+#endif
+
+static void walk_center(struct verification *verification, struct worker_tally *tally) {
+    struct Reservation chunk[VERIFICATION_CHUNK];
+    unsigned int count;
+    struct reservation_cursor cursor = {0};
+    while ((count = exportList(verification->management_center, &cursor, chunk, VERIFICATION_CHUNK)) > 0) {
+        mark_chunk(verification, tally, chunk, count);
+    }
+}
+
+static uint64_t popcount_scalar(const uint64_t *words, size_t count) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < count; i++) {
+        bits += __builtin_popcountll(words[i]);
+    }
+    return bits;
+}
+
+#ifdef HAVE_X86_SIMD
+/**
+ * Counts bits 256 at a time, looking up the count of every nibble with a byte shuffle
+ * and summing the bytes of each 64-bit lane with a SAD against zero
+ */
+__attribute__((target("avx2")))
+static uint64_t popcount_avx2(const uint64_t *words, size_t count) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (words + i));
+        __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_nibbles));
+        __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256()));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcount_scalar(words + i, count - i);
+}
+#endif
+
+static uint64_t popcount_words(const uint64_t *words, size_t count) {
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return popcount_avx2(words, count);
+    }
+#endif
+    return popcount_scalar(words, count);
+}
+
+/**
+ * Walks the flights and the center that no other worker has taken yet
+ */
+static void walk_tasks(struct verification *verification, struct worker_tally *tally) {
+    while (1) {
+        unsigned int task = atomic_fetch_add_explicit(&verification->next_task, 1, memory_order_relaxed);
+        if (task > verification->num_flights) break;
+        if (task == verification->num_flights) {
+            walk_center(verification, tally);
+        } else {
+            walk_flight(verification, tally, task);
+        }
+    }
+}
+
+/**
+ * Counts the bits of a worker's contiguous share of the bitmap, once every reservation has been marked
+ */
+static uint64_t count_share(const struct verification *verification, unsigned int index) {
+    size_t share = (verification->words + verification->num_workers - 1) / verification->num_workers;
+    size_t first = share * index;
+    size_t last = first + share < verification->words ? first + share : verification->words;
+    return first < last ? popcount_words((const uint64_t *) verification->bitmap + first, last - first) : 0;
+}
+
+static void merge_tally(struct verification *verification, const struct worker_tally *tally, uint64_t distinct) {
+    pthread_mutex_lock(&verification->result_lock);
+    struct exactly_once_result *result = verification->result;
+    result->found += tally->found;
+    result->distinct += distinct;
+    result->strays += tally->strays;
+    if (tally->duplicates > 0 && (result->duplicates == 0 || tally->first_duplicate < result->first_duplicate)) {
+        result->first_duplicate = tally->first_duplicate;
+    }
+    result->duplicates += tally->duplicates;
+    pthread_mutex_unlock(&verification->result_lock);
+}
+
+static void *verification_worker_main(void *args) {
+    struct verification_worker *worker = (struct verification_worker *) args;
+    struct verification *verification = worker->verification;
+    struct worker_tally tally = {0, 0, 0, -1};
+
+    // the walked barrier is only sized once the calling thread knows how many workers started
+    pthread_mutex_lock(&verification->start_lock);
+    while (!verification->released) pthread_cond_wait(&verification->start_cond, &verification->start_lock);
+    pthread_mutex_unlock(&verification->start_lock);
+
+    walk_tasks(verification, &tally);
+    pthread_barrier_wait(&verification->walked);
+    merge_tally(verification, &tally, count_share(verification, worker->index));
+    return NULL;
+}
+
+int verify_exactly_once(struct flight_reservations **flights, unsigned int numOfFlights,
+                        struct list *management_center, uint64_t expected, unsigned int workers,
+                        struct exactly_once_result *result) {
+    memset(result, 0, sizeof(struct exactly_once_result));
+    result->first_duplicate = -1;
+    result->first_missing = -1;
+
+    struct verification verification;
+    verification.flights = flights;
+    verification.num_flights = numOfFlights;
+    verification.management_center = management_center;
+    verification.expected = expected;
+    verification.words = (expected + 63) / 64;
+    verification.result = result;
+    // anonymous pages are zero and only faulted in by the workers that touch them
+    size_t length = verification.words > 0 ? verification.words * sizeof(uint64_t) : sizeof(uint64_t);
+    void *bitmap = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bitmap == MAP_FAILED) {
+        return 0;
+    }
+    verification.bitmap = bitmap;
+
+    if (workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cpus > 0 ? (unsigned int) cpus : 1;
+    }
+    if (workers > numOfFlights + 1) workers = numOfFlights + 1; // no more than there are structures to walk
+    struct verification_worker *pool = workers > 1 ? calloc(workers, sizeof(struct verification_worker)) : NULL;
+    if (pool == NULL) workers = 1; // verified on the calling thread alone
+    verification.num_workers = workers;
+    atomic_init(&verification.next_task, 0);
+    pthread_mutex_init(&verification.result_lock, NULL);
+    pthread_mutex_init(&verification.start_lock, NULL);
+    pthread_cond_init(&verification.start_cond, NULL);
+    verification.released = 0;
+
+    // the calling thread is worker 0, and also counts the shares of workers whose thread didn't start
+    unsigned int started = 0;
+    for (unsigned int i = 1; i < workers; i++) {
+        pool[i].verification = &verification;
+        pool[i].index = i;
+        pool[i].started = pthread_create(&pool[i].thread, NULL, verification_worker_main, &pool[i]) == 0;
+        if (pool[i].started) started++;
+    }
+    pthread_barrier_init(&verification.walked, NULL, started + 1);
+    pthread_mutex_lock(&verification.start_lock);
+    verification.released = 1;
+    pthread_cond_broadcast(&verification.start_cond);
+    pthread_mutex_unlock(&verification.start_lock);
+
+    struct worker_tally tally = {0, 0, 0, -1};
+    walk_tasks(&verification, &tally);
+    pthread_barrier_wait(&verification.walked);
+    uint64_t distinct = count_share(&verification, 0);
+    for (unsigned int i = 1; i < workers; i++) {
+        if (!pool[i].started) distinct += count_share(&verification, i);
+    }
+    merge_tally(&verification, &tally, distinct);
+    for (unsigned int i = 1; i < workers; i++) {
+        if (pool[i].started) pthread_join(pool[i].thread, NULL);
+    }
+    free(pool);
+
+    if (result->distinct != expected) {
+        // locate the first hole for the report, skipping over complete words
+        const uint64_t *words = (const uint64_t *) verification.bitmap;
+        for (size_t i = 0; i < verification.words; i++) {
+            if (words[i] != ~0ull) {
+                uint64_t bit = i * 64 + __builtin_ctzll(~words[i]);
+                if (bit < expected) result->first_missing = (reservation_number_t) (bit + 1);
+                break;
+            }
+        }
+    }
+
+    pthread_barrier_destroy(&verification.walked);
+    pthread_cond_destroy(&verification.start_cond);
+    pthread_mutex_destroy(&verification.start_lock);
+    pthread_mutex_destroy(&verification.result_lock);
+    munmap(bitmap, length);
+    return 1;
+}
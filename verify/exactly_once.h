@@ -0,0 +1,36 @@
+#ifndef HY486_PROJECT_EXACTLY_ONCE_H
+#define HY486_PROJECT_EXACTLY_ONCE_H
+
+#include <stdint.h>
+#include "../common/reservations.h"
+#include "../list/lazy_list.h"
+
+/**
+ * What an exactly-once verification found
+ */
+struct exactly_once_result {
+    uint64_t found; // reservations walked
+    uint64_t distinct; // bits set in the bitmap
+    uint64_t duplicates; // reservations whose bit was already set
+    uint64_t strays; // reservations outside 1..expected
+    reservation_number_t first_duplicate; // -1 if none
+    reservation_number_t first_missing; // -1 if none
+};
+
+/**
+ * @brief Verifies that the stacks, queues and center hold every reservation number in 1..expected exactly once.
+ *
+ * Parallel workers claim the flights (and the center) one at a time, walk their structures and set a
+ * bit per reservation with an atomic OR, which reports a duplicate as soon as its bit was already set.
+ * The same workers then count the set bits, with an AVX2 popcount where the CPU supports it, and any
+ * shortfall is a hole. Unlike the size & keysum checks, a duplicate can't hide behind a lost reservation.
+ * The structures must be quiescent, e.g. at the controller's barriers.
+ * @param workers Threads to use, 0 for one per online CPU. The calling thread is one of them and takes over
+ * the share of any that can't be started, or of all of them if their state can't be allocated.
+ * @return 1 if the verification could run, 0 if the bitmap couldn't be allocated
+ */
+int verify_exactly_once(struct flight_reservations **flights, unsigned int numOfFlights,
+                        struct list *management_center, uint64_t expected, unsigned int workers,
+                        struct exactly_once_result *result);
+
+#endif //HY486_PROJECT_EXACTLY_ONCE_H
@@ -0,0 +1,530 @@
+#include "wal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The calling thread's writer, registered with the log on its first append
+ */
+static __thread struct wal_writer *thread_writer = NULL;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Writes the whole range, retrying on short writes & interrupts.
+ * @return 1 if successful, 0 otherwise
+ */
+static int write_fully(int fd, const void *data, size_t length) {
+    const char *bytes = data;
+    while (length > 0) {
+        ssize_t written = write(fd, bytes, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        bytes += written;
+        length -= written;
+    }
+    return 1;
+}
+
+/**
+ * A record that can't be buffered or committed would be acknowledged without being durable,
+ * so the run stops instead
+ */
+static void wal_fail(const char *what) {
+    perror(what);
+    fprintf(stderr, "wal: stopping the run, logged operations can no longer be made durable\n");
+    exit(-1);
+}
+
+static struct wal_buffer *take_buffer(struct wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    struct wal_buffer *buffer = wal->free_buffers;
+    if (buffer != NULL) {
+        wal->free_buffers = buffer->next;
+    }
+    pthread_mutex_unlock(&wal->lock);
+
+    if (buffer == NULL) {
+        buffer = malloc(sizeof(struct wal_buffer) + sizeof(struct wal_record) * wal->batch_size);
+        if (buffer == NULL) {
+            wal_fail("wal buffer");
+        }
+    }
+    buffer->next = NULL;
+    buffer->count = 0;
+    return buffer;
+}
+
+static void recycle_buffer(struct wal *wal, struct wal_buffer *buffer) {
+    pthread_mutex_lock(&wal->lock);
+    buffer->next = wal->free_buffers;
+    wal->free_buffers = buffer;
+    pthread_mutex_unlock(&wal->lock);
+}
+
+static void hand_off(struct wal *wal, struct wal_buffer *buffer) {
+    pthread_mutex_lock(&wal->lock);
+    if (wal->ready_tail == NULL) {
+        wal->ready_head = buffer;
+    } else {
+        wal->ready_tail->next = buffer;
+    }
+    wal->ready_tail = buffer;
+    pthread_cond_signal(&wal->ready_cond);
+    pthread_mutex_unlock(&wal->lock);
+}
+
+static struct wal_writer *add_writer(struct wal *wal) {
+    struct wal_writer *writer = calloc(1, sizeof(struct wal_writer));
+    if (writer == NULL) {
+        wal_fail("wal writer");
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_mutex_lock(&wal->lock);
+    writer->next = wal->writers;
+    wal->writers = writer;
+    pthread_mutex_unlock(&wal->lock);
+    return writer;
+}
+
+/**
+ * Hands off the partially filled buffer of every writer, once its records have waited for as long
+ * as they may. Writer locks are taken before the log's lock, never while holding it.
+ */
+static void take_partial_buffers(struct wal *wal) {
+    pthread_mutex_lock(&wal->lock);
+    struct wal_writer *writers = wal->writers;
+    pthread_mutex_unlock(&wal->lock);
+
+    for (struct wal_writer *writer = writers; writer != NULL; writer = writer->next) {
+        pthread_mutex_lock(&writer->lock);
+        struct wal_buffer *buffer = writer->buffer;
+        if (buffer != NULL && buffer->count > 0) {
+            writer->buffer = NULL;
+            hand_off(wal, buffer);
+            wal->partial_buffers++;
+        }
+        pthread_mutex_unlock(&writer->lock);
+    }
+}
+
+/**
+ * The flusher waits for handed-off buffers or for the latency bound to expire, in which case it takes
+ * the partially filled buffers too, then writes everything that is ready and commits it with a single fdatasync.
+ */
+static void *flusher_main(void *args) {
+    struct wal *wal = (struct wal *) args;
+    double latency = wal->latency_us / 1e6;
+    double next_deadline = now_seconds() + latency;
+
+    while (1) {
+        pthread_mutex_lock(&wal->lock);
+        while (wal->ready_head == NULL && !wal->stopping) {
+            double wait = next_deadline - now_seconds();
+            if (wait <= 0) break;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += (time_t) wait;
+            deadline.tv_nsec += (long) ((wait - (time_t) wait) * 1e9);
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&wal->ready_cond, &wal->lock, &deadline);
+        }
+        pthread_mutex_unlock(&wal->lock);
+
+        if (now_seconds() >= next_deadline) {
+            take_partial_buffers(wal);
+            next_deadline = now_seconds() + latency;
+        }
+
+        pthread_mutex_lock(&wal->lock);
+        struct wal_buffer *batch = wal->ready_head;
+        wal->ready_head = wal->ready_tail = NULL;
+        int stopping = wal->stopping;
+        pthread_mutex_unlock(&wal->lock);
+
+        if (batch != NULL) {
+            double start = now_seconds();
+            struct wal_buffer *last = batch;
+            for (struct wal_buffer *buffer = batch; buffer != NULL; buffer = buffer->next) {
+                size_t length = sizeof(struct wal_record) * buffer->count;
+                if (!write_fully(wal->fd, buffer->records, length)) {
+                    wal_fail("wal write");
+                }
+                wal->records += buffer->count;
+                wal->bytes += length;
+                last = buffer;
+            }
+            if (fdatasync(wal->fd) != 0) {
+                wal_fail("wal fdatasync");
+            }
+            wal->commits++;
+            wal->commit_seconds += now_seconds() - start;
+
+            // recycle the written buffers
+            pthread_mutex_lock(&wal->lock);
+            last->next = wal->free_buffers;
+            wal->free_buffers = batch;
+            pthread_mutex_unlock(&wal->lock);
+        } else if (stopping) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+struct wal *wal_open(const char *path, unsigned int batch_size, unsigned int latency_us, unsigned int numOfFlights,
+                     const unsigned int *capacities) {
+    struct wal *wal = (struct wal *) calloc(1, sizeof(struct wal));
+    if (wal == NULL) {
+        return NULL;
+    }
+    wal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (wal->fd < 0) {
+        perror("wal open");
+        free(wal);
+        return NULL;
+    }
+
+    struct wal_file_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, WAL_MAGIC, sizeof(header.magic));
+    header.version = WAL_VERSION;
+    header.record_size = sizeof(struct wal_record);
+    header.num_flights = numOfFlights;
+    uint32_t *stored = malloc(sizeof(uint32_t) * (numOfFlights > 0 ? numOfFlights : 1));
+    for (unsigned int i = 0; stored != NULL && i < numOfFlights; i++) {
+        stored[i] = capacities[i];
+    }
+    // the header & capacities are committed before any record, so a recovery can always size the flights
+    if (stored == NULL || !write_fully(wal->fd, &header, sizeof(header)) ||
+        !write_fully(wal->fd, stored, sizeof(uint32_t) * numOfFlights) || fdatasync(wal->fd) != 0) {
+        perror("wal header");
+        free(stored);
+        close(wal->fd);
+        free(wal);
+        return NULL;
+    }
+    free(stored);
+
+    wal->batch_size = batch_size > 0 ? batch_size : 1;
+    wal->latency_us = latency_us > 0 ? latency_us : 1;
+    pthread_mutex_init(&wal->lock, NULL);
+    pthread_cond_init(&wal->ready_cond, NULL);
+    int error = pthread_create(&wal->flusher, NULL, flusher_main, wal);
+    if (error != 0) {
+        // without the flusher nothing would ever group-commit
+        fprintf(stderr, "wal flusher: %s\n", strerror(error));
+        pthread_cond_destroy(&wal->ready_cond);
+        pthread_mutex_destroy(&wal->lock);
+        close(wal->fd);
+        free(wal);
+        return NULL;
+    }
+    return wal;
+}
+
+void wal_append(struct wal *wal, enum wal_record_type type, unsigned int flight, struct Reservation reservation) {
+    struct wal_writer *writer = thread_writer;
+    if (writer == NULL) {
+        writer = thread_writer = add_writer(wal);
+    }
+
+    pthread_mutex_lock(&writer->lock);
+    struct wal_buffer *buffer = writer->buffer;
+    if (buffer == NULL) {
+        buffer = writer->buffer = take_buffer(wal);
+    }
+    struct wal_record *record = &buffer->records[buffer->count++];
+    record->header = ((uint32_t) type << 24) | (flight & 0xFFFFFF);
+    record->agency_id = reservation.agency_id;
+    record->reservation_number = reservation.reservation_number;
+    if (buffer->count == wal->batch_size) {
+        writer->buffer = NULL;
+        hand_off(wal, buffer);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void wal_flush_thread(struct wal *wal) {
+    struct wal_writer *writer = thread_writer;
+    if (writer == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&writer->lock);
+    struct wal_buffer *buffer = writer->buffer;
+    writer->buffer = NULL;
+    if (buffer != NULL) {
+        if (buffer->count > 0) {
+            hand_off(wal, buffer);
+        } else {
+            recycle_buffer(wal, buffer);
+        }
+    }
+    pthread_mutex_unlock(&writer->lock);
+    thread_writer = NULL; // the writer stays registered, empty, until the log is destroyed
+}
+
+void wal_close(struct wal *wal) {
+    if (wal == NULL || wal->fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&wal->lock);
+    wal->stopping = 1;
+    pthread_cond_signal(&wal->ready_cond);
+    pthread_mutex_unlock(&wal->lock);
+    pthread_join(wal->flusher, NULL);
+
+    close(wal->fd);
+    wal->fd = -1;
+}
+
+void wal_destroy(struct wal *wal) {
+    if (wal == NULL) {
+        return;
+    }
+    while (wal->free_buffers != NULL) {
+        struct wal_buffer *buffer = wal->free_buffers;
+        wal->free_buffers = buffer->next;
+        free(buffer);
+    }
+    while (wal->writers != NULL) {
+        struct wal_writer *writer = wal->writers;
+        wal->writers = writer->next;
+        free(writer->buffer);
+        pthread_mutex_destroy(&writer->lock);
+        free(writer);
+    }
+    pthread_cond_destroy(&wal->ready_cond);
+    pthread_mutex_destroy(&wal->lock);
+    free(wal);
+}
+
+void wal_print_stats(struct wal *wal) {
+    printf("WAL: %" PRIu64 " records, %" PRIu64 " bytes in %" PRIu64 " group commits (%.1f records/commit, "
+           "%" PRIu64 " buffers taken at their deadline, %.3f s in write+fdatasync)\n",
+           wal->records, wal->bytes, wal->commits,
+           wal->commits > 0 ? (double) wal->records / wal->commits : 0.0, wal->partial_buffers, wal->commit_seconds);
+}
+
+static int compare_records(const void *a, const void *b) {
+    int64_t x = ((const struct wal_record *) a)->reservation_number;
+    int64_t y = ((const struct wal_record *) b)->reservation_number;
+    return (x > y) - (x < y);
+}
+
+static enum wal_record_type record_type(const struct wal_record *record) {
+    return (enum wal_record_type) (record->header >> 24);
+}
+
+static unsigned int record_flight(const struct wal_record *record) {
+    return record->header & 0xFFFFFF;
+}
+
+/**
+ * Where the records of one reservation put it
+ * @param stacked Set to 1 if it's on the returned flight's stack, 0 if it's pending in its queue
+ * @return The flight
+ */
+static unsigned int place_reservation(const struct wal_record *records, size_t count, int *stacked) {
+    for (size_t i = 0; i < count; i++) {
+        enum wal_record_type type = record_type(&records[i]);
+        if (type != WAL_PUSH && type != WAL_TO_STACK) continue;
+        unsigned int flight = record_flight(&records[i]);
+        long balance = 0;
+        for (size_t j = 0; j < count; j++) {
+            if (record_flight(&records[j]) != flight) continue;
+            type = record_type(&records[j]);
+            if (type == WAL_PUSH || type == WAL_TO_STACK) balance++;
+            if (type == WAL_STACK_FULL) balance--;
+        }
+        if (balance > 0) {
+            *stacked = 1;
+            return flight;
+        }
+    }
+    *stacked = 0;
+    for (size_t i = 0; i < count; i++) {
+        enum wal_record_type type = record_type(&records[i]);
+        if (type == WAL_ENQUEUE || type == WAL_STACK_FULL) return record_flight(&records[i]);
+    }
+    return record_flight(&records[0]); // its booking record was lost, any queue will redistribute it
+}
+
+int wal_recover(const char *path, struct snapshot *snapshot, struct wal_recovery *recovery) {
+    memset(snapshot, 0, sizeof(struct snapshot));
+    memset(recovery, 0, sizeof(struct wal_recovery));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("wal recover");
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct wal_file_header)) {
+        fprintf(stderr, "wal: %s is too short to be a log\n", path);
+        close(fd);
+        return 0;
+    }
+    size_t length = st.st_size;
+    const char *log = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (log == MAP_FAILED) {
+        perror("wal mmap");
+        return 0;
+    }
+    const struct wal_file_header *header = (const struct wal_file_header *) log;
+    if (memcmp(header->magic, WAL_MAGIC, sizeof(header->magic)) != 0 || header->version != WAL_VERSION ||
+        header->record_size != sizeof(struct wal_record)) {
+        fprintf(stderr, "wal: %s is not a version %d log\n", path, WAL_VERSION);
+        munmap((void *) log, length);
+        return 0;
+    }
+    unsigned int numOfFlights = header->num_flights;
+    size_t records_offset = sizeof(struct wal_file_header) + sizeof(uint32_t) * (size_t) numOfFlights;
+    if (numOfFlights == 0 || numOfFlights > 0xFFFFFF || length < records_offset) {
+        fprintf(stderr, "wal: %s has a corrupt header\n", path);
+        munmap((void *) log, length);
+        return 0;
+    }
+    uint32_t *capacities = malloc(sizeof(uint32_t) * numOfFlights);
+    size_t available = (length - records_offset) / sizeof(struct wal_record);
+    struct wal_record *records = malloc(sizeof(struct wal_record) * (available > 0 ? available : 1));
+    uint64_t *stack_counts = calloc(numOfFlights, sizeof(uint64_t));
+    uint64_t *queue_counts = calloc(numOfFlights, sizeof(uint64_t));
+    uint64_t *promoted_counts = calloc(numOfFlights, sizeof(uint64_t));
+    if (capacities == NULL || records == NULL || stack_counts == NULL || queue_counts == NULL ||
+        promoted_counts == NULL) {
+        fprintf(stderr, "wal: could not allocate the recovery of %s\n", path);
+        free(capacities);
+        free(records);
+        free(stack_counts);
+        free(queue_counts);
+        free(promoted_counts);
+        munmap((void *) log, length);
+        return 0;
+    }
+    memcpy(capacities, log + sizeof(struct wal_file_header), sizeof(uint32_t) * numOfFlights);
+
+    // a crash can leave a torn record or zeroed blocks after the last write, so reading stops at the first invalid one
+    size_t count = 0;
+    for (; count < available; count++) {
+        memcpy(&records[count], log + records_offset + count * sizeof(struct wal_record), sizeof(struct wal_record));
+        enum wal_record_type type = record_type(&records[count]);
+        int64_t number = records[count].reservation_number;
+        if (type < WAL_PUSH || type > WAL_STACK_FULL || record_flight(&records[count]) >= numOfFlights ||
+            number < RESERVATION_NUMBER_MIN || number > RESERVATION_NUMBER_MAX || number == -1) {
+            break;
+        }
+    }
+    recovery->records = count;
+    recovery->ignored_bytes = length - records_offset - count * sizeof(struct wal_record);
+    munmap((void *) log, length);
+    qsort(records, count, sizeof(struct wal_record), compare_records);
+
+    // first pass: place every reservation and count what each stack & queue gets
+    uint64_t reservations = 0;
+    for (size_t first = 0, last; first < count; first = last) {
+        for (last = first + 1; last < count && records[last].reservation_number == records[first].reservation_number;) {
+            last++;
+        }
+        int stacked;
+        unsigned int flight = place_reservation(records + first, last - first, &stacked);
+        if (stacked && stack_counts[flight] < capacities[flight]) {
+            stack_counts[flight]++;
+        } else {
+            queue_counts[flight]++;
+        }
+        reservations++;
+    }
+    // each thread's buffer commits on its own, so a queued reservation may have survived the pushes
+    // before it. A queue only fills once its stack is full, so the first pending ones take the free seats
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        uint64_t free_seats = capacities[i] - stack_counts[i];
+        promoted_counts[i] = queue_counts[i] < free_seats ? queue_counts[i] : free_seats;
+        stack_counts[i] += promoted_counts[i];
+        queue_counts[i] -= promoted_counts[i];
+    }
+
+    // laid out as a snapshot with an empty center, so that it restores like one
+    size_t entries_offset = sizeof(struct snapshot_header);
+    size_t reservations_offset = entries_offset + sizeof(struct snapshot_flight) * numOfFlights;
+    size_t mapping_length = reservations_offset + sizeof(struct Reservation) * reservations;
+    void *mapping = mmap(NULL, mapping_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        perror("wal recover");
+        free(capacities);
+        free(records);
+        free(stack_counts);
+        free(queue_counts);
+        free(promoted_counts);
+        return 0;
+    }
+    struct snapshot_header *restored = mapping;
+    memcpy(restored->magic, SNAPSHOT_MAGIC, sizeof(restored->magic));
+    restored->version = SNAPSHOT_VERSION;
+    restored->reservation_size = sizeof(struct Reservation);
+    restored->num_flights = numOfFlights;
+    restored->center_first = reservations;
+    restored->center_count = 0;
+    struct snapshot_flight *entries = (struct snapshot_flight *) ((char *) mapping + entries_offset);
+    struct Reservation *placed = (struct Reservation *) ((char *) mapping + reservations_offset);
+    uint64_t next = 0;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        entries[i].capacity = capacities[i];
+        entries[i].stack_count = stack_counts[i];
+        entries[i].queue_count = queue_counts[i];
+        entries[i].first = next;
+        next += stack_counts[i] + queue_counts[i];
+        recovery->stacked += stack_counts[i];
+        recovery->pending += queue_counts[i];
+        // reused as the next free position of the flight's stack & queue
+        queue_counts[i] = entries[i].first + stack_counts[i];
+        stack_counts[i] = entries[i].first;
+    }
+
+    // second pass: the same placements, written out
+    for (size_t first = 0, last; first < count; first = last) {
+        for (last = first + 1; last < count && records[last].reservation_number == records[first].reservation_number;) {
+            last++;
+        }
+        int stacked;
+        unsigned int flight = place_reservation(records + first, last - first, &stacked);
+        struct Reservation reservation;
+        reservation.agency_id = records[first].agency_id;
+        reservation.reservation_number = (reservation_number_t) records[first].reservation_number;
+        // stacks with seats left over for pending reservations hold every stacked one
+        if (stacked && stack_counts[flight] < entries[flight].first + entries[flight].stack_count) {
+            placed[stack_counts[flight]++] = reservation;
+        } else if (!stacked && promoted_counts[flight] > 0) {
+            promoted_counts[flight]--;
+            placed[stack_counts[flight]++] = reservation;
+        } else {
+            placed[queue_counts[flight]++] = reservation;
+        }
+    }
+    recovery->reservations = reservations;
+    free(capacities);
+    free(records);
+    free(stack_counts);
+    free(queue_counts);
+    free(promoted_counts);
+
+    snapshot->mapping = mapping;
+    snapshot->length = mapping_length;
+    snapshot->header = restored;
+    snapshot->flights = entries;
+    snapshot->reservations = placed;
+    return 1;
+}
@@ -0,0 +1,153 @@
+#ifndef HY486_PROJECT_WAL_H
+#define HY486_PROJECT_WAL_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "../common/reservations.h"
+#include "../snapshot/snapshot.h"
+
+#define WAL_MAGIC "HYWAL\0\0\0"
+#define WAL_VERSION 2
+
+/**
+ * Every record is appended before the operation it describes is applied, so the log
+ * holds at least every operation whose effect could have been seen.
+ */
+enum wal_record_type {
+    WAL_PUSH = 1, // an agency pushes a reservation to a flight's stack
+    WAL_ENQUEUE = 2, // an agency enqueues a reservation to a flight's pending queue
+    WAL_TO_CENTER = 3, // an airline moves a reservation from its queue to the center
+    WAL_TO_STACK = 4, // an airline moves a reservation to a flight's stack, from the center or a queue (p2p)
+    WAL_STACK_FULL = 5 // a logged push or move found the flight's stack full, the reservation goes to its queue instead
+};
+
+/**
+ * The file starts with this header and the stack capacity of every flight (num_flights
+ * uint32_t values), followed by wal_record entries
+ */
+struct wal_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t num_flights;
+    uint32_t reserved;
+};
+
+/**
+ * A single 16-byte log entry
+ */
+struct wal_record {
+    uint32_t header; // record type in the top 8 bits, flight index in the low 24 bits
+    int32_t agency_id;
+    int64_t reservation_number;
+};
+
+/**
+ * A batch of records filled by a single thread and then handed off to the flusher
+ */
+struct wal_buffer {
+    struct wal_buffer *next;
+    unsigned int count;
+    struct wal_record records[];
+};
+
+/**
+ * The buffer an appending thread is filling. The lock is only contended when the flusher
+ * takes a partially filled buffer whose records have waited for their deadline.
+ */
+struct wal_writer {
+    pthread_mutex_t lock;
+    struct wal_buffer *buffer; // NULL until the thread appends again
+    struct wal_writer *next; // writers are only added, and freed with the log
+};
+
+/**
+ * @brief A write-ahead reservation log with group commit.
+ *
+ * Threads append records to a buffer of their own, under a lock only the flusher also takes.
+ * Full buffers are handed off to a dedicated flusher thread, which every latency_us also takes
+ * the partially filled buffers of all threads, writes every buffer handed off so far and then
+ * issues a single fdatasync for all of them. Appending never waits on the disk. A record is
+ * committed at most latency_us (plus the time a commit takes) after it was appended.
+ */
+struct wal {
+    int fd;
+    unsigned int batch_size; // records per buffer
+    unsigned int latency_us; // how long an appended record may wait before the flusher takes it
+    pthread_mutex_t lock; // protects the ready, free & writer lists and the stopping flag
+    pthread_cond_t ready_cond;
+    struct wal_buffer *ready_head; // buffers waiting to be written
+    struct wal_buffer *ready_tail;
+    struct wal_buffer *free_buffers; // written buffers that can be reused
+    struct wal_writer *writers;
+    int stopping;
+    pthread_t flusher;
+    // flusher statistics
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t commits;
+    uint64_t partial_buffers; // buffers the flusher took before they were full
+    double commit_seconds;
+};
+
+/**
+ * Creates (truncating) the log file, writes the stack capacity of every flight and starts
+ * the flusher thread.
+ * @return The log or NULL if the file could not be created
+ */
+struct wal *wal_open(const char *path, unsigned int batch_size, unsigned int latency_us, unsigned int numOfFlights,
+                     const unsigned int *capacities);
+
+/**
+ * Appends a record to the calling thread's buffer, before the operation it describes is applied.
+ * Only one log may be in use per process, since the writer is kept in thread-local storage.
+ * Exits the process if no buffer can be allocated, rather than losing the record.
+ */
+void wal_append(struct wal *wal, enum wal_record_type type, unsigned int flight, struct Reservation reservation);
+
+/**
+ * Hands off whatever the calling thread has buffered. Must be called by every
+ * appending thread once it is done, before the log is closed.
+ */
+void wal_flush_thread(struct wal *wal);
+
+/**
+ * Commits all handed-off records, stops the flusher and closes the file. Does nothing if it's already closed.
+ * The statistics remain available until the log is destroyed.
+ */
+void wal_close(struct wal *wal);
+
+void wal_destroy(struct wal *wal);
+
+void wal_print_stats(struct wal *wal);
+
+/**
+ * What a recovery found in a log
+ */
+struct wal_recovery {
+    uint64_t records; // complete, valid records read
+    uint64_t ignored_bytes; // a torn or invalid tail after the last valid record
+    uint64_t reservations; // distinct reservation numbers
+    uint64_t stacked; // reservations recovered onto a stack
+    uint64_t pending; // reservations recovered into a queue
+};
+
+/**
+ * @brief Rebuilds the state a logged run had reached from its log.
+ *
+ * The records of a reservation come from different threads, so they aren't ordered in the file.
+ * They're grouped by reservation number (which is unique within a run) and the reservation is
+ * placed from their counts alone: on the stack of a flight that has more PUSH & TO_STACK records
+ * than STACK_FULL ones, otherwise pending in the queue of the flight it was booked on. Reservations
+ * that had reached the center go back to that queue, so the result is a phase 1 state which phase 2
+ * redistributes again, and stacks that would overflow (their STACK_FULL record was lost) spill into
+ * their queue. Since every thread's buffer commits on its own, a flight's ENQUEUE or STACK_FULL records
+ * may survive without all of the pushes before them; its first pending reservations then fill the free
+ * seats of its stack, so that a queue is only left non-empty next to a full stack, as in phase 1.
+ * Reading stops at the first torn or invalid record.
+ * @param snapshot Filled in with the rebuilt state, in an anonymous mapping released by snapshot_close
+ * @return 1 if successful, 0 otherwise
+ */
+int wal_recover(const char *path, struct snapshot *snapshot, struct wal_recovery *recovery);
+
+#endif //HY486_PROJECT_WAL_H
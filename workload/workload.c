@@ -0,0 +1,218 @@
+#include "workload.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * splitmix64, used both as the agency PRNG and to derive per-agency seeds
+ */
+static uint64_t next_random(uint64_t *state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * @return A uniform double in [0, 1)
+ */
+static double next_uniform(uint64_t *state) {
+    return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_seconds(double seconds) {
+    if (seconds <= 0) {
+        return;
+    }
+    struct timespec ts = {(time_t) seconds, (long) ((seconds - (time_t) seconds) * 1e9)};
+    nanosleep(&ts, NULL);
+}
+
+int workload_init(struct workload *workload, const struct workload_config *config, unsigned int numOfFlights) {
+    workload->config = *config;
+    workload->num_flights = numOfFlights;
+    workload->cdf = malloc(sizeof(double) * numOfFlights);
+    workload->rank_to_flight = malloc(sizeof(unsigned int) * numOfFlights);
+    if (workload->cdf == NULL || workload->rank_to_flight == NULL) {
+        workload_destroy(workload);
+        return 0;
+    }
+
+    // P(rank = r) is proportional to 1 / (r + 1)^s
+    double total = 0;
+    for (unsigned int r = 0; r < numOfFlights; r++) {
+        total += 1.0 / pow(r + 1, config->zipf_s);
+        workload->cdf[r] = total;
+    }
+    for (unsigned int r = 0; r < numOfFlights; r++) {
+        workload->cdf[r] /= total;
+    }
+    workload->cdf[numOfFlights - 1] = 1.0;
+
+    // seeded Fisher-Yates shuffle of the flights
+    uint64_t state = config->seed;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        workload->rank_to_flight[i] = i;
+    }
+    for (unsigned int i = numOfFlights - 1; i > 0; i--) {
+        unsigned int j = next_random(&state) % (i + 1);
+        unsigned int tmp = workload->rank_to_flight[i];
+        workload->rank_to_flight[i] = workload->rank_to_flight[j];
+        workload->rank_to_flight[j] = tmp;
+    }
+    return 1;
+}
+
+void workload_agency_init(const struct workload *workload, struct workload_agency *agency, int agency_id) {
+    uint64_t state = workload->config.seed ^ ((uint64_t) agency_id * 0xD1B54A32D192ED03ull);
+    agency->rng = next_random(&state);
+    agency->next_time = 0;
+    // stagger the agencies over the burst cycle so they don't all burst at once
+    double cycle = (workload->config.burst_on_ms + workload->config.burst_off_ms) / 1e3;
+    agency->burst_offset = next_uniform(&agency->rng) * cycle;
+    // drawn from the seed's own stream rather than the agency's, so that rates don't change the flights
+    const struct workload_config *config = &workload->config;
+    agency->rate = config->agency_rate;
+    if (config->agency_rate > 0 && config->agency_rate_max > config->agency_rate) {
+        agency->rate = config->agency_rate * pow(config->agency_rate_max / config->agency_rate, next_uniform(&state));
+    }
+}
+
+unsigned int workload_next_flight(const struct workload *workload, struct workload_agency *agency,
+                                  unsigned int home_flight) {
+    if (workload->config.distribution == FLIGHTS_FIXED) {
+        return home_flight;
+    }
+    // binary search for the first rank whose cdf covers u
+    double u = next_uniform(&agency->rng);
+    unsigned int low = 0, high = workload->num_flights - 1;
+    while (low < high) {
+        unsigned int mid = low + (high - low) / 2;
+        if (workload->cdf[mid] > u) {
+            high = mid;
+        } else {
+            low = mid + 1;
+        }
+    }
+    return workload->rank_to_flight[low];
+}
+
+void workload_pace(const struct workload *workload, struct workload_agency *agency, double start) {
+    const struct workload_config *config = &workload->config;
+    double now = now_seconds();
+
+    if (config->burst_off_ms > 0) {
+        // idle until the next active window of this agency's burst cycle
+        double on = config->burst_on_ms / 1e3;
+        double cycle = on + config->burst_off_ms / 1e3;
+        double position = fmod(now - start + agency->burst_offset, cycle);
+        if (position >= on) {
+            sleep_seconds(cycle - position);
+            now = now_seconds();
+        }
+    }
+
+    if (agency->rate > 0) {
+        if (agency->next_time < now - 1.0 / agency->rate) {
+            agency->next_time = now; // don't catch up on time spent idle
+        }
+        sleep_seconds(agency->next_time - now);
+        agency->next_time += 1.0 / agency->rate;
+    }
+}
+
+/**
+ * A thread regenerating the choices of the agencies first_agency, first_agency + stride, ...
+ */
+struct counting_worker {
+    const struct workload *workload;
+    unsigned int first_agency;
+    unsigned int stride;
+    unsigned int num_agencies;
+    unsigned int reservations_per_agency;
+    uint64_t *counts; // private to the worker, merged once it's done
+    pthread_t thread;
+    int started;
+};
+
+static void *count_agencies(void *args) {
+    struct counting_worker *worker = (struct counting_worker *) args;
+    const struct workload *workload = worker->workload;
+    for (unsigned int agency_id = worker->first_agency; agency_id <= worker->num_agencies; agency_id += worker->stride) {
+        struct workload_agency agency;
+        workload_agency_init(workload, &agency, agency_id);
+        unsigned int home_flight = (agency_id - 1) % workload->num_flights;
+        for (unsigned int i = 0; i < worker->reservations_per_agency; i++) {
+            worker->counts[workload_next_flight(workload, &agency, home_flight)]++;
+        }
+    }
+    return NULL;
+}
+
+int workload_expected_counts(const struct workload *workload, unsigned int numOfAgencies,
+                             unsigned int reservationsPerAgency, uint64_t *counts) {
+    unsigned int numOfFlights = workload->num_flights;
+    for (unsigned int i = 0; i < numOfFlights; i++) {
+        counts[i] = 0;
+    }
+    if (workload->config.distribution == FLIGHTS_FIXED) {
+        for (unsigned int agency_id = 1; agency_id <= numOfAgencies; agency_id++) {
+            counts[(agency_id - 1) % numOfFlights] += reservationsPerAgency;
+        }
+        return 1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int num_workers = cpus > 0 ? (unsigned int) cpus : 1;
+    if (num_workers > numOfAgencies) num_workers = numOfAgencies > 0 ? numOfAgencies : 1;
+    struct counting_worker *workers = calloc(num_workers, sizeof(struct counting_worker));
+    uint64_t *worker_counts = calloc((size_t) num_workers * numOfFlights, sizeof(uint64_t));
+    if (workers == NULL || worker_counts == NULL) {
+        free(workers);
+        free(worker_counts);
+        return 0;
+    }
+    for (unsigned int w = 0; w < num_workers; w++) {
+        workers[w].workload = workload;
+        workers[w].first_agency = w + 1;
+        workers[w].stride = num_workers;
+        workers[w].num_agencies = numOfAgencies;
+        workers[w].reservations_per_agency = reservationsPerAgency;
+        workers[w].counts = worker_counts + (size_t) w * numOfFlights;
+    }
+    // the calling thread takes the first share itself
+    for (unsigned int w = 1; w < num_workers; w++) {
+        workers[w].started = pthread_create(&workers[w].thread, NULL, count_agencies, &workers[w]) == 0;
+    }
+    count_agencies(&workers[0]);
+    for (unsigned int w = 1; w < num_workers; w++) {
+        if (workers[w].started) {
+            pthread_join(workers[w].thread, NULL);
+        } else {
+            count_agencies(&workers[w]); // a share whose thread didn't start is counted here instead
+        }
+    }
+    for (unsigned int w = 0; w < num_workers; w++) {
+        for (unsigned int i = 0; i < numOfFlights; i++) {
+            counts[i] += workers[w].counts[i];
+        }
+    }
+    free(workers);
+    free(worker_counts);
+    return 1;
+}
+
+void workload_destroy(struct workload *workload) {
+    free(workload->cdf);
+    free(workload->rank_to_flight);
+    workload->cdf = NULL;
+    workload->rank_to_flight = NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef HY486_PROJECT_WORKLOAD_H
+#define HY486_PROJECT_WORKLOAD_H
+
+#include <stdint.h>
+
+enum flight_distribution {
+    FLIGHTS_FIXED, // agency X books every reservation on flight (X-1) mod A
+    FLIGHTS_ZIPF // every reservation picks a flight from a Zipf distribution
+};
+
+struct workload_config {
+    enum flight_distribution distribution;
+    double zipf_s; // Zipf exponent, larger values concentrate more reservations on the hottest flights
+    uint64_t seed;
+    double agency_rate; // reservations per second per agency while active, 0 for unthrottled
+    double agency_rate_max; // each agency draws its own rate log-uniformly from [agency_rate, agency_rate_max]
+    unsigned int burst_on_ms; // agencies alternate between booking for burst_on_ms and idling for burst_off_ms
+    unsigned int burst_off_ms; // 0 disables bursts
+};
+
+/**
+ * @brief A deterministic synthetic workload shared (read-only) by all agencies.
+ *
+ * Flight ranks are mapped to flights through a seeded permutation, so the hottest
+ * flight is not always the one with the smallest stack.
+ */
+struct workload {
+    struct workload_config config;
+    unsigned int num_flights;
+    double *cdf; // cdf[r] = P(rank <= r)
+    unsigned int *rank_to_flight;
+};
+
+/**
+ * The generator state of a single agency, private to its thread
+ */
+struct workload_agency {
+    uint64_t rng;
+    double rate; // this agency's reservations per second while active, 0 for unthrottled
+    double next_time; // earliest time the next reservation may be booked
+    double burst_offset; // phase of the agency within the burst cycle, in seconds
+};
+
+/**
+ * @return 1 if successful, 0 otherwise
+ */
+int workload_init(struct workload *workload, const struct workload_config *config, unsigned int numOfFlights);
+
+/**
+ * Seeds an agency's generator and draws its rate. The same seed and agency always produce
+ * the same flights, whatever the rates.
+ */
+void workload_agency_init(const struct workload *workload, struct workload_agency *agency, int agency_id);
+
+/**
+ * @param home_flight The flight the agency is assigned to under the fixed mapping
+ * @return The flight the agency's next reservation goes to
+ */
+unsigned int workload_next_flight(const struct workload *workload, struct workload_agency *agency,
+                                  unsigned int home_flight);
+
+/**
+ * Sleeps until the agency may book its next reservation, according to its rate and burst phase.
+ * @param start When the agencies started, in CLOCK_MONOTONIC seconds
+ */
+void workload_pace(const struct workload *workload, struct workload_agency *agency, double start);
+
+/**
+ * Computes how many reservations each flight receives. The fixed mapping gives every agency's
+ * reservations to its home flight, otherwise every agency's choices are regenerated, spread
+ * over one thread per online CPU.
+ * @param counts An array of numOfFlights entries
+ * @return 1 if successful, 0 otherwise
+ */
+int workload_expected_counts(const struct workload *workload, unsigned int numOfAgencies,
+                             unsigned int reservationsPerAgency, uint64_t *counts);
+
+void workload_destroy(struct workload *workload);
+
+#endif //HY486_PROJECT_WORKLOAD_H